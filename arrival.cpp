@@ -0,0 +1,53 @@
+#include "arrival.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+ArrivalRaster *newArrival(int64_t width, int64_t height, int bytes) {
+    ArrivalRaster *arrival = (ArrivalRaster *) std::malloc(sizeof(ArrivalRaster));
+    if (arrival == NULL)
+        return NULL;
+    arrival->width = width;
+    arrival->height = height;
+    arrival->bytes = bytes == 2 ? 2 : 4;
+    arrival->steps = std::malloc(arrival->bytes*width*height);
+    if (arrival->steps == NULL) {
+        std::free(arrival);
+        return NULL;
+    }
+    // All ones is ARRIVAL_NONE at either size
+    memset(arrival->steps, 0xff, arrival->bytes*width*height);
+    return arrival;
+}
+
+void freeArrival(ArrivalRaster *arrival) {
+    std::free(arrival->steps);
+    std::free(arrival);
+}
+
+void seedArrival(ArrivalRaster *arrival, const Vertex *grid) {
+    for (int64_t tile = 0; tile < arrival->width*arrival->height; tile++) {
+        if (grid[tile*6].col[0] != 0)
+            setArrival(arrival, tile, 0);
+    }
+}
+
+uint32_t getArrival(const ArrivalRaster *arrival, int64_t i, int64_t j) {
+    int64_t tile = i*arrival->width + j;
+    if (arrival->bytes == 2) {
+        uint16_t step = ((const uint16_t *) arrival->steps)[tile];
+        return step == 0xffff ? ARRIVAL_NONE : step;
+    }
+    return ((const uint32_t *) arrival->steps)[tile];
+}
+
+// The plane is already in the file's layout on little-endian machines, so it
+// goes out in one write.
+void writeArrival(const ArrivalRaster *arrival, FILE *file) {
+    uint32_t bytes = arrival->bytes;
+    uint64_t size[2] = {(uint64_t) arrival->width, (uint64_t) arrival->height};
+    fwrite("FTOA", 1, 4, file);
+    fwrite(&bytes, sizeof(uint32_t), 1, file);
+    fwrite(size, sizeof(uint64_t), 2, file);
+    fwrite(arrival->steps, arrival->bytes, arrival->width*arrival->height, file);
+}
@@ -0,0 +1,50 @@
+#ifndef ARRIVAL_H
+#define ARRIVAL_H
+
+#include "grid.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Stored for tiles the fire has not reached
+#define ARRIVAL_NONE 0xffffffffu
+
+// Time of arrival: for each tile of a width x height grid, the step the fire
+// took its fuel in, counted as eventFire counts them. Tiles burning before
+// the first step arrived at 0 and a tile taken by stepping with step s arrived
+// at s+1. A tile hit twice at once arrives too, though it never burns.
+//
+// The engines write into it as tiles burn when one is attached, so nothing has
+// to be replayed afterwards. With 2 bytes per tile steps past 65534 are stored
+// as 65534.
+typedef struct ArrivalRaster
+{
+    int64_t width;
+    int64_t height;
+    int bytes;
+    void *steps;
+} ArrivalRaster;
+
+// bytes is 2 or 4. Every tile starts out not reached. Returns NULL if the
+// raster cannot be allocated.
+ArrivalRaster *newArrival(int64_t width, int64_t height, int bytes);
+void freeArrival(ArrivalRaster *arrival);
+// Marks tiles of a Vertex grid that are burning as arrived at step 0, for
+// engines started from a grid with fire already on it. Tiles without fuel
+// stay ARRIVAL_NONE: a grid cannot tell ones that burned out from ones that
+// never had any.
+void seedArrival(ArrivalRaster *arrival, const Vertex *grid);
+// The step tile (i, j) arrived at, or ARRIVAL_NONE.
+uint32_t getArrival(const ArrivalRaster *arrival, int64_t i, int64_t j);
+// "FTOA", then bytes per tile as a little-endian uint32, width and height as
+// uint64, then the plane row by row, ARRIVAL_NONE truncated to the tile size
+// for tiles not reached.
+void writeArrival(const ArrivalRaster *arrival, FILE *file);
+
+inline void setArrival(ArrivalRaster *arrival, int64_t tile, uint32_t step) {
+    if (arrival->bytes == 2)
+        ((uint16_t *) arrival->steps)[tile] = step < 0xfffe ? step : 0xfffe;
+    else
+        ((uint32_t *) arrival->steps)[tile] = step;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include "batch.h"
+#include "ensemble.h"
+#include "rng.h"
+
+#include <math.h>
+#include <chrono>
+
+// Random stream the batch seeds are drawn from
+#define BATCH_STREAM 6
+
+// 95% two-sided normal quantile
+const double BATCH_Z = 1.96;
+
+// What the workers pull batches from, guarded by the run's lock
+typedef struct BatchPool
+{
+    Vertex *grid;
+    BatchRun *run;
+    const BatchTarget *target;
+    float odds;
+    uint64_t seed;
+    int64_t next_batch;
+    int64_t batches;
+    int64_t since_check;
+} BatchPool;
+
+static void pullBatches(void *context, int64_t task, int worker);
+static bool checkBatches(BatchRun *run, const BatchTarget *target);
+
+BatchRun *runBatches(Vertex *grid, int64_t width, int64_t height, float odds, uint64_t seed,
+                     const BatchTarget *target, Scheduler *scheduler) {
+    BatchRun *run = new BatchRun;
+    run->width = width;
+    run->height = height;
+    run->burn_counts.assign(width*height, 0);
+    run->realizations = 0;
+    run->burned_sum = 0;
+    run->burned_squares = 0;
+    run->mean_burned = 0;
+    run->burned_half_width = 0;
+    run->probability_half_width = 0;
+    run->converged = false;
+    run->run_us = 0;
+    run->check_us = 0;
+
+    // Whole ensembles only, so max_realizations is never passed unless it is
+    // below a single one
+    int64_t batches = target->max_realizations / ENSEMBLE_LANES;
+    if (batches < 1 && target->max_realizations > 0)
+        batches = 1;
+    BatchPool pool = {grid, run, target, odds, seed, 0, batches, 0};
+    auto start = std::chrono::high_resolution_clock::now();
+    runTasks(scheduler, scheduler->workers, pullBatches, &pool);
+    // Batches merged after the last check, including those still running when
+    // it converged, or a check never reached
+    if (run->checks.empty() || run->checks.back().realizations != run->realizations)
+        checkBatches(run, target);
+    auto end = std::chrono::high_resolution_clock::now();
+    run->run_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    return run;
+}
+
+void freeBatchRun(BatchRun *run) {
+    delete run;
+}
+
+// Each worker takes the next batch as soon as it is done with one, runs it to
+// the end and adds it in, until the run converges or every batch is taken.
+// Merging takes one pass over the grid under the lock, against thousands of
+// steps over it to run. Batches already running when the run converges are
+// still merged, so the batches merged are always 0 to some b.
+static void pullBatches(void *context, int64_t, int) {
+    BatchPool *pool = (BatchPool *) context;
+    BatchRun *run = pool->run;
+    std::vector<uint8_t> counts(run->width*run->height);
+    while (true) {
+        int64_t batch;
+        {
+            std::lock_guard<std::mutex> guard(run->lock);
+            if (run->converged || pool->next_batch >= pool->batches)
+                return;
+            batch = pool->next_batch++;
+        }
+        uint64_t seed = rngHash(pool->seed, batch, 0, BATCH_STREAM);
+        Ensemble *ensemble = newEnsemble(pool->grid, run->width, run->height);
+        for (int step = 0; stepEnsemble(ensemble, pool->odds, seed, step) != 0; step++)
+            ;
+        ensembleBurnCounts(ensemble, counts.data());
+        int64_t burned[ENSEMBLE_LANES];
+        ensembleLaneBurned(ensemble, burned);
+        freeEnsemble(ensemble);
+
+        std::lock_guard<std::mutex> guard(run->lock);
+        auto start = std::chrono::high_resolution_clock::now();
+        uint32_t *burn_counts = run->burn_counts.data();
+        for (int64_t tile = 0; tile < run->width*run->height; tile++)
+            burn_counts[tile] += counts[tile];
+        for (int lane = 0; lane < ENSEMBLE_LANES; lane++) {
+            run->burned_sum += burned[lane];
+            run->burned_squares += (double) burned[lane]*burned[lane];
+        }
+        run->realizations += ENSEMBLE_LANES;
+        auto end = std::chrono::high_resolution_clock::now();
+        run->check_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (!run->converged && ++pool->since_check >= BATCH_CHECK_EVERY) {
+            pool->since_check = 0;
+            checkBatches(run, pool->target);
+        }
+    }
+}
+
+// The least certain tile is the one burned in closest to half the
+// realizations, so one pass finds it. Its interval is Agresti-Coull's, which
+// unlike the plain normal one does not shrink to nothing for tiles that have
+// always or never burned so far.
+static bool checkBatches(BatchRun *run, const BatchTarget *target) {
+    auto start = std::chrono::high_resolution_clock::now();
+    int64_t n = run->realizations;
+    int64_t closest = n;
+    const uint32_t *burn_counts = run->burn_counts.data();
+    for (int64_t tile = 0; tile < run->width*run->height; tile++) {
+        int64_t off = llabs(2*(int64_t) burn_counts[tile] - n);
+        if (off < closest)
+            closest = off;
+    }
+    double adjusted_n = n + BATCH_Z*BATCH_Z;
+    double p = ((n - closest)/2. + BATCH_Z*BATCH_Z/2.) / adjusted_n;
+    run->probability_half_width = BATCH_Z*sqrt(p*(1-p)/adjusted_n);
+
+    run->mean_burned = run->burned_sum / n;
+    double variance = (run->burned_squares - n*run->mean_burned*run->mean_burned) / (n > 1 ? n-1 : 1);
+    run->burned_half_width = BATCH_Z*sqrt(variance > 0 ? variance/n : 0);
+
+    run->checks.push_back({n, run->probability_half_width, run->burned_half_width});
+    run->converged = n >= target->min_realizations
+        && run->probability_half_width <= target->probability_half_width
+        && run->burned_half_width <= target->burned_half_width*run->mean_burned;
+    auto end = std::chrono::high_resolution_clock::now();
+    run->check_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    return run->converged;
+}
@@ -0,0 +1,73 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "grid.h"
+#include "sched.h"
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+// Merged batches between checks of the intervals. A check is one pass over
+// the grid, like a merge, against thousands for running a batch.
+#define BATCH_CHECK_EVERY 1
+
+// When to stop adding realizations. Half widths are of 95% confidence
+// intervals.
+typedef struct BatchTarget
+{
+    // Of the burn probability of every tile, as a probability
+    double probability_half_width;
+    // Of the mean tiles burned per realization, relative to the mean
+    double burned_half_width;
+    int64_t min_realizations;
+    // Rounded down to whole ensembles of ENSEMBLE_LANES, but one is always run
+    int64_t max_realizations;
+} BatchTarget;
+
+// Where the intervals stood at a check
+typedef struct BatchCheck
+{
+    int64_t realizations;
+    double probability_half_width;
+    double burned_half_width;
+} BatchCheck;
+
+typedef struct BatchRun
+{
+    int64_t width;
+    int64_t height;
+    // Taken by workers to merge a finished batch
+    std::mutex lock;
+    // Realizations each tile ignited in
+    std::vector<uint32_t> burn_counts;
+    int64_t realizations;
+    // Over realizations, of the tiles each burned
+    double burned_sum;
+    double burned_squares;
+    // As of the last check
+    double mean_burned;
+    double burned_half_width;
+    // Of the tile whose burn probability is least certain
+    double probability_half_width;
+    bool converged;
+    std::vector<BatchCheck> checks;
+    // Wall time of the whole run, and the part of it spent merging and
+    // checking batches under the lock
+    int64_t run_us;
+    int64_t check_us;
+} BatchRun;
+
+// Runs realizations of the fire on grid in ensembles of ENSEMBLE_LANES, one
+// batch at a time per worker, with no barrier between them: a worker pulls
+// the next batch as soon as it has merged its last, and the intervals are
+// checked against target every BATCH_CHECK_EVERY merges. Once they meet it no
+// new batch starts, and the ones running are still merged in, so up to
+// BATCH_CHECK_EVERY-1 plus a batch per other worker more than needed are run.
+// Batch b rolls with a seed hashed from seed and b, and the batches merged are
+// always the first ones, so the same number of realizations gives the same
+// result on any number of workers.
+BatchRun *runBatches(Vertex *grid, int64_t width, int64_t height, float odds, uint64_t seed,
+                     const BatchTarget *target, Scheduler *scheduler);
+void freeBatchRun(BatchRun *run);
+
+#endif
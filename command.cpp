@@ -0,0 +1,158 @@
+#include "command.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+static void igniteTile(Vertex *grid, int64_t width, int64_t height, int64_t i, int64_t j, LodPyramid *lod, int step);
+static void breakTile(Vertex *grid, int64_t width, int64_t height, int64_t i, int64_t j, LodPyramid *lod);
+static void drawFirebreak(Vertex *grid, int64_t width, int64_t height, const Command *command, LodPyramid *lod);
+static void setOverlay(GridOverlay *overlay, const std::vector<OverlayFeature> &features, Vertex *grid,
+                       LodPyramid *lod);
+static void copyOverlaySpans(GridOverlay *overlay, Vertex *grid, LodPyramid *lod);
+static bool sameFeature(const OverlayFeature *a, const OverlayFeature *b);
+static float baseFuel(void *context, int64_t i, int64_t j);
+
+GridOverlay *newGridOverlay(const Vertex *grid, int64_t width, int64_t height) {
+    GridOverlay *overlay = new GridOverlay;
+    overlay->base.resize(width*height);
+    for (int64_t i = 0; i < height; i++) {
+        for (int64_t j = 0; j < width; j++)
+            overlay->base[i*width + j] = grid[getGridIndex(i, j, width)].col[1];
+    }
+    overlay->fuel = overlay->base;
+    overlay->overlay = newOverlay(overlay->fuel.data(), width, height, baseFuel, overlay);
+    return overlay;
+}
+
+void freeGridOverlay(GridOverlay *overlay) {
+    if (overlay == NULL)
+        return;
+    freeOverlay(overlay->overlay);
+    delete overlay;
+}
+
+void pushCommand(CommandQueue *queue, Command command) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->pending.push_back(command);
+}
+
+int applyCommands(CommandQueue *queue, Vertex *grid, int64_t width, int64_t height, LodPyramid *lod, int step,
+                  GridOverlay *overlay) {
+    std::vector<Command> commands;
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        commands.swap(queue->pending);
+    }
+    for (const Command &command : commands) {
+        if (command.type == CMD_IGNITE)
+            igniteTile(grid, width, height, command.i0, command.j0, lod, step);
+        else if (command.type == CMD_FIREBREAK)
+            drawFirebreak(grid, width, height, &command, lod);
+        else if (command.type == CMD_OVERLAY && overlay != NULL)
+            setOverlay(overlay, command.features, grid, lod);
+    }
+    return (int)commands.size();
+}
+
+// Same as a successful roll in updateGrid: the tile's fuel becomes its
+// intensity. Burning or burnt tiles have no fuel left and are left alone.
+static void igniteTile(Vertex *grid, int64_t width, int64_t height, int64_t i, int64_t j, LodPyramid *lod, int step) {
+    if (i < 0 || j < 0 || i >= height || j >= width)
+        return;
+    int64_t index = getGridIndex(i, j, width);
+    if (grid[index].col[1] == 0)
+        return;
+    for (int v = 0; v < 6; v++) {
+        grid[index+v].col[0] = grid[index+v].col[1];
+        grid[index+v].col[1] = 0;
+        grid[index+v].col[2] = step + 1;
+    }
+    markLodDirty(lod, i, j);
+}
+
+// Clears fuel and puts out any fire on the tile.
+static void breakTile(Vertex *grid, int64_t width, int64_t height, int64_t i, int64_t j, LodPyramid *lod) {
+    if (i < 0 || j < 0 || i >= height || j >= width)
+        return;
+    int64_t index = getGridIndex(i, j, width);
+    for (int v = 0; v < 6; v++) {
+        grid[index+v].col[0] = 0;
+        grid[index+v].col[1] = 0;
+    }
+    markLodDirty(lod, i, j);
+}
+
+// Bresenham line. Steps are 4-connected (one axis at a time) so the fire
+// cannot slip through the diagonal gaps of a thin line.
+static void drawFirebreak(Vertex *grid, int64_t width, int64_t height, const Command *command, LodPyramid *lod) {
+    int64_t i = command->i0, j = command->j0;
+    int64_t di = llabs(command->i1 - i), dj = llabs(command->j1 - j);
+    int64_t si = i < command->i1 ? 1 : -1, sj = j < command->j1 ? 1 : -1;
+    int64_t err = dj - di;
+    breakTile(grid, width, height, i, j, lod);
+    while (i != command->i1 || j != command->j1) {
+        if (2*err > -di && (j != command->j1)) {
+            err -= di;
+            j += sj;
+        } else {
+            err += dj;
+            i += si;
+        }
+        breakTile(grid, width, height, i, j, lod);
+    }
+}
+
+// Features are matched up by position: the first feature of the file edits
+// feature 0, and so on. Unchanged ones are left alone and ones past the end
+// of features are removed.
+static void setOverlay(GridOverlay *overlay, const std::vector<OverlayFeature> &features, Vertex *grid,
+                       LodPyramid *lod) {
+    Overlay *drawn = overlay->overlay;
+    size_t count = std::max(features.size(), drawn->features.size());
+    for (size_t k = 0; k < count; k++) {
+        if (k >= drawn->features.size()) {
+            addOverlayFeature(drawn, &features[k]);
+        } else if (k >= features.size()) {
+            if (drawn->features[k].points.empty())
+                continue;
+            removeOverlayFeature(drawn, k);
+        } else {
+            if (sameFeature(&drawn->features[k], &features[k]))
+                continue;
+            setOverlayFeature(drawn, k, &features[k]);
+        }
+        copyOverlaySpans(overlay, grid, lod);
+    }
+}
+
+// The tiles the last overlay edit changed, to the grid's tiles that have
+// neither burned nor caught
+static void copyOverlaySpans(GridOverlay *overlay, Vertex *grid, LodPyramid *lod) {
+    Overlay *drawn = overlay->overlay;
+    for (const OverlaySpan &span : drawn->changed) {
+        for (int64_t j = span.first_j; j < span.end_j; j++) {
+            int64_t index = getGridIndex(span.i, j, drawn->width);
+            if (grid[index].col[0] != 0 || grid[index].col[2] != 0)
+                continue;
+            float fuel = overlay->fuel[span.i*drawn->width + j];
+            for (int v = 0; v < 6; v++)
+                grid[index+v].col[1] = fuel;
+            markLodDirty(lod, span.i, j);
+        }
+    }
+}
+
+static bool sameFeature(const OverlayFeature *a, const OverlayFeature *b) {
+    if (a->kind != b->kind || a->width != b->width || a->fuel != b->fuel || a->points.size() != b->points.size())
+        return false;
+    for (size_t k = 0; k < a->points.size(); k++) {
+        if (a->points[k].i != b->points[k].i || a->points[k].j != b->points[k].j)
+            return false;
+    }
+    return true;
+}
+
+static float baseFuel(void *context, int64_t i, int64_t j) {
+    GridOverlay *overlay = (GridOverlay *) context;
+    return overlay->base[i*overlay->overlay->width + j];
+}
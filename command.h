@@ -0,0 +1,58 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "grid.h"
+#include "lod.h"
+#include "overlay.h"
+#include <mutex>
+#include <vector>
+
+enum {
+    CMD_IGNITE = 0,
+    CMD_FIREBREAK = 1,
+    CMD_OVERLAY = 2
+};
+
+// An edit to the grid requested from the UI. Firebreaks run from (i0, j0) to
+// (i1, j1); ignitions only use (i0, j0). An overlay command replaces the
+// grid's overlay features with features.
+typedef struct Command
+{
+    int type;
+    int64_t i0, j0;
+    int64_t i1, j1;
+    std::vector<OverlayFeature> features;
+} Command;
+
+// Roads and breaks from a features file, burned into the grid's fuel. The
+// overlay draws into a plane of its own over the fuel the grid started with,
+// and each edit copies the tiles it changed to the grid's unburnt tiles only,
+// so reloading the file never puts fuel back where the fire has been.
+typedef struct GridOverlay
+{
+    Overlay *overlay;
+    std::vector<float> base;
+    std::vector<float> fuel;
+} GridOverlay;
+
+// Edits are queued by the input callbacks and applied by the simulation
+// between steps, so the UI never has to touch or copy the grid itself.
+typedef struct CommandQueue
+{
+    std::mutex mutex;
+    std::vector<Command> pending;
+} CommandQueue;
+
+// Takes the grid's current fuel as the base the features are drawn over.
+GridOverlay *newGridOverlay(const Vertex *grid, int64_t width, int64_t height);
+void freeGridOverlay(GridOverlay *overlay);
+
+void pushCommand(CommandQueue *queue, Command command);
+// Applies everything queued so far and marks only the touched tiles dirty.
+// step is the number of steps taken so far, for the arrival of ignited tiles.
+// Overlay commands only redraw the features that changed, and are dropped if
+// overlay is NULL. Returns the number of commands applied.
+int applyCommands(CommandQueue *queue, Vertex *grid, int64_t width, int64_t height, LodPyramid *lod, int step,
+                  GridOverlay *overlay);
+
+#endif
@@ -0,0 +1,514 @@
+#include "dist.h"
+#include "rng.h"
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <vector>
+
+// Steps an edge stays quiet when no fire anywhere can reach it
+#define DIST_FAR ((int64_t) 1 << 40)
+
+// Sides of a block. DIST_DOWN faces the rows below, as DIR_DOWN does.
+enum {
+    DIST_DOWN = 0,
+    DIST_UP = 1,
+    DIST_LEFT = 2,
+    DIST_RIGHT = 3
+};
+
+// A rank's rows x cols rectangle of the grid from tile (first_row,
+// first_col), stored with its halo as (rows+2) x (cols+2) planes: local (r, c)
+// is tile (first_row+r-1, first_col+c-1). Double-buffered like SimBand.
+typedef struct DistBlock
+{
+    int64_t grid_width;
+    int64_t first_row;
+    int64_t rows;
+    int64_t first_col;
+    int64_t cols;
+    int64_t stride;
+    std::vector<float> intensity;
+    std::vector<float> fuel;
+    std::vector<float> next_intensity;
+    std::vector<float> next_fuel;
+    // Burning tiles per local row, halo rows included, and per owned column
+    std::vector<int64_t> row_fire;
+    std::vector<int64_t> col_fire;
+    std::vector<int64_t> next_row_fire;
+    std::vector<int64_t> next_col_fire;
+    // Rows that were skipped last step and hold the same data in both buffers
+    std::vector<char> row_settled;
+    // An edge on its way out or in
+    std::vector<float> line;
+} DistBlock;
+
+// One side of the link between two neighboring blocks
+typedef struct DistEdge
+{
+    int fd;
+    // Steps the neighbor's edge stays quiet at the least, as it said at step
+    // reported. Before it has said anything its edge may be burning.
+    int64_t reach;
+    int reported;
+    // Both edges are quiet, and nothing is exchanged, before this step
+    int64_t quiet_until;
+} DistEdge;
+
+static DistBlock *newDistBlock(const DistScenario *scenario, int64_t first_row, int64_t rows, int64_t first_col,
+                               int64_t cols);
+static int64_t stepBlock(DistBlock *block, float odds, uint64_t seed, int step);
+static bool exchangeEdge(DistEdge *edges, int side, DistBlock *block, int step, bool send_first, int64_t *traffic);
+static bool sendEdge(DistEdge *edge, int side, DistBlock *block, int64_t reach, int64_t *traffic);
+static bool recvHalo(DistEdge *edge, int side, DistBlock *block, int step);
+static void setHalo(DistBlock *block, int side, const float *values);
+static int64_t edgeFire(const DistBlock *block, int side);
+static int64_t edgeReach(const DistEdge *edges, const DistBlock *block, int side, int step);
+static void runRank(const DistScenario *scenario, int64_t first_row, int64_t rows, int64_t first_col, int64_t cols,
+                    int rank_row, int rank_col, const int *fds, int parent_fd, int max_steps);
+static int reportSteps(int step, int max_steps);
+static int64_t rankRows(int64_t height, int ranks, int rank);
+static void closeAll(const std::vector<int> &fds);
+static bool writeAll(int fd, const void *data, size_t size);
+static bool readAll(int fd, void *data, size_t size);
+
+int distFire(const DistScenario *scenario, int rank_rows, int rank_cols, int max_steps, DistSave save,
+             void *save_context, DistStats *stats) {
+    if (rank_rows < 1 || rank_cols < 1 || rank_rows > scenario->height || rank_cols > scenario->width)
+        return -1;
+    int ranks = rank_rows*rank_cols;
+    // Rank a*rank_cols + b owns block (a, b). rank_fds holds its four links
+    // in DIST_ order, -1 on the grid's edges, and parent[2k] and parent[2k+1]
+    // are the parent's and rank k's ends of their link.
+    std::vector<int> rank_fds(4*ranks, -1);
+    std::vector<int> parent(2*ranks, -1);
+    for (int k = 0; k < ranks; k++) {
+        int a = k / rank_cols, b = k % rank_cols;
+        int pair[2];
+        bool ok = socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0;
+        if (ok) {
+            parent[2*k] = pair[0];
+            parent[2*k+1] = pair[1];
+        }
+        if (ok && a+1 < rank_rows && (ok = socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0)) {
+            rank_fds[4*k + DIST_UP] = pair[0];
+            rank_fds[4*(k+rank_cols) + DIST_DOWN] = pair[1];
+        }
+        if (ok && b+1 < rank_cols && (ok = socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0)) {
+            rank_fds[4*k + DIST_RIGHT] = pair[0];
+            rank_fds[4*(k+1) + DIST_LEFT] = pair[1];
+        }
+        if (!ok) {
+            closeAll(rank_fds);
+            closeAll(parent);
+            return -1;
+        }
+    }
+
+    std::vector<pid_t> pids;
+    for (int k = 0; k < ranks; k++) {
+        pid_t pid = fork();
+        if (pid < 0)
+            break;
+        if (pid == 0) {
+            for (int fd = 0; fd < 4*ranks; fd++) {
+                if (fd / 4 != k && rank_fds[fd] >= 0)
+                    close(rank_fds[fd]);
+            }
+            for (int fd = 0; fd < 2*ranks; fd++) {
+                if (fd != 2*k+1)
+                    close(parent[fd]);
+            }
+            int a = k / rank_cols, b = k % rank_cols;
+            int64_t first_row = 0, first_col = 0;
+            for (int r = 0; r < a; r++)
+                first_row += rankRows(scenario->height, rank_rows, r);
+            for (int c = 0; c < b; c++)
+                first_col += rankRows(scenario->width, rank_cols, c);
+            runRank(scenario, first_row, rankRows(scenario->height, rank_rows, a), first_col,
+                    rankRows(scenario->width, rank_cols, b), a, b, &rank_fds[4*k], parent[2*k+1], max_steps);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    closeAll(rank_fds);
+    for (int k = 0; k < ranks; k++)
+        close(parent[2*k+1]);
+    // Ranks already running find their links closed and stop
+    bool ok = (int) pids.size() == ranks;
+
+    // The parent only sums the fire counts and tells the ranks when to stop.
+    // The run ends after the first step that started with no fire.
+    int step = 0;
+    int64_t reports = 0;
+    while (ok) {
+        int batch = reportSteps(step, max_steps);
+        int64_t totals[DIST_REPORT_STEPS] = {0};
+        for (int k = 0; k < ranks && ok; k++) {
+            int64_t fire_counts[DIST_REPORT_STEPS];
+            ok = readAll(parent[2*k], fire_counts, sizeof(int64_t)*batch);
+            for (int b = 0; b < batch; b++)
+                totals[b] += fire_counts[b];
+        }
+        reports++;
+        int taken = 0;
+        while (taken < batch && totals[taken] > 0)
+            taken++;
+        bool out = taken < batch;
+        step += out ? taken + 1 : batch;
+        char go_on = ok && !out && (max_steps < 0 || step < max_steps);
+        for (int k = 0; k < ranks; k++)
+            writeAll(parent[2*k], &go_on, 1);
+        if (!go_on)
+            break;
+    }
+
+    DistStats total = {0, 0, 0, reports};
+    for (int k = 0; k < ranks && ok; k++) {
+        int64_t traffic[3];
+        ok = readAll(parent[2*k], traffic, sizeof(traffic));
+        total.messages += traffic[0];
+        total.bytes += traffic[1];
+        total.skipped += traffic[2];
+    }
+    if (stats != NULL)
+        *stats = total;
+
+    // Each rank sends its block a row at a time, intensity then fuel
+    int64_t first_row = 0;
+    for (int a = 0; a < rank_rows && ok; a++) {
+        int64_t rows = rankRows(scenario->height, rank_rows, a);
+        int64_t first_col = 0;
+        for (int b = 0; b < rank_cols && ok; b++) {
+            int64_t cols = rankRows(scenario->width, rank_cols, b);
+            std::vector<float> row(2*cols);
+            for (int64_t r = 0; r < rows && ok; r++) {
+                ok = readAll(parent[2*(a*rank_cols + b)], row.data(), sizeof(float)*row.size());
+                if (ok && save != NULL)
+                    save(save_context, first_row + r, first_col, cols, row.data(), row.data() + cols);
+            }
+            first_col += cols;
+        }
+        first_row += rows;
+    }
+    for (int k = 0; k < ranks; k++)
+        close(parent[2*k]);
+    for (size_t k = 0; k < pids.size(); k++)
+        waitpid(pids[k], NULL, 0);
+    return ok ? step : -1;
+}
+
+// Halos are swapped pairwise, the lower rank of each pair sending first:
+// first with the neighbors above and below, then with those to the sides.
+// Along each axis, ranks at even positions pair forward before they pair back
+// and odd ranks the other way round, so every pass pairs ranks off and no two
+// ranks ever block sending to each other. Both sides of a link work out the
+// same quiet window from the same exchange, so they skip the same steps.
+static void runRank(const DistScenario *scenario, int64_t first_row, int64_t rows, int64_t first_col, int64_t cols,
+                    int rank_row, int rank_col, const int *fds, int parent_fd, int max_steps) {
+    DistBlock *block = newDistBlock(scenario, first_row, rows, first_col, cols);
+    DistEdge edges[4];
+    for (int side = 0; side < 4; side++)
+        edges[side] = {fds[side], 0, 0, 0};
+    // Messages, bytes and skipped sends
+    int64_t traffic[3] = {0, 0, 0};
+    bool ok = true;
+    char go_on = 1;
+    for (int step = 0; ok && go_on; ) {
+        int batch = reportSteps(step, max_steps);
+        int64_t fire_counts[DIST_REPORT_STEPS];
+        for (int b = 0; b < batch; b++, step++) {
+            for (int pass = 0; pass < 4 && ok; pass++) {
+                int position = pass < 2 ? rank_row : rank_col;
+                bool forward = (pass % 2 == 0) == (position % 2 == 0);
+                int side = pass < 2 ? (forward ? DIST_UP : DIST_DOWN) : (forward ? DIST_RIGHT : DIST_LEFT);
+                if (edges[side].fd >= 0)
+                    ok = exchangeEdge(edges, side, block, step, forward, traffic);
+            }
+            fire_counts[b] = ok ? stepBlock(block, scenario->odds, scenario->seed, step) : 0;
+        }
+        ok = ok && writeAll(parent_fd, fire_counts, sizeof(int64_t)*batch)
+                && readAll(parent_fd, &go_on, 1);
+    }
+    ok = ok && writeAll(parent_fd, traffic, sizeof(traffic));
+    for (int64_t r = 1; r <= rows && ok; r++) {
+        ok = writeAll(parent_fd, &block->intensity[r*block->stride + 1], sizeof(float)*cols)
+             && writeAll(parent_fd, &block->fuel[r*block->stride + 1], sizeof(float)*cols);
+    }
+    delete block;
+}
+
+static DistBlock *newDistBlock(const DistScenario *scenario, int64_t first_row, int64_t rows, int64_t first_col,
+                               int64_t cols) {
+    DistBlock *block = new DistBlock;
+    int64_t stride = cols + 2;
+    block->grid_width = scenario->width;
+    block->first_row = first_row;
+    block->rows = rows;
+    block->first_col = first_col;
+    block->cols = cols;
+    block->stride = stride;
+    block->intensity.assign((rows+2)*stride, 0);
+    block->fuel.assign((rows+2)*stride, 0);
+    block->next_intensity.assign((rows+2)*stride, 0);
+    block->next_fuel.assign((rows+2)*stride, 0);
+    block->row_fire.assign(rows+2, 0);
+    block->next_row_fire.assign(rows+2, 0);
+    block->col_fire.assign(cols+2, 0);
+    block->next_col_fire.assign(cols+2, 0);
+    block->row_settled.assign(rows+2, 0);
+    block->line.resize(std::max(rows, cols));
+    for (int64_t r = 1; r <= rows; r++) {
+        for (int64_t c = 1; c <= cols; c++)
+            block->fuel[r*stride + c] = scenario->fuel(scenario->context, first_row + r - 1, first_col + c - 1);
+    }
+    for (size_t k = 0; k < scenario->ignitions.size(); k++) {
+        const DistIgnition *ignition = &scenario->ignitions[k];
+        int64_t r = ignition->i - first_row + 1, c = ignition->j - first_col + 1;
+        if (r < 1 || r > rows || c < 1 || c > cols)
+            continue;
+        block->intensity[r*stride + c] = ignition->intensity;
+        block->fuel[r*stride + c] = 0;
+    }
+    for (int64_t r = 1; r <= rows; r++) {
+        for (int64_t c = 1; c <= cols; c++) {
+            if (block->intensity[r*stride + c] != 0) {
+                block->row_fire[r]++;
+                block->col_fire[c]++;
+            }
+        }
+    }
+    return block;
+}
+
+// stepBand over the block, where a row also has to be stepped when the halo
+// columns next to it burn, and burning tiles are counted by column too.
+static int64_t stepBlock(DistBlock *block, float odds, uint64_t seed, int step) {
+    int64_t stride = block->stride, cols = block->cols, width = block->grid_width;
+    int64_t fire_count = 0;
+    std::fill(block->next_col_fire.begin(), block->next_col_fire.end(), 0);
+    for (int64_t r = 1; r <= block->rows; r++) {
+        const float *intensity = &block->intensity[r*stride];
+        const float *fuel = &block->fuel[r*stride];
+        float *next_intensity = &block->next_intensity[r*stride];
+        float *next_fuel = &block->next_fuel[r*stride];
+        block->next_row_fire[r] = 0;
+        if (block->row_fire[r-1] == 0 && block->row_fire[r] == 0 && block->row_fire[r+1] == 0
+            && intensity[0] == 0 && intensity[cols+1] == 0) {
+            if (!block->row_settled[r]) {
+                memcpy(next_intensity + 1, intensity + 1, sizeof(float)*cols);
+                memcpy(next_fuel + 1, fuel + 1, sizeof(float)*cols);
+                block->row_settled[r] = 1;
+            }
+            continue;
+        }
+        block->row_settled[r] = 0;
+        fire_count += block->row_fire[r];
+
+        const float *below = intensity - stride;
+        const float *above = intensity + stride;
+        uint64_t first_tile = (block->first_row + r - 1)*width + block->first_col - 1;
+        for (int64_t c = 1; c <= cols; c++) {
+            uint64_t tile = first_tile + c;
+            float cur = intensity[c];
+            float left_fuel = fuel[c];
+            int hits = 0;
+            if (intensity[c-1] != 0 && rngUniform(seed, step, tile-1, DIR_RIGHT) < odds)
+                hits++;
+            if (intensity[c+1] != 0 && rngUniform(seed, step, tile+1, DIR_LEFT) < odds)
+                hits++;
+            if (below[c] != 0 && rngUniform(seed, step, tile-width, DIR_UP) < odds)
+                hits++;
+            if (above[c] != 0 && rngUniform(seed, step, tile+width, DIR_DOWN) < odds)
+                hits++;
+
+            if (cur != 0) {
+                cur -= 0.005;
+                if (cur < 0)
+                    cur = 0;
+            }
+            if (hits > 0) {
+                cur = hits == 1 ? left_fuel : 0;
+                left_fuel = 0;
+            }
+            next_intensity[c] = cur;
+            next_fuel[c] = left_fuel;
+            if (cur != 0) {
+                block->next_row_fire[r]++;
+                block->next_col_fire[c]++;
+            }
+        }
+    }
+
+    block->intensity.swap(block->next_intensity);
+    block->fuel.swap(block->next_fuel);
+    for (int64_t r = 1; r <= block->rows; r++)
+        block->row_fire[r] = block->next_row_fire[r];
+    block->col_fire.swap(block->next_col_fire);
+    return fire_count;
+}
+
+// Steps to run from step before the next report, which ranks and parent work
+// out alike. At least one, as a run always takes a step.
+static int reportSteps(int step, int max_steps) {
+    if (max_steps >= 0 && max_steps - step < DIST_REPORT_STEPS)
+        return max_steps - step > 1 ? max_steps - step : 1;
+    return DIST_REPORT_STEPS;
+}
+
+// Rows (or columns) are dealt out as evenly as possible, the first ranks
+// taking the spare.
+static int64_t rankRows(int64_t height, int ranks, int rank) {
+    return height/ranks + (rank < height%ranks ? 1 : 0);
+}
+
+// Both sides send how many steps their edge stays quiet, qa and qb, so both
+// edges stay quiet for min(qa, qb) steps from the exchange on. The halo is
+// cleared every quiet step, since stepping swaps it with the other buffer's.
+static bool exchangeEdge(DistEdge *edges, int side, DistBlock *block, int step, bool send_first, int64_t *traffic) {
+    DistEdge *edge = &edges[side];
+    if (step < edge->quiet_until) {
+        traffic[2]++;
+        setHalo(block, side, NULL);
+        return true;
+    }
+    int64_t reach = edgeReach(edges, block, side, step);
+    bool ok = send_first ? sendEdge(edge, side, block, reach, traffic) && recvHalo(edge, side, block, step)
+                         : recvHalo(edge, side, block, step) && sendEdge(edge, side, block, reach, traffic);
+    edge->quiet_until = step + std::min(reach, edge->reach);
+    return ok;
+}
+
+// Steps from step on that the edge row or column on side stays quiet at the
+// least. Fire in the block as many rows or columns in as are quiet reaches it
+// after that many steps. Fire that a neighbor's edge may hold from step s on
+// is in the block at s+1, at the edge's end for a neighbor to the side and
+// across the block for the one opposite. What a neighbor said holds as it
+// ages, since fire cannot come any faster than a tile a step.
+static int64_t edgeReach(const DistEdge *edges, const DistBlock *block, int side, int step) {
+    bool rows = side == DIST_DOWN || side == DIST_UP;
+    const std::vector<int64_t> &fire = rows ? block->row_fire : block->col_fire;
+    int64_t lines = rows ? block->rows : block->cols;
+    int64_t quiet = 0;
+    while (quiet < lines && fire[side % 2 == 0 ? 1 + quiet : lines - quiet] == 0)
+        quiet++;
+    int64_t reach = quiet < lines ? quiet : DIST_FAR;
+    for (int other = 0; other < 4; other++) {
+        if (other == side || edges[other].fd < 0)
+            continue;
+        int64_t aged = std::max<int64_t>(edges[other].reach - (step - edges[other].reported), 0);
+        reach = std::min(reach, aged + 1 + (other == (side ^ 1) ? lines - 1 : 0));
+    }
+    return reach;
+}
+
+static int64_t edgeFire(const DistBlock *block, int side) {
+    switch (side) {
+    case DIST_DOWN:
+        return block->row_fire[1];
+    case DIST_UP:
+        return block->row_fire[block->rows];
+    case DIST_LEFT:
+        return block->col_fire[1];
+    default:
+        return block->col_fire[block->cols];
+    }
+}
+
+// The header is the edge's fire count and its reach. The edge itself only
+// goes with fire.
+static bool sendEdge(DistEdge *edge, int side, DistBlock *block, int64_t reach, int64_t *traffic) {
+    int64_t header[2] = {edgeFire(block, side), reach};
+    bool rows = side == DIST_DOWN || side == DIST_UP;
+    int64_t count = rows ? block->cols : block->rows;
+    traffic[0]++;
+    traffic[1] += sizeof(header) + (header[0] != 0 ? sizeof(float)*count : 0);
+    if (!writeAll(edge->fd, header, sizeof(header)))
+        return false;
+    if (header[0] == 0)
+        return true;
+    if (rows) {
+        int64_t r = side == DIST_DOWN ? 1 : block->rows;
+        return writeAll(edge->fd, &block->intensity[r*block->stride + 1], sizeof(float)*count);
+    }
+    int64_t c = side == DIST_LEFT ? 1 : block->cols;
+    for (int64_t r = 1; r <= block->rows; r++)
+        block->line[r-1] = block->intensity[r*block->stride + c];
+    return writeAll(edge->fd, block->line.data(), sizeof(float)*count);
+}
+
+// Only burning tiles roll, so a quiet edge is as good as an empty one.
+static bool recvHalo(DistEdge *edge, int side, DistBlock *block, int step) {
+    int64_t header[2];
+    if (!readAll(edge->fd, header, sizeof(header)))
+        return false;
+    edge->reach = header[1];
+    edge->reported = step;
+    if (header[0] == 0) {
+        setHalo(block, side, NULL);
+        return true;
+    }
+    bool rows = side == DIST_DOWN || side == DIST_UP;
+    int64_t count = rows ? block->cols : block->rows;
+    if (!readAll(edge->fd, block->line.data(), sizeof(float)*count))
+        return false;
+    setHalo(block, side, block->line.data());
+    if (rows)
+        block->row_fire[side == DIST_DOWN ? 0 : block->rows+1] = header[0];
+    return true;
+}
+
+// Fills the halo on side from values, or clears it when values is NULL.
+static void setHalo(DistBlock *block, int side, const float *values) {
+    int64_t stride = block->stride;
+    if (side == DIST_DOWN || side == DIST_UP) {
+        int64_t r = side == DIST_DOWN ? 0 : block->rows+1;
+        float *halo = &block->intensity[r*stride + 1];
+        if (values == NULL)
+            memset(halo, 0, sizeof(float)*block->cols);
+        else
+            memcpy(halo, values, sizeof(float)*block->cols);
+        block->row_fire[r] = 0;
+        return;
+    }
+    int64_t c = side == DIST_LEFT ? 0 : block->cols+1;
+    for (int64_t r = 1; r <= block->rows; r++)
+        block->intensity[r*stride + c] = values == NULL ? 0 : values[r-1];
+}
+
+static void closeAll(const std::vector<int> &fds) {
+    for (size_t k = 0; k < fds.size(); k++) {
+        if (fds[k] >= 0)
+            close(fds[k]);
+    }
+}
+
+// Every descriptor is a socket, and a rank that has gone away should fail the
+// write rather than kill the writer with SIGPIPE.
+static bool writeAll(int fd, const void *data, size_t size) {
+    const char *bytes = (const char *) data;
+    while (size > 0) {
+        ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t size) {
+    char *bytes = (char *) data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got <= 0)
+            return false;
+        bytes += got;
+        size -= got;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef DIST_H
+#define DIST_H
+
+#include "sparse.h"
+#include <stdint.h>
+#include <vector>
+
+// Steps each rank runs between reports of its fire counts to the parent
+#define DIST_REPORT_STEPS 16
+
+// A tile burning at the start, its fuel already taken
+typedef struct DistIgnition
+{
+    int64_t i;
+    int64_t j;
+    float intensity;
+} DistIgnition;
+
+// What the ranks build their blocks from. Each rank asks fuel(context, i, j)
+// for the tiles it owns, in its own process, so no process ever holds the
+// whole landscape.
+typedef struct DistScenario
+{
+    int64_t width;
+    int64_t height;
+    SparseFuel fuel;
+    void *context;
+    std::vector<DistIgnition> ignitions;
+    float odds;
+    uint64_t seed;
+} DistScenario;
+
+// Receives tiles (i, first_j) to (i, first_j+count-1) of the finished grid
+typedef void (*DistSave)(void *context, int64_t i, int64_t first_j, int64_t count, const float *intensity,
+                         const float *fuel);
+
+// Traffic over a run, summed over ranks
+typedef struct DistStats
+{
+    // Edge messages between neighboring ranks, and their bytes
+    int64_t messages;
+    int64_t bytes;
+    // Edge-steps that needed no message, the edge being known to be quiet
+    int64_t skipped;
+    // Round trips between the ranks and the parent
+    int64_t reports;
+} DistStats;
+
+// Runs the synchronous model on rank_rows x rank_cols processes, each building
+// and stepping its own rectangle of the grid (rows and columns dealt out as
+// evenly as possible) with a halo a tile deep on every side. Neighbors swap
+// their edge rows and columns; the rolls only reach the four neighbors, so no
+// corners are needed. Fire moves at most a tile a step, so with each message a
+// rank tells its neighbor how many steps its edge stays quiet at the least,
+// from its own fire and from what its other neighbors last told it, and
+// nothing is sent across a link until both sides' promises run out.
+//
+// The result matches stepping the whole grid as one band with the same seed
+// bit for bit. Once the run stops, the parent hands each rank's block to save
+// (may be NULL) a row at a time, and never holds more than that row. Stops
+// when the fire is out or after max_steps if it is not negative. Ranks report
+// to the parent every DIST_REPORT_STEPS steps, and a block with no fire left
+// does not change, so the steps run past the end of the fire are harmless.
+// stats (may be NULL) receives the traffic. Returns the number of steps taken,
+// or -1 if the processes could not be set up.
+int distFire(const DistScenario *scenario, int rank_rows, int rank_cols, int max_steps, DistSave save,
+             void *save_context, DistStats *stats);
+
+#endif
@@ -0,0 +1,256 @@
+#include "ensemble.h"
+#include "event.h"
+#include "rng.h"
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ENSEMBLE_STREAM 9
+
+static Ensemble *allocEnsemble(int64_t width, int64_t height);
+static void setEnsembleTile(Ensemble *ensemble, int64_t i, int64_t j, float intensity, float fuel);
+static uint64_t rollMask(uint32_t threshold, uint64_t step_key, uint64_t tile, int dir, uint64_t lanes);
+static uint64_t commonRollMask(const Ensemble *ensemble, uint64_t seed, int step, uint64_t tile, int dir);
+
+inline EnsembleTile *ensembleRow(EnsembleTile *tiles, const Ensemble *ensemble, int64_t i) {
+    return tiles + (i+1)*ensemble->width;
+}
+
+Ensemble *newEnsemble(Vertex *grid, int64_t width, int64_t height) {
+    Ensemble *ensemble = allocEnsemble(width, height);
+    if (ensemble == NULL)
+        return NULL;
+    for (int64_t i = 0; i < height; i++) {
+        for (int64_t j = 0; j < width; j++) {
+            const Vertex *vertex = &grid[getGridIndex(i, j, width)];
+            setEnsembleTile(ensemble, i, j, vertex->col[0], vertex->col[1]);
+        }
+    }
+    return ensemble;
+}
+
+Ensemble *newBandEnsemble(const SimBand *band) {
+    Ensemble *ensemble = allocEnsemble(band->width, band->rows);
+    if (ensemble == NULL)
+        return NULL;
+    for (int64_t i = 0; i < band->rows; i++) {
+        const float *intensity = bandRow(band->intensity, band, i+1);
+        const float *fuel = bandRow(band->fuel, band, i+1);
+        for (int64_t j = 0; j < band->width; j++)
+            setEnsembleTile(ensemble, i, j, intensity[j], fuel[j]);
+    }
+    return ensemble;
+}
+
+static Ensemble *allocEnsemble(int64_t width, int64_t height) {
+    Ensemble *ensemble = (Ensemble *) std::malloc(sizeof(Ensemble));
+    if (ensemble == NULL)
+        return NULL;
+    ensemble->width = width;
+    ensemble->height = height;
+    ensemble->burn_steps = (uint8_t *) std::malloc(width*height);
+    ensemble->tiles = (EnsembleTile *) std::calloc((height+2)*width, sizeof(EnsembleTile));
+    ensemble->next_tiles = (EnsembleTile *) std::calloc((height+2)*width, sizeof(EnsembleTile));
+    ensemble->row_fire = (int64_t *) std::calloc(height+2, sizeof(int64_t));
+    ensemble->next_row_fire = (int64_t *) std::calloc(height+2, sizeof(int64_t));
+    ensemble->row_settled = (char *) std::calloc(height+2, sizeof(char));
+    ensemble->common_rolls = false;
+    if (ensemble->burn_steps == NULL || ensemble->tiles == NULL || ensemble->next_tiles == NULL
+        || ensemble->row_fire == NULL || ensemble->next_row_fire == NULL || ensemble->row_settled == NULL) {
+        freeEnsemble(ensemble);
+        return NULL;
+    }
+    return ensemble;
+}
+
+// Starts tile (i, j) of every realization burning with the given intensity,
+// or unburnt with the given fuel if the intensity is 0.
+static void setEnsembleTile(Ensemble *ensemble, int64_t i, int64_t j, float intensity, float fuel) {
+    EnsembleTile *tile = &ensembleRow(ensemble->tiles, ensemble, i)[j];
+    bool burning = intensity != 0;
+    int steps = burnSteps(burning ? intensity : fuel);
+    // The age counter has 8 bits; fuel up to 1.275 fits.
+    ensemble->burn_steps[i*ensemble->width + j] = steps > 255 ? 255 : steps;
+    tile->burning = burning ? ~0ULL : 0;
+    tile->unburnt = !burning && steps > 0 ? ~0ULL : 0;
+    if (burning)
+        ensemble->row_fire[i+1] += ENSEMBLE_LANES;
+}
+
+void freeEnsemble(Ensemble *ensemble) {
+    std::free(ensemble->burn_steps);
+    std::free(ensemble->tiles);
+    std::free(ensemble->next_tiles);
+    std::free(ensemble->row_fire);
+    std::free(ensemble->next_row_fire);
+    std::free(ensemble->row_settled);
+    std::free(ensemble);
+}
+
+// The same rule as stepBand, per realization bit: a burning realization ages
+// a step and burns out when its age reaches the tile's burn steps; one hit
+// ignites an unburnt realization, a second hit or a hit on a burning one puts
+// it out.
+int64_t stepEnsemble(Ensemble *ensemble, float odds, uint64_t seed, int step) {
+    int64_t width = ensemble->width;
+    uint32_t threshold = (uint32_t)(odds*65536.f + 0.5f);
+    uint64_t step_key = rngHash(seed, step, 0, ENSEMBLE_STREAM);
+    // Only lanes where the source burns and the target can still change need
+    // a roll; the rest are masked out of the result anyway.
+    auto roll = [ensemble, threshold, seed, step, step_key](uint64_t tile, int dir, uint64_t lanes) {
+        if (ensemble->common_rolls)
+            return commonRollMask(ensemble, seed, step, tile, dir);
+        return rollMask(threshold, step_key, tile, dir, lanes);
+    };
+    int64_t fire_count = 0;
+    for (int64_t i = 0; i < ensemble->height; i++) {
+        EnsembleTile *next_row = ensembleRow(ensemble->next_tiles, ensemble, i);
+        ensemble->next_row_fire[i+1] = 0;
+        if (ensemble->row_fire[i] == 0 && ensemble->row_fire[i+1] == 0 && ensemble->row_fire[i+2] == 0) {
+            if (!ensemble->row_settled[i+1]) {
+                memcpy(next_row, ensembleRow(ensemble->tiles, ensemble, i), sizeof(EnsembleTile)*width);
+                ensemble->row_settled[i+1] = 1;
+            }
+            continue;
+        }
+        ensemble->row_settled[i+1] = 0;
+        fire_count += ensemble->row_fire[i+1];
+
+        const EnsembleTile *below = ensembleRow(ensemble->tiles, ensemble, i-1);
+        const EnsembleTile *row = ensembleRow(ensemble->tiles, ensemble, i);
+        const EnsembleTile *above = ensembleRow(ensemble->tiles, ensemble, i+1);
+        const uint8_t *burn_steps = ensemble->burn_steps + i*width;
+        for (int64_t j = 0; j < width; j++) {
+            const EnsembleTile *tile = &row[j];
+            EnsembleTile *next = &next_row[j];
+            uint64_t hit = 0, hit_twice = 0, rolled, lanes;
+            uint64_t open = tile->unburnt | tile->burning;
+            if (j > 0 && (lanes = row[j-1].burning & open)) {
+                rolled = lanes & roll(i*width + j-1, DIR_RIGHT, lanes);
+                hit_twice |= hit & rolled;
+                hit |= rolled;
+            }
+            if (j < width-1 && (lanes = row[j+1].burning & open)) {
+                rolled = lanes & roll(i*width + j+1, DIR_LEFT, lanes);
+                hit_twice |= hit & rolled;
+                hit |= rolled;
+            }
+            if ((lanes = below[j].burning & open)) {
+                rolled = lanes & roll((i-1)*width + j, DIR_UP, lanes);
+                hit_twice |= hit & rolled;
+                hit |= rolled;
+            }
+            if ((lanes = above[j].burning & open)) {
+                rolled = lanes & roll((i+1)*width + j, DIR_DOWN, lanes);
+                hit_twice |= hit & rolled;
+                hit |= rolled;
+            }
+            if (!tile->burning && !hit) {
+                *next = *tile;
+                continue;
+            }
+
+            // age+1 by ripple carry, and whether it reached burn_steps
+            uint64_t carry = ~0ULL;
+            uint64_t done = ~0ULL;
+            uint64_t aged[ENSEMBLE_AGE_BITS];
+            for (int b = 0; b < ENSEMBLE_AGE_BITS; b++) {
+                aged[b] = tile->age[b] ^ carry;
+                carry &= tile->age[b];
+                done &= (burn_steps[j] >> b & 1) ? aged[b] : ~aged[b];
+            }
+            uint64_t still_burning = tile->burning & ~hit & ~done;
+            next->burning = still_burning | (tile->unburnt & hit & ~hit_twice);
+            next->unburnt = tile->unburnt & ~hit;
+            for (int b = 0; b < ENSEMBLE_AGE_BITS; b++)
+                next->age[b] = aged[b] & still_burning;
+            ensemble->next_row_fire[i+1] += __builtin_popcountll(next->burning);
+        }
+    }
+
+    EnsembleTile *swap = ensemble->tiles;
+    ensemble->tiles = ensemble->next_tiles;
+    ensemble->next_tiles = swap;
+    for (int64_t i = 0; i < ensemble->height; i++)
+        ensemble->row_fire[i+1] = ensemble->next_row_fire[i+1];
+    return fire_count;
+}
+
+void ensembleBurnCounts(const Ensemble *ensemble, uint8_t *counts) {
+    for (int64_t i = 0; i < ensemble->height; i++) {
+        const EnsembleTile *row = ensembleRow(ensemble->tiles, ensemble, i);
+        for (int64_t j = 0; j < ensemble->width; j++) {
+            // Tiles with no fuel never count as ignited.
+            uint64_t ignited = ensemble->burn_steps[i*ensemble->width + j] ? ~row[j].unburnt : 0;
+            counts[i*ensemble->width + j] = __builtin_popcountll(ignited);
+        }
+    }
+}
+
+bool setEnsembleOdds(Ensemble *ensemble, const float *odds, int count) {
+    if (count < 1)
+        return false;
+    for (int k = 1; k < count && k < ENSEMBLE_LANES; k++) {
+        if (!(odds[k] >= odds[k-1]))
+            return false;
+    }
+    for (int k = 0; k < ENSEMBLE_LANES; k++)
+        ensemble->lane_odds[k] = odds[k < count ? k : count-1];
+    ensemble->common_rolls = true;
+    return true;
+}
+
+void ensembleLaneBurned(const Ensemble *ensemble, int64_t *burned) {
+    for (int k = 0; k < ENSEMBLE_LANES; k++)
+        burned[k] = 0;
+    for (int64_t i = 0; i < ensemble->height; i++) {
+        const EnsembleTile *row = ensembleRow(ensemble->tiles, ensemble, i);
+        for (int64_t j = 0; j < ensemble->width; j++) {
+            uint64_t ignited = ensemble->burn_steps[i*ensemble->width + j] ? ~row[j].unburnt : 0;
+            for (; ignited; ignited &= ignited - 1)
+                burned[__builtin_ctzll(ignited)]++;
+        }
+    }
+}
+
+// 64 rolls at once: bit k is set with probability threshold/65536. Each lane
+// compares its own random 16-bit number against threshold from the top bit
+// down, and the comparison stops as soon as every lane in lanes is decided,
+// about log2 of their number plus two words rather than 16 per lane. Each
+// edge mixes its key from the step's once, and each word of it takes one
+// more mix. Odds of 1 round to a threshold of 65536, which has no bits in
+// 15..0 and is every lane.
+static uint64_t rollMask(uint32_t threshold, uint64_t step_key, uint64_t tile, int dir, uint64_t lanes) {
+    if (threshold >= 65536)
+        return ~0ULL;
+    uint64_t edge_key = rngMix(step_key ^ (tile*4 + dir));
+    uint64_t below = 0;
+    uint64_t equal = lanes;
+    for (int bit = 15; bit >= 0 && equal; bit--) {
+        uint64_t random = rngMix(edge_key + bit);
+        if (threshold >> bit & 1) {
+            below |= equal & ~random;
+            equal &= random;
+        } else {
+            equal &= ~random;
+        }
+    }
+    return below;
+}
+
+// One uniform number for every lane, the one stepBand compares against its
+// odds. The lanes it spreads in are those with odds above it, which, with
+// odds ascending, are all the lanes from the first such one up.
+static uint64_t commonRollMask(const Ensemble *ensemble, uint64_t seed, int step, uint64_t tile, int dir) {
+    float roll = rngUniform(seed, step, tile, dir);
+    int low = 0, high = ENSEMBLE_LANES;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (ensemble->lane_odds[mid] > roll)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return low == ENSEMBLE_LANES ? 0 : ~0ULL << low;
+}
@@ -0,0 +1,64 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "grid.h"
+#include "sim.h"
+#include <stdint.h>
+
+#define ENSEMBLE_LANES 64
+#define ENSEMBLE_AGE_BITS 8
+
+// One tile for 64 realizations of the synchronous model at once: bit k of each
+// word belongs to realization k. The age is a bit-sliced counter of the steps
+// each burning realization has burned for, age[b] holding bit b of it.
+typedef struct EnsembleTile
+{
+    uint64_t unburnt;
+    uint64_t burning;
+    uint64_t age[ENSEMBLE_AGE_BITS];
+} EnsembleTile;
+
+// All realizations share the landscape, so a tile burns for the same number
+// of steps in every one of them and only ignition times differ. Tiles are
+// stored with one empty halo row above and below the grid.
+typedef struct Ensemble
+{
+    int64_t width;
+    int64_t height;
+    uint8_t *burn_steps;
+    EnsembleTile *tiles;
+    EnsembleTile *next_tiles;
+    // Burning realizations per row, halos included, for skipping quiet rows
+    int64_t *row_fire;
+    int64_t *next_row_fire;
+    char *row_settled;
+    // With common rolls every lane sees the same uniform number per edge,
+    // the one stepBand rolls, and lane k spreads across it with odds
+    // lane_odds[k] instead of all lanes using the odds given to the step
+    bool common_rolls;
+    float lane_odds[ENSEMBLE_LANES];
+} Ensemble;
+
+// Starts all 64 realizations from the same Vertex grid. Both constructors
+// return NULL if the tiles cannot be allocated.
+Ensemble *newEnsemble(Vertex *grid, int64_t width, int64_t height);
+// Starts all 64 realizations from the planes of a band covering a whole grid.
+Ensemble *newBandEnsemble(const SimBand *band);
+void freeEnsemble(Ensemble *ensemble);
+// Advances every realization one step with plain bitwise logic. Spread rolls
+// for all 64 realizations come from one 64-bit mask per edge, so realizations
+// differ only in the random bits they see. Returns the number of burning
+// (tile, realization) pairs at the start of the step.
+int64_t stepEnsemble(Ensemble *ensemble, float odds, uint64_t seed, int step);
+// For each tile, the number of realizations (0-64) in which it ignited.
+void ensembleBurnCounts(const Ensemble *ensemble, uint8_t *counts);
+// Turns the lanes into a parameter sweep with common random numbers: lane k
+// steps exactly as stepBand would with odds[k] and the same seed, so results
+// differ between lanes only because the odds do. Lanes past count repeat the
+// last odds. Returns false, leaving the ensemble as it was, when count is not
+// positive or the odds are not ascending.
+bool setEnsembleOdds(Ensemble *ensemble, const float *odds, int count);
+// Tiles ignited in each lane, ENSEMBLE_LANES counts.
+void ensembleLaneBurned(const Ensemble *ensemble, int64_t *burned);
+
+#endif
@@ -0,0 +1,164 @@
+#include "event.h"
+
+#include <stdlib.h>
+#include <climits>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+// A successful roll of src onto dst at step.
+typedef struct Event
+{
+    int step;
+    int64_t src;
+    int64_t dst;
+} Event;
+
+struct LaterEvent
+{
+    bool operator()(const Event &a, const Event &b) const {
+        return a.step > b.step;
+    }
+};
+
+static int geometricDelay(float odds);
+static void igniteTile(Vertex *grid, int64_t tile, int step, int64_t width, int64_t height, float odds,
+                       std::vector<int> &ignited_at, std::vector<int> &burns_until,
+                       std::vector<int64_t> &ignited,
+                       std::priority_queue<Event, std::vector<Event>, LaterEvent> &events);
+
+// The model is evaluated synchronously: every tile acts on the state at the
+// start of a step, and a tile ignited during step s first rolls in step s+1.
+// A tile burns during steps (ignited_at, burns_until]. As in stepBand, a roll
+// landing on a tile that has already ignited puts it out, so two rolls onto
+// the same tile in one step cancel.
+int eventFire(Vertex *grid, int64_t width, int64_t height, float scale_factor, int until_step, int *arrival) {
+    int64_t cell_count = width*height;
+    std::vector<int> ignited_at(cell_count, -1);
+    std::vector<int> burns_until(cell_count, -1);
+    std::vector<int64_t> ignited;
+    std::priority_queue<Event, std::vector<Event>, LaterEvent> events;
+
+    for (int64_t tile = 0; tile < cell_count; tile++) {
+        if (grid[tile*6].col[0] == 0)
+            continue;
+        // igniteTile moves col[1] into col[0], so do the same for tiles that
+        // are already burning to keep their remaining intensity.
+        for (int v = 0; v < 6; v++)
+            grid[tile*6+v].col[1] = grid[tile*6+v].col[0];
+        igniteTile(grid, tile, 0, width, height, scale_factor, ignited_at, burns_until, ignited, events);
+    }
+
+    int last_step = 0;
+    while (!events.empty()) {
+        Event event = events.top();
+        if (until_step >= 0 && event.step > until_step)
+            break;
+        events.pop();
+        // The source went out before this roll came up.
+        if (event.step > burns_until[event.src])
+            continue;
+        last_step = event.step;
+
+        if (ignited_at[event.dst] < 0) {
+            igniteTile(grid, event.dst, event.step, width, height, scale_factor, ignited_at, burns_until, ignited, events);
+        } else if (burns_until[event.dst] > event.step) {
+            burns_until[event.dst] = event.step;
+        }
+
+        // Only keep rolling on this edge while the target can still change.
+        int next_step = event.step + geometricDelay(scale_factor);
+        if (next_step <= burns_until[event.src]
+            && (ignited_at[event.dst] < 0 || burns_until[event.dst] > event.step)) {
+            events.push({next_step, event.src, event.dst});
+        }
+    }
+
+    int end_step = until_step;
+    if (until_step < 0) {
+        // Nothing left to roll, so the fire is out once the last tile burns down.
+        end_step = last_step;
+        for (int64_t tile : ignited) {
+            if (burns_until[tile] > end_step)
+                end_step = burns_until[tile];
+        }
+    }
+    for (int64_t tile : ignited) {
+        float intensity = 0;
+        if (burns_until[tile] > end_step) {
+            intensity = grid[tile*6].col[0];
+            for (int s = ignited_at[tile]; s < end_step; s++)
+                intensity -= 0.005;
+        }
+        for (int v = 0; v < 6; v++)
+            grid[tile*6+v].col[0] = intensity;
+    }
+    if (arrival != NULL) {
+        for (int64_t tile = 0; tile < cell_count; tile++)
+            arrival[tile] = ignited_at[tile];
+    }
+    return end_step;
+}
+
+// Mirrors the decrement in updateGrid, including its float rounding, so the
+// two engines burn a tile for exactly the same number of steps.
+int burnSteps(float intensity) {
+    if (intensity <= 0)
+        return 0;
+    int steps = 0;
+    while (intensity > 0) {
+        intensity -= 0.005;
+        steps++;
+    }
+    return steps;
+}
+
+static void igniteTile(Vertex *grid, int64_t tile, int step, int64_t width, int64_t height, float odds,
+                       std::vector<int> &ignited_at, std::vector<int> &burns_until,
+                       std::vector<int64_t> &ignited,
+                       std::priority_queue<Event, std::vector<Event>, LaterEvent> &events) {
+    float fuel = grid[tile*6].col[1];
+    // Igniting a tile with no fuel leaves it at zero intensity: nothing happens.
+    if (fuel <= 0)
+        return;
+    for (int v = 0; v < 6; v++) {
+        grid[tile*6+v].col[0] = fuel;
+        grid[tile*6+v].col[1] = 0;
+    }
+    ignited_at[tile] = step;
+    burns_until[tile] = step + burnSteps(fuel);
+    ignited.push_back(tile);
+
+    int64_t i = tile / width;
+    int64_t j = tile % width;
+    int64_t neighbors[4];
+    int neighbor_count = 0;
+    if (j > 0)
+        neighbors[neighbor_count++] = tile - 1;
+    if (j < width-1)
+        neighbors[neighbor_count++] = tile + 1;
+    if (i > 0)
+        neighbors[neighbor_count++] = tile - width;
+    if (i < height-1)
+        neighbors[neighbor_count++] = tile + width;
+    for (int n = 0; n < neighbor_count; n++) {
+        int first_step = step + geometricDelay(odds);
+        if (first_step <= burns_until[tile])
+            events.push({first_step, tile, neighbors[n]});
+    }
+}
+
+// Steps until the first success of a roll that succeeds with probability odds
+// each step, always at least 1. Delays are capped at INT_MAX/2, far beyond any
+// burn, so adding one to a step cannot overflow.
+static int geometricDelay(float odds) {
+    if (odds <= 0)
+        return INT_MAX/2;
+    if (odds >= 1)
+        return 1;
+    double u = ((double)rand() + 1.0) / ((double)RAND_MAX + 1.0);
+    double delay = 1.0 + std::floor(std::log(u) / std::log1p(-(double)odds));
+    if (delay >= INT_MAX/2)
+        return INT_MAX/2;
+    return (int)delay;
+}
@@ -0,0 +1,26 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "grid.h"
+
+// Discrete-event form of the synchronous model that stepBand steps. Instead
+// of rolling every neighbor of every burning tile every step, the step of the
+// next successful roll on each edge is drawn directly from the geometric
+// distribution and processed from a priority queue, so empty time and
+// unburnable tiles cost nothing. It draws its rolls from rand() rather than
+// the counter generator, so it matches stepBand in distribution, not roll for
+// roll. It does not match the in-place updateGrid, whose sweep lets tiles
+// ignited to the right and above roll again in the same step and so spreads
+// faster in those directions.
+//
+// Tiles whose col[0] is non-zero on entry are treated as burning at step 0.
+// Runs until the fire is out, or until until_step if it is not negative, and
+// leaves grid as stepBand leaves it after that step.
+// arrival (width*height ints, may be NULL) receives the step each tile ignited
+// at, or -1 if it never did. Returns the last step simulated.
+int eventFire(Vertex *grid, int64_t width, int64_t height, float scale_factor, int until_step, int *arrival);
+
+// Number of steps a tile ignited with the given intensity keeps burning.
+int burnSteps(float intensity);
+
+#endif
@@ -0,0 +1,262 @@
+#include "frames.h"
+
+#include <string.h>
+
+static void encodeKeyframe(FrameEncoder *encoder, const uint8_t *intensity, const uint8_t *fuel);
+static void encodeDelta(FrameEncoder *encoder, const uint8_t *intensity, const uint8_t *fuel, int elapsed);
+static void encodeRuns(std::vector<uint8_t> *payload, const uint8_t *plane, int64_t count);
+static bool decodeRuns(const uint8_t **at, const uint8_t *end, uint8_t *plane, int64_t count);
+static bool decodeDelta(FrameDecoder *decoder, const uint8_t *at, const uint8_t *end);
+static void playForward(uint8_t *intensity, int64_t count, int elapsed);
+static void putVarint(std::vector<uint8_t> *payload, uint64_t value);
+static bool getVarint(const uint8_t **at, const uint8_t *end, uint64_t *value);
+static uint64_t maxPayload(int64_t tiles);
+
+// Tiles compared at once while looking for the next change
+#define DELTA_CHUNK 32
+
+// Intensity a tile has left after burning for steps more
+inline uint8_t playedForward(uint8_t intensity, uint8_t steps) {
+    return intensity > steps ? intensity - steps : 0;
+}
+
+FrameEncoder *newFrameEncoder(int64_t width, int64_t height, int keyframe_every, FILE *file) {
+    if (width < 1 || height < 1 || width > FRAMES_MAX_TILES / height)
+        return NULL;
+    FrameEncoder *encoder = new FrameEncoder;
+    encoder->width = width;
+    encoder->height = height;
+    encoder->file = file;
+    encoder->keyframe_every = keyframe_every < 1 ? 1 : keyframe_every;
+    encoder->frames = 0;
+    encoder->last_step = 0;
+    encoder->intensity.resize(width*height);
+    encoder->fuel.resize(width*height);
+    uint32_t version = FRAMES_VERSION;
+    uint64_t size[2] = {(uint64_t) width, (uint64_t) height};
+    fwrite("FFRM", 1, 4, file);
+    fwrite(&version, sizeof(uint32_t), 1, file);
+    fwrite(size, sizeof(uint64_t), 2, file);
+    return encoder;
+}
+
+void freeFrameEncoder(FrameEncoder *encoder) {
+    fflush(encoder->file);
+    delete encoder;
+}
+
+int64_t encodeFrame(FrameEncoder *encoder, const uint8_t *intensity, const uint8_t *fuel, int step) {
+    bool keyframe = encoder->frames % encoder->keyframe_every == 0 || step < encoder->last_step;
+    encoder->payload.clear();
+    if (keyframe)
+        encodeKeyframe(encoder, intensity, fuel);
+    else
+        encodeDelta(encoder, intensity, fuel, step - encoder->last_step);
+    int64_t tiles = encoder->width*encoder->height;
+    memcpy(encoder->intensity.data(), intensity, tiles);
+    memcpy(encoder->fuel.data(), fuel, tiles);
+    encoder->frames++;
+    encoder->last_step = step;
+
+    uint32_t frame_step = step;
+    uint64_t size = encoder->payload.size();
+    fputc(keyframe ? 'K' : 'D', encoder->file);
+    fwrite(&frame_step, sizeof(uint32_t), 1, encoder->file);
+    fwrite(&size, sizeof(uint64_t), 1, encoder->file);
+    fwrite(encoder->payload.data(), 1, size, encoder->file);
+    return 1 + sizeof(uint32_t) + sizeof(uint64_t) + size;
+}
+
+int64_t encodeQuant(FrameEncoder *encoder, const QuantGrid *quant, int step) {
+    return encodeFrame(encoder, quantRow(quant->intensity, quant, 0), quantRow(quant->fuel, quant, 0), step);
+}
+
+FrameDecoder *newFrameDecoder(FILE *file) {
+    char magic[4];
+    uint32_t version;
+    uint64_t size[2];
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "FFRM", 4) != 0
+        || fread(&version, sizeof(uint32_t), 1, file) != 1 || version != FRAMES_VERSION
+        || fread(size, sizeof(uint64_t), 2, file) != 2)
+        return NULL;
+    // Checked by division, since the product can wrap
+    if (size[0] < 1 || size[1] < 1 || size[0] > (uint64_t) FRAMES_MAX_TILES / size[1])
+        return NULL;
+    FrameDecoder *decoder = new FrameDecoder;
+    decoder->width = size[0];
+    decoder->height = size[1];
+    decoder->file = file;
+    decoder->have_keyframe = false;
+    decoder->step = 0;
+    decoder->intensity.resize(size[0]*size[1]);
+    decoder->fuel.resize(size[0]*size[1]);
+    return decoder;
+}
+
+void freeFrameDecoder(FrameDecoder *decoder) {
+    delete decoder;
+}
+
+bool decodeFrame(FrameDecoder *decoder) {
+    while (true) {
+        int kind = fgetc(decoder->file);
+        uint32_t step;
+        uint64_t size;
+        if (kind == EOF || fread(&step, sizeof(uint32_t), 1, decoder->file) != 1
+            || fread(&size, sizeof(uint64_t), 1, decoder->file) != 1)
+            return false;
+        int64_t tiles = decoder->width*decoder->height;
+        if (size > maxPayload(tiles))
+            return false;
+        decoder->payload.resize(size);
+        if (fread(decoder->payload.data(), 1, size, decoder->file) != size)
+            return false;
+        const uint8_t *at = decoder->payload.data();
+        const uint8_t *end = at + size;
+        if (kind == 'K') {
+            if (!decodeRuns(&at, end, decoder->intensity.data(), tiles)
+                || !decodeRuns(&at, end, decoder->fuel.data(), tiles))
+                return false;
+            decoder->have_keyframe = true;
+        } else if (kind == 'D') {
+            if (!decoder->have_keyframe)
+                continue;
+            if (!decodeDelta(decoder, at, end))
+                return false;
+        } else {
+            return false;
+        }
+        decoder->step = step;
+        return true;
+    }
+}
+
+static void encodeKeyframe(FrameEncoder *encoder, const uint8_t *intensity, const uint8_t *fuel) {
+    int64_t tiles = encoder->width*encoder->height;
+    encodeRuns(&encoder->payload, intensity, tiles);
+    encodeRuns(&encoder->payload, fuel, tiles);
+}
+
+// The comparison against the last frame played forward is the only full
+// pass, and goes a chunk at a time so it vectorizes; what gets written
+// depends on the front alone.
+static void encodeDelta(FrameEncoder *encoder, const uint8_t *intensity, const uint8_t *fuel, int elapsed) {
+    int64_t tiles = encoder->width*encoder->height;
+    const uint8_t *last_intensity = encoder->intensity.data();
+    const uint8_t *last_fuel = encoder->fuel.data();
+    uint8_t steps = elapsed > 255 ? 255 : elapsed;
+    std::vector<uint8_t> *payload = &encoder->payload;
+    putVarint(payload, elapsed);
+    int64_t unchanged_from = 0;
+    int64_t tile = 0;
+    while (tile < tiles) {
+        while (tile + DELTA_CHUNK <= tiles) {
+            uint8_t differ = 0;
+            for (int k = 0; k < DELTA_CHUNK; k++) {
+                differ |= intensity[tile+k] ^ playedForward(last_intensity[tile+k], steps);
+                differ |= fuel[tile+k] ^ last_fuel[tile+k];
+            }
+            if (differ)
+                break;
+            tile += DELTA_CHUNK;
+        }
+        if (tile == tiles)
+            break;
+        if (intensity[tile] == playedForward(last_intensity[tile], steps) && fuel[tile] == last_fuel[tile]) {
+            tile++;
+            continue;
+        }
+        int64_t first = tile;
+        while (tile < tiles && (intensity[tile] != playedForward(last_intensity[tile], steps)
+                                || fuel[tile] != last_fuel[tile]))
+            tile++;
+        putVarint(payload, first - unchanged_from);
+        putVarint(payload, tile - first);
+        for (int64_t t = first; t < tile; t++) {
+            payload->push_back(intensity[t]);
+            payload->push_back(fuel[t]);
+        }
+        unchanged_from = tile;
+    }
+}
+
+static void encodeRuns(std::vector<uint8_t> *payload, const uint8_t *plane, int64_t count) {
+    int64_t start = 0;
+    while (start < count) {
+        int64_t end = start + 1;
+        while (end < count && plane[end] == plane[start])
+            end++;
+        putVarint(payload, end - start);
+        payload->push_back(plane[start]);
+        start = end;
+    }
+}
+
+static bool decodeRuns(const uint8_t **at, const uint8_t *end, uint8_t *plane, int64_t count) {
+    int64_t filled = 0;
+    while (filled < count) {
+        uint64_t run;
+        if (!getVarint(at, end, &run) || *at == end || run > (uint64_t) (count - filled))
+            return false;
+        memset(plane + filled, **at, run);
+        (*at)++;
+        filled += run;
+    }
+    return true;
+}
+
+static bool decodeDelta(FrameDecoder *decoder, const uint8_t *at, const uint8_t *end) {
+    int64_t tiles = decoder->width*decoder->height;
+    uint64_t elapsed;
+    if (!getVarint(&at, end, &elapsed))
+        return false;
+    playForward(decoder->intensity.data(), tiles, elapsed);
+    int64_t tile = 0;
+    while (at < end) {
+        uint64_t skip, changed;
+        if (!getVarint(&at, end, &skip) || !getVarint(&at, end, &changed)
+            || skip + changed > (uint64_t) (tiles - tile) || (uint64_t) (end - at) < 2*changed)
+            return false;
+        tile += skip;
+        for (uint64_t t = 0; t < changed; t++, tile++) {
+            decoder->intensity[tile] = *at++;
+            decoder->fuel[tile] = *at++;
+        }
+    }
+    return true;
+}
+
+static void playForward(uint8_t *intensity, int64_t count, int elapsed) {
+    uint8_t steps = elapsed > 255 ? 255 : elapsed;
+    for (int64_t tile = 0; tile < count; tile++)
+        intensity[tile] = playedForward(intensity[tile], steps);
+}
+
+static void putVarint(std::vector<uint8_t> *payload, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value)
+            byte |= 0x80;
+        payload->push_back(byte);
+    } while (value);
+}
+
+static bool getVarint(const uint8_t **at, const uint8_t *end, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*at == end)
+            return false;
+        uint8_t byte = *(*at)++;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// A keyframe is at worst a run of one per tile in each plane, 4 bytes a tile;
+// a delta is at worst 2 bytes a tile and a few varints.
+static uint64_t maxPayload(int64_t tiles) {
+    return 4*(uint64_t) tiles + 32;
+}
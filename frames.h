@@ -0,0 +1,74 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include "quant.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#define FRAMES_VERSION 2
+// Most tiles a stream may have, so a damaged or hostile header cannot make a
+// decoder allocate without bound
+#define FRAMES_MAX_TILES (1LL << 32)
+
+// A stream of frames of the intensity and fuel planes, one byte per tile in
+// burn steps as QuantGrid and the shared memory export store them:
+//
+// "FFRM", version as a little-endian uint32, width and height as uint64, then
+// per frame a kind byte ('K' or 'D'), the step as uint32, the payload size as
+// uint64 and the payload. All counts in payloads are LEB128 varints.
+//
+// A keyframe ('K') run-length encodes both planes whole, as (run, byte) pairs.
+// A delta frame ('D') starts with the steps elapsed since the frame before it
+// and encodes only the tiles that differ from that frame played forward:
+// burning tiles lose one step of intensity per step and nothing else changes.
+// Tiles that follow that (everything but the front) cost nothing; the rest go
+// as (unchanged tiles skipped, tiles changed, then intensity and fuel bytes
+// of each changed tile).
+typedef struct FrameEncoder
+{
+    int64_t width;
+    int64_t height;
+    FILE *file;
+    // A keyframe every this many frames, for readers that lose their place
+    int keyframe_every;
+    int64_t frames;
+    int last_step;
+    // The last frame, as the decoder has it
+    std::vector<uint8_t> intensity;
+    std::vector<uint8_t> fuel;
+    std::vector<uint8_t> payload;
+} FrameEncoder;
+
+typedef struct FrameDecoder
+{
+    int64_t width;
+    int64_t height;
+    FILE *file;
+    bool have_keyframe;
+    int step;
+    std::vector<uint8_t> intensity;
+    std::vector<uint8_t> fuel;
+    std::vector<uint8_t> payload;
+} FrameDecoder;
+
+// Writes the stream header to file, which can be a socket or pipe opened
+// with fdopen as well as a file. Returns NULL for an empty grid or one of more
+// than FRAMES_MAX_TILES tiles.
+FrameEncoder *newFrameEncoder(int64_t width, int64_t height, int keyframe_every, FILE *file);
+void freeFrameEncoder(FrameEncoder *encoder);
+// Appends a frame for the given planes and returns the bytes it took.
+int64_t encodeFrame(FrameEncoder *encoder, const uint8_t *intensity, const uint8_t *fuel, int step);
+int64_t encodeQuant(FrameEncoder *encoder, const QuantGrid *quant, int step);
+
+// Reads the stream header. Returns NULL if file does not start with one, or
+// its grid is empty or has more than FRAMES_MAX_TILES tiles.
+FrameDecoder *newFrameDecoder(FILE *file);
+void freeFrameDecoder(FrameDecoder *decoder);
+// Reads the next frame into the decoder's planes and step. Delta frames
+// before the first keyframe are skipped. Returns false at the end of the
+// stream or on a damaged frame, including one whose payload is larger than
+// any frame of the grid can encode to.
+bool decodeFrame(FrameDecoder *decoder);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <linmath.h>
+#include <stdint.h>
+
+// Each tile is drawn as two triangles, so it owns 6 consecutive vertices.
+// col[0] is the fire intensity and col[1] the unburnt fuel of the tile. col[2]
+// is 0 until the fire takes the tile's fuel, then one more than the number of
+// steps taken before it did; only the interactive simulation records it.
+typedef struct Vertex
+{
+    vec2 pos;
+    vec3 col;
+} Vertex;
+
+// Grids are width tiles wide and height tiles tall, stored row by row. Indices
+// are 64-bit: 6 vertices per tile overflow an int past about 18k x 18k tiles.
+inline int64_t getGridIndex(int64_t i, int64_t j, int64_t width) {
+    return i*width*2*3+ j*6;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "landscape.h"
+#include "rng.h"
+
+#include <stdlib.h>
+#include <vector>
+
+// Stream of the lattice values, apart from the four roll directions
+#define LANDSCAPE_STREAM 5
+// Tiles of a row worked on at once, so lattice values fit on the stack
+#define LANDSCAPE_CHUNK 256
+// Rows per task in genLandscape
+#define LANDSCAPE_ROWS 16
+
+typedef struct LandscapeArgs
+{
+    Vertex *grid;
+    int64_t width;
+    int64_t height;
+    const FuelNoise *noise;
+} LandscapeArgs;
+
+static float latticeValue(uint64_t row_key, int64_t lj);
+static void fillRows(void *context, int64_t task, int worker);
+
+FuelNoise whiteFuelNoise(uint64_t seed) {
+    return {seed, 1, 1, 1.f, 0.5f, 1.f};
+}
+
+FuelNoise clumpedFuelNoise(uint64_t seed, int clump) {
+    return {seed, clump, 4, 0.5f, 0.5f, 1.f};
+}
+
+// Each lattice row gets its key from the full generator once, and its points
+// take one more mix of the key each.
+static float latticeValue(uint64_t row_key, int64_t lj) {
+    return (float)(rngMix(row_key ^ lj) >> 40) * (1.f/16777216.f);
+}
+
+void fuelNoiseRow(const FuelNoise *noise, int64_t i, int64_t first_j, int64_t count, float *fuel) {
+    int64_t end = first_j + count;
+    for (int64_t k = 0; k < count; k++)
+        fuel[k] = 0;
+    float weight = 1, total = 0;
+    for (int octave = 0; octave < noise->octaves; octave++) {
+        int64_t cell = noise->clump >> octave;
+        if (cell < 1)
+            cell = 1;
+        int64_t li = i / cell;
+        float y = (float) (i % cell) / cell;
+        float sy = y*y*(3 - 2*y);
+        float step = 1.f / cell;
+        uint64_t key = rngHash(noise->seed, octave, li, LANDSCAPE_STREAM);
+        uint64_t next_key = rngHash(noise->seed, octave, li+1, LANDSCAPE_STREAM);
+        for (int64_t start = first_j; start < end; start += LANDSCAPE_CHUNK) {
+            int64_t stop = start + LANDSCAPE_CHUNK < end ? start + LANDSCAPE_CHUNK : end;
+            // Lattice values interpolated down to row i, one per lattice
+            // column the chunk touches and one past it
+            int64_t first_lj = start / cell;
+            int64_t last_lj = (stop - 1) / cell + 1;
+            float column[LANDSCAPE_CHUNK + 2];
+            for (int64_t lj = first_lj; lj <= last_lj; lj++) {
+                float a = latticeValue(key, lj);
+                if (sy != 0)
+                    a += (latticeValue(next_key, lj) - a)*sy;
+                column[lj - first_lj] = a;
+            }
+            float *out = fuel + (start - first_j);
+            if (cell == 1) {
+                for (int64_t t = 0; t < stop - start; t++)
+                    out[t] += weight*column[t];
+                continue;
+            }
+            for (int64_t lj = first_lj; lj < last_lj; lj++) {
+                int64_t from = lj*cell > start ? lj*cell : start;
+                int64_t to = (lj+1)*cell < stop ? (lj+1)*cell : stop;
+                // 32-bit so the conversion to float vectorizes
+                int offset = from - lj*cell;
+                int tiles = to - from;
+                float a = column[lj - first_lj];
+                float d = column[lj - first_lj + 1] - a;
+                float *cell_out = out + (from - start);
+                for (int t = 0; t < tiles; t++) {
+                    float x = (offset + t)*step;
+                    cell_out[t] += weight*(a + d*(x*x*(3 - 2*x)));
+                }
+            }
+        }
+        total += weight;
+        weight *= noise->persistence;
+    }
+    float scale = (noise->max_fuel - noise->min_fuel) / total;
+    for (int64_t k = 0; k < count; k++)
+        fuel[k] = noise->min_fuel + fuel[k]*scale;
+}
+
+float fuelNoiseAt(void *noise, int64_t i, int64_t j) {
+    float fuel;
+    fuelNoiseRow((const FuelNoise *) noise, i, j, 1, &fuel);
+    return fuel;
+}
+
+Vertex *genLandscape(int64_t width, int64_t height, const FuelNoise *noise, Scheduler *scheduler) {
+    Vertex *grid = (Vertex *) std::malloc(sizeof(Vertex)*2*3*width*height);
+    LandscapeArgs args = {grid, width, height, noise};
+    int64_t tasks = (height + LANDSCAPE_ROWS - 1) / LANDSCAPE_ROWS;
+    if (scheduler != NULL) {
+        runTasks(scheduler, tasks, fillRows, &args);
+    } else {
+        for (int64_t task = 0; task < tasks; task++)
+            fillRows(&args, task, 0);
+    }
+    return grid;
+}
+
+// Tasks write disjoint rows, and every value is a function of the tile's
+// position, so the grid is the same however the tasks are spread.
+static void fillRows(void *context, int64_t task, int /* worker */) {
+    LandscapeArgs *args = (LandscapeArgs *) context;
+    int64_t width = args->width;
+    float x_increment = 2.0/width;
+    float y_increment = 2.0/args->height;
+    std::vector<float> fuel(width);
+    int64_t last_row = (task+1)*LANDSCAPE_ROWS < args->height ? (task+1)*LANDSCAPE_ROWS : args->height;
+    for (int64_t i = task*LANDSCAPE_ROWS; i < last_row; i++) {
+        fuelNoiseRow(args->noise, i, 0, width, fuel.data());
+        Vertex *row = args->grid + getGridIndex(i, 0, width);
+        float base_y = i*y_increment-1;
+        for (int64_t j = 0; j < width; j++) {
+            float base_x = j*x_increment-1;
+            Vertex *tile = row + j*6;
+            tile[0] = {{base_x, base_y}, {0.f, fuel[j], 0.f}};
+            tile[1] = {{base_x+x_increment, base_y}, {0.f, fuel[j], 0.f}};
+            tile[2] = {{base_x, base_y+y_increment}, {0.f, fuel[j], 0.f}};
+            tile[3] = {{base_x+x_increment, base_y+y_increment}, {0.f, fuel[j], 0.f}};
+            tile[4] = {{base_x+x_increment, base_y}, {0.f, fuel[j], 0.f}};
+            tile[5] = {{base_x, base_y+y_increment}, {0.f, fuel[j], 0.f}};
+        }
+    }
+}
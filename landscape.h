@@ -0,0 +1,44 @@
+#ifndef LANDSCAPE_H
+#define LANDSCAPE_H
+
+#include "grid.h"
+#include "sched.h"
+#include <stdint.h>
+
+// Fuel from fractal value noise. Octave o is noise on a lattice of squares
+// clump >> o tiles wide (at least 1), smoothly interpolated between lattice
+// points, with persistence^o the weight of the first. The weighted sum is
+// scaled into [min_fuel, max_fuel). A larger clump gives larger patches of
+// similar fuel; clump 1 with one octave is independent fuel per tile.
+//
+// Lattice values come from the counter generator in rng.h keyed on the
+// lattice point alone, so the fuel of a tile depends only on the seed and its
+// position: not on the grid's size, on the order tiles are filled in, or on
+// how the work is split.
+typedef struct FuelNoise
+{
+    uint64_t seed;
+    int clump;
+    int octaves;
+    float persistence;
+    float min_fuel;
+    float max_fuel;
+} FuelNoise;
+
+// Independent fuel per tile in genGrid's range of [0.5, 1).
+FuelNoise whiteFuelNoise(uint64_t seed);
+// Four octaves with persistence 0.5 from patches clump tiles across.
+FuelNoise clumpedFuelNoise(uint64_t seed, int clump);
+
+// Fuel of tiles (i, first_j) to (i, first_j+count-1) into fuel. Works a
+// lattice square at a time so the inner loops are plain passes over floats.
+void fuelNoiseRow(const FuelNoise *noise, int64_t i, int64_t first_j, int64_t count, float *fuel);
+// Fuel of one tile, the same value fuelNoiseRow gives it. Has the SparseFuel
+// signature with the FuelNoise as context.
+float fuelNoiseAt(void *noise, int64_t i, int64_t j);
+
+// A Vertex grid laid out as genGrid lays it out, with fuel from noise and no
+// fire. Rows are filled as tasks on scheduler, or serially when it is NULL.
+Vertex *genLandscape(int64_t width, int64_t height, const FuelNoise *noise, Scheduler *scheduler);
+
+#endif
@@ -0,0 +1,275 @@
+#include "lod.h"
+#include "palette.h"
+
+#include <algorithm>
+#include <cmath>
+
+static void computeBlock(const LodPyramid *lod, LodLevels *copy, const Vertex *grid, int level, int64_t block);
+static int64_t blockTiles(const LodPyramid *lod, int level, int64_t bi, int64_t bj);
+static uint8_t stateByte(float value);
+
+LodPyramid *newLod(const Vertex *grid, int64_t width, int64_t height) {
+    LodPyramid *lod = new LodPyramid;
+    lod->width = width;
+    lod->height = height;
+    lod->levels = 0;
+    lod->level_width.push_back(width);
+    lod->level_height.push_back(height);
+    while (lod->level_width.back() > 1 || lod->level_height.back() > 1) {
+        lod->level_width.push_back((lod->level_width.back() + 1) / 2);
+        lod->level_height.push_back((lod->level_height.back() + 1) / 2);
+        lod->levels++;
+    }
+    lod->published = 0;
+    lod->reading = -1;
+    lod->dirty.resize(lod->levels + 1);
+    lod->dirty_flags.resize(lod->levels + 1);
+    lod->behind.resize(lod->levels + 1);
+    for (int level = 0; level <= lod->levels; level++)
+        lod->dirty_flags[level].assign(lod->level_width[level]*lod->level_height[level], 0);
+    for (LodLevels &copy : lod->copies) {
+        copy.tile_intensity.assign(width*height, 0);
+        copy.tile_fuel.assign(width*height, 0);
+        copy.tile_arrival.assign(width*height, 0);
+        copy.max_intensity.resize(lod->levels + 1);
+        copy.burning.resize(lod->levels + 1);
+        copy.fuel.resize(lod->levels + 1);
+        copy.arrival.resize(lod->levels + 1);
+        copy.burned.resize(lod->levels + 1);
+        copy.last_arrival = 0;
+        for (int level = 1; level <= lod->levels; level++) {
+            int64_t blocks = lod->level_width[level]*lod->level_height[level];
+            copy.max_intensity[level].assign(blocks, 0);
+            copy.burning[level].assign(blocks, 0);
+            copy.fuel[level].assign(blocks, 0);
+            copy.arrival[level].assign(blocks, 0);
+            copy.burned[level].assign(blocks, 0);
+        }
+        for (int level = 0; level <= lod->levels; level++) {
+            int64_t blocks = lod->level_width[level]*lod->level_height[level];
+            for (int64_t block = 0; block < blocks; block++)
+                computeBlock(lod, &copy, grid, level, block);
+        }
+    }
+    return lod;
+}
+
+void freeLod(LodPyramid *lod) {
+    delete lod;
+}
+
+void markLodDirty(LodPyramid *lod, int64_t i, int64_t j) {
+    int64_t tile = i*lod->width + j;
+    if (lod->dirty_flags[0][tile])
+        return;
+    lod->dirty_flags[0][tile] = 1;
+    lod->dirty[0].push_back(tile);
+}
+
+// Walks the dirty blocks up one level at a time, so the cost is the number of
+// changed tiles times the number of levels, for this step and the one before:
+// the copy being written last took the changes of two steps ago.
+void updateLod(LodPyramid *lod, const Vertex *grid) {
+    for (int level = 1; level <= lod->levels; level++) {
+        int64_t child_width = lod->level_width[level-1];
+        int64_t level_width = lod->level_width[level];
+        for (int64_t child : lod->dirty[level-1]) {
+            int64_t block = (child / child_width / 2)*level_width + (child % child_width) / 2;
+            if (!lod->dirty_flags[level][block]) {
+                lod->dirty_flags[level][block] = 1;
+                lod->dirty[level].push_back(block);
+            }
+        }
+    }
+    // Wait for the renderer to let go of the copy published before last
+    int back = 1 - lod->published;
+    {
+        std::unique_lock<std::mutex> lock(lod->lock);
+        lod->released.wait(lock, [lod, back] { return lod->reading != back; });
+    }
+    LodLevels *copy = &lod->copies[back];
+    for (int level = 0; level <= lod->levels; level++) {
+        std::vector<int64_t> &dirty = lod->dirty[level];
+        std::vector<char> &flags = lod->dirty_flags[level];
+        size_t changed = dirty.size();
+        for (int64_t block : lod->behind[level]) {
+            if (!flags[block]) {
+                flags[block] = 1;
+                dirty.push_back(block);
+            }
+        }
+        for (int64_t block : dirty) {
+            computeBlock(lod, copy, grid, level, block);
+            flags[block] = 0;
+        }
+        lod->behind[level].assign(dirty.begin(), dirty.begin() + changed);
+        dirty.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(lod->lock);
+        lod->published = back;
+    }
+}
+
+LodView fitLodView(const LodPyramid *lod, int width, int height) {
+    LodView view;
+    view.center_i = lod->height / 2.0;
+    view.center_j = lod->width / 2.0;
+    view.tiles_per_pixel = std::fmax((double)lod->width / width, (double)lod->height / height);
+    return view;
+}
+
+bool lodPixelToTile(const LodPyramid *lod, const LodView *view, int width, int height,
+                    double x, double y, int64_t *i, int64_t *j) {
+    double tile_i = view->center_i + (y - height/2.0)*view->tiles_per_pixel;
+    double tile_j = view->center_j + (x - width/2.0)*view->tiles_per_pixel;
+    if (tile_i < 0 || tile_j < 0 || tile_i >= lod->height || tile_j >= lod->width)
+        return false;
+    *i = (int64_t)tile_i;
+    *j = (int64_t)tile_j;
+    return true;
+}
+
+void renderLod(LodPyramid *lod, const LodView *view, int width, int height, int mode, uint8_t *state) {
+    {
+        std::lock_guard<std::mutex> lock(lod->lock);
+        lod->reading = lod->published;
+    }
+    const LodLevels *copy = &lod->copies[lod->reading];
+    int level = 0;
+    if (view->tiles_per_pixel > 1)
+        level = (int)std::ceil(std::log2(view->tiles_per_pixel));
+    if (level > lod->levels)
+        level = lod->levels;
+    int64_t level_width = lod->level_width[level];
+    double left = view->center_j - width/2.0*view->tiles_per_pixel;
+    double bottom = view->center_i - height/2.0*view->tiles_per_pixel;
+    // Arrivals from 1 to last_arrival onto 1 to 254
+    float arrival_scale = 253 / std::fmax(copy->last_arrival, 1.f);
+
+    for (int y = 0; y < height; y++) {
+        double i = bottom + (y + 0.5)*view->tiles_per_pixel;
+        // Blocks under the pixel's rows, clipped to the grid
+        double low_i = bottom + y*view->tiles_per_pixel;
+        int64_t first_bi = std::max((int64_t)std::floor(low_i), (int64_t)0) >> level;
+        int64_t last_bi = std::min((int64_t)std::ceil(low_i + view->tiles_per_pixel) - 1, lod->height - 1) >> level;
+        uint8_t *row = state + 4*(int64_t)y*width;
+        for (int x = 0; x < width; x++) {
+            double j = left + (x + 0.5)*view->tiles_per_pixel;
+            if (i < 0 || j < 0 || i >= lod->height || j >= lod->width) {
+                row[4*x] = row[4*x+1] = row[4*x+3] = 0;
+                row[4*x+2] = STATE_ARRIVAL_OFF_GRID;
+                continue;
+            }
+            double low_j = left + x*view->tiles_per_pixel;
+            int64_t first_bj = std::max((int64_t)std::floor(low_j), (int64_t)0) >> level;
+            int64_t last_bj = std::min((int64_t)std::ceil(low_j + view->tiles_per_pixel) - 1, lod->width - 1) >> level;
+            float max_intensity = 0, arrival = 0;
+            int64_t tiles = 0, burning = 0, burned = 0;
+            double fuel = 0;
+            for (int64_t bi = first_bi; bi <= last_bi; bi++) {
+                for (int64_t bj = first_bj; bj <= last_bj; bj++) {
+                    float block_arrival;
+                    if (level == 0) {
+                        int64_t tile = bi*level_width + bj;
+                        max_intensity = std::fmax(max_intensity, copy->tile_intensity[tile]);
+                        burning += copy->tile_intensity[tile] != 0;
+                        fuel += copy->tile_fuel[tile];
+                        block_arrival = copy->tile_arrival[tile];
+                        burned += block_arrival != 0;
+                        tiles++;
+                    } else {
+                        int64_t block = bi*level_width + bj;
+                        max_intensity = std::fmax(max_intensity, copy->max_intensity[level][block]);
+                        burning += copy->burning[level][block];
+                        fuel += copy->fuel[level][block];
+                        block_arrival = copy->arrival[level][block];
+                        burned += copy->burned[level][block];
+                        tiles += blockTiles(lod, level, bi, bj);
+                    }
+                    if (block_arrival != 0)
+                        arrival = arrival == 0 ? block_arrival : std::fmin(arrival, block_arrival);
+                }
+            }
+            float intensity = mode == LOD_BURNING_FRACTION ? (float)((double)burning / tiles) : max_intensity;
+            row[4*x] = stateByte(intensity);
+            row[4*x+1] = stateByte((float)(fuel / tiles));
+            row[4*x+2] = arrival == 0 ? 0 : (uint8_t) (1 + arrival*arrival_scale);
+            row[4*x+3] = stateByte((float)((double)burned / tiles));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(lod->lock);
+        lod->reading = -1;
+    }
+    lod->released.notify_one();
+}
+
+// Level 0 copies the tile from the grid; the levels above sum their children
+// in the same copy, so the levels must be brought up to date bottom up.
+static void computeBlock(const LodPyramid *lod, LodLevels *copy, const Vertex *grid, int level, int64_t block) {
+    if (level == 0) {
+        const Vertex *tile = &grid[getGridIndex(block / lod->width, block % lod->width, lod->width)];
+        copy->tile_intensity[block] = tile->col[0];
+        copy->tile_fuel[block] = tile->col[1];
+        copy->tile_arrival[block] = tile->col[2];
+        copy->last_arrival = std::fmax(copy->last_arrival, tile->col[2]);
+        return;
+    }
+    int64_t level_width = lod->level_width[level];
+    int64_t child_width = lod->level_width[level-1];
+    int64_t child_height = lod->level_height[level-1];
+    int64_t bi = block / level_width;
+    int64_t bj = block % level_width;
+    float max_intensity = 0;
+    int64_t burning = 0;
+    double fuel = 0;
+    float arrival = 0;
+    int64_t burned = 0;
+    for (int64_t ci = 2*bi; ci < 2*bi + 2 && ci < child_height; ci++) {
+        for (int64_t cj = 2*bj; cj < 2*bj + 2 && cj < child_width; cj++) {
+            int64_t child = ci*child_width + cj;
+            if (level == 1) {
+                float tile_arrival = copy->tile_arrival[child];
+                max_intensity = std::fmax(max_intensity, copy->tile_intensity[child]);
+                burning += copy->tile_intensity[child] != 0;
+                fuel += copy->tile_fuel[child];
+                if (tile_arrival != 0) {
+                    arrival = arrival == 0 ? tile_arrival : std::fmin(arrival, tile_arrival);
+                    burned++;
+                }
+            } else {
+                float child_arrival = copy->arrival[level-1][child];
+                max_intensity = std::fmax(max_intensity, copy->max_intensity[level-1][child]);
+                burning += copy->burning[level-1][child];
+                fuel += copy->fuel[level-1][child];
+                if (child_arrival != 0)
+                    arrival = arrival == 0 ? child_arrival : std::fmin(arrival, child_arrival);
+                burned += copy->burned[level-1][child];
+            }
+        }
+    }
+    copy->max_intensity[level][block] = max_intensity;
+    copy->burning[level][block] = burning;
+    copy->fuel[level][block] = fuel;
+    copy->arrival[level][block] = arrival;
+    copy->burned[level][block] = burned;
+}
+
+// 0 stays 0 and anything above it is at least 1, so a trace of fire or fuel
+// still picks a color off the bottom of the palette.
+static uint8_t stateByte(float value) {
+    if (value <= 0)
+        return 0;
+    if (value >= 1)
+        return 255;
+    return (uint8_t) (1 + value*254);
+}
+
+// Number of grid tiles under a block; less than 4^level along the far edges.
+static int64_t blockTiles(const LodPyramid *lod, int level, int64_t bi, int64_t bj) {
+    int64_t side = (int64_t)1 << level;
+    int64_t rows = std::min(side, lod->height - bi*side);
+    int64_t cols = std::min(side, lod->width - bj*side);
+    return rows*cols;
+}
@@ -0,0 +1,97 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "grid.h"
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// One copy of every level. Level 0 keeps each tile's own intensity, fuel
+// and arrival (col[2]); blocks of the levels above keep sums, so partial
+// blocks along the edges of odd-sized levels stay exact. Counts are integers
+// and fuel a double, so they stay exact at any grid size.
+typedef struct LodLevels
+{
+    std::vector<float> tile_intensity;
+    std::vector<float> tile_fuel;
+    std::vector<float> tile_arrival;
+    // Indexed by level, from 1
+    std::vector<std::vector<float>> max_intensity;
+    std::vector<std::vector<int64_t>> burning;
+    std::vector<std::vector<double>> fuel;
+    // Earliest arrival in each block, 0 while none, and the number of burned
+    // tiles. last_arrival is the latest arrival seen anywhere.
+    std::vector<std::vector<float>> arrival;
+    std::vector<std::vector<int64_t>> burned;
+    float last_arrival;
+} LodLevels;
+
+// Downsampled copies of the grid for drawing it at screen resolution. Level 0
+// is the grid itself; each level above halves both sides, so a block at level
+// k covers up to 2^k x 2^k tiles.
+//
+// The levels are kept twice. updateLod brings the copy that is not published
+// up to date and then publishes it, and renderLod only reads the published
+// copy, so the renderer never waits for a step or reads a grid being stepped;
+// the simulation only waits when the renderer is still reading the copy it is
+// about to update, which takes one render at most.
+typedef struct LodPyramid
+{
+    int64_t width;
+    int64_t height;
+    int levels;
+    std::vector<int64_t> level_width;
+    std::vector<int64_t> level_height;
+    LodLevels copies[2];
+    // Guards published and reading, never the levels
+    std::mutex lock;
+    std::condition_variable released;
+    int published;
+    // The copy renderLod is reading, -1 between renders
+    int reading;
+    // Blocks changed since the last updateLod, per level, with flags so each
+    // block is queued at most once.
+    std::vector<std::vector<int64_t>> dirty;
+    std::vector<std::vector<char>> dirty_flags;
+    // Blocks the last updateLod changed in the published copy, which the other
+    // copy has still to take
+    std::vector<std::vector<int64_t>> behind;
+} LodPyramid;
+
+// Which grid region is on screen. Coordinates are in tiles, rows increasing
+// upwards like the grid's vertex positions.
+typedef struct LodView
+{
+    double center_i;
+    double center_j;
+    double tiles_per_pixel;
+} LodView;
+
+enum {
+    LOD_MAX_INTENSITY = 0,
+    LOD_BURNING_FRACTION = 1
+};
+
+LodPyramid *newLod(const Vertex *grid, int64_t width, int64_t height);
+void freeLod(LodPyramid *lod);
+// Records that tile (i, j) changed; updateLod folds it into the coarse levels.
+// Both are called by the thread that steps the grid.
+void markLodDirty(LodPyramid *lod, int64_t i, int64_t j);
+void updateLod(LodPyramid *lod, const Vertex *grid);
+// Fits the whole grid into a width x height framebuffer.
+LodView fitLodView(const LodPyramid *lod, int width, int height);
+// Maps framebuffer pixel (x, y), y up, to the tile under it. Returns false
+// when the pixel is outside the grid.
+bool lodPixelToTile(const LodPyramid *lod, const LodView *view, int width, int height,
+                    double x, double y, int64_t *i, int64_t *j);
+// Fills width*height RGBA bytes, one per pixel, with the state channels of
+// palette.h: intensity (by mode), fuel, arrival and the fraction of tiles
+// burned. Each pixel combines the blocks it overlaps on the finest level whose
+// blocks are at least a pixel across, at most 2 x 2 of them, so every tile
+// under the pixel counts and a single burning tile is never missed. Colors
+// are left to the palettes. Reads the published copy of the levels only, from
+// one rendering thread. Cost depends only on the framebuffer size.
+void renderLod(LodPyramid *lod, const LodView *view, int width, int height, int mode, uint8_t *state);
+
+#endif
@@ -1,346 +1,593 @@
-#define GLAD_GL_IMPLEMENTATION
-#include <glad/gl.h>
-#define GLFW_INCLUDE_NONE
-#include <GLFW/glfw3.h>
- 
-#include <linmath.h>
- 
-#include <stdlib.h>
-#include <stddef.h>
-#include <stdio.h>
-
-#include <iostream>
-#include <cmath>
-#include <random>
-#include <chrono>
-#include <thread>
-
-using namespace std::chrono_literals;
-
- 
-typedef struct Vertex
-{
-    vec2 pos;
-    vec3 col;
-} Vertex;
-
-
-static const Vertex vertices_const[6] =
-{
-    { { -0.5f, -.5f}, { 0.f, 0.f, 0.f } }, // Bottom left: 0
-    { {  -.5f, .5f}, { 0.f, 0.f, 0.f } }, // Top left: 1
-    { {   .5f,  -.5f}, { 0.f, 0.f, 0.f } }, // Bottom right: 2
-    { {  -0.5f, 0.5f}, { 0.f, 0.f, 0.f } }, // Top left: 3
-    { {  .5f, .5f}, { 0.f, 0.f, 0.f } }, // Top right: 4
-    { {   0.5f,  -0.5f}, { 0.f, 0.f, 0.f } } // Bottom right: 5
-};
-
-unsigned int indices_const[] = {
-    0, 1, 2,
-    3, 4, 5
-};
- 
-static const char* vertex_shader_text =
-"#version 330\n"
-"in vec3 vCol;\n"
-"in vec2 vPos;\n"
-"out vec3 color;\n"
-"void main()\n"
-"{\n"
-"    gl_Position = vec4(vPos, 0.0, 1.0);\n"
-"    color = vCol;\n"
-"}\n";
- 
-static const char* fragment_shader_text =
-"#version 330\n"
-"in vec3 color;\n"
-"out vec4 fragment;\n"
-"void main()\n"
-"{\n"
-"    fragment = vec4(color, 1.0);\n"
-"}\n";
- 
-Vertex *genGrid(int tile_count);
-unsigned int *genIndices(int vertex_count);
-void checkGLError(const char *);
-void startFire(Vertex *grid, int vertex_count);
-void updateGrid(Vertex *grid, int tile_count);
-inline int getGridIndex(int i, int j, int tile_count);
-
-static void error_callback(int error, const char* description)
-{
-    fprintf(stderr, "Error: %s\n", description);
-}
- 
-static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, GLFW_TRUE);
-}
- 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}  
-
-int main(void)
-{
-    // Error checking
-    int  success;
-    char infoLog[512];
-    glfwSetErrorCallback(error_callback);
- 
-    if (!glfwInit())
-        exit(EXIT_FAILURE);
- 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
- 
-    GLFWwindow* window = glfwCreateWindow(640, 480, "OpenGL Triangle", NULL, NULL);
-    if (!window)
-    {
-        glfwTerminate();
-        exit(EXIT_FAILURE);
-    }
- 
-    glfwSetKeyCallback(window, key_callback);
- 
-    glfwMakeContextCurrent(window);
-    gladLoadGL(glfwGetProcAddress);
-    glfwSwapInterval(1);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);  
-   
-    const GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &vertex_shader_text, NULL);
-    glCompileShader(vertex_shader);
-    // Error checking
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(vertex_shader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
- 
-    const GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &fragment_shader_text, NULL);
-    glCompileShader(fragment_shader);
-    // Error checking
-    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(fragment_shader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-    // Build the shader program for the GPU
-    const GLuint program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
-    // Error checking
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if(!success) {
-        glGetProgramInfoLog(program, 512, NULL, infoLog);
-    }
-    
-    const GLint vpos_location = glGetAttribLocation(program, "vPos");
-    const GLint vcol_location = glGetAttribLocation(program, "vCol");
-    
-    int tile_count = 1000;
-    int vertex_count = tile_count*tile_count*2*3;
-    Vertex *grid = genGrid(tile_count);
-    // unsigned int *indices = genIndices(vertex_count);
-
-    // GLuint VBO;
-    GLuint VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    // glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    checkGLError("bind");
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*vertex_count, grid, GL_DYNAMIC_DRAW);
-    checkGLError("data");
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    // Locations of the vpos on GPU
-    glEnableVertexAttribArray(vpos_location);
-    // Tells the shader how to interpret the array of verticies. 
-    glVertexAttribPointer(vpos_location, 2, GL_FLOAT, GL_FALSE,
-                          sizeof(Vertex), (void*) offsetof(Vertex, pos));
-    // Locations of the colors on GPU
-    glEnableVertexAttribArray(vcol_location);
-    glVertexAttribPointer(vcol_location, 3, GL_FLOAT, GL_FALSE,
-                          sizeof(Vertex), (void*) offsetof(Vertex, col));
-
-    
-    // startFire(grid, vertex_count);
-    startFire(grid, tile_count);
-    while (!glfwWindowShouldClose(window))
-    {
-        updateGrid(grid, tile_count);
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-        const float ratio = width / (float) height;
-
-        updateGrid(grid, tile_count);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*vertex_count, grid, GL_DYNAMIC_DRAW);
- 
-        glViewport(0, 0, width, height);
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
- 
-        glUseProgram(program);
-        glBindVertexArray(VAO);
-        checkGLError("bind VAO");
-        glDrawArrays(GL_TRIANGLES, 0, vertex_count);
-        // glDrawElements(GL_TRIANGLES, vertex_count, GL_UNSIGNED_INT, indices);
-
- 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-        std::this_thread::sleep_for(33ms);
-    }
- 
-    glfwDestroyWindow(window);
-    free(grid);
- 
-    glfwTerminate();
-    exit(EXIT_SUCCESS);
-}
-void startFire(Vertex *grid, int tile_count) {
-    int start_index = getGridIndex(tile_count / 2, tile_count/2, tile_count);
-    // int start_index = vertex_count - 6;
-    for (int i = 0; i < 6; i++) {
-        grid[start_index+i].col[1] = 0;
-        grid[start_index+i].col[0] = 1;
-    }
-}
-
-void updateGrid(Vertex *grid, int tile_count) {
-    float fire_source_fuel;
-    float SCALE_FACTOR = 1.f/10.f;
-    for (int i = 0; i < tile_count; i++) {
-        int curRow = i*tile_count*2*3;
-        for (int j = 0; j < tile_count; j++) {
-            float odds;
-            int src_index = curRow + j*6;
-            if ((fire_source_fuel = grid[src_index].col[0]) == 0)
-                continue;
-            // Left
-            if (j > 0) {
-                int target_index = getGridIndex(i, j-1, tile_count);
-                odds = SCALE_FACTOR;
-                // std::cout << "(" << i << ", " << j-1 << "): " << odds << std::endl;
-                if (((float)rand())/((float)RAND_MAX) < odds) {
-                    for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
-                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
-                        grid[vertex_index].col[1] = 0;
-                    }
-                }
-            }
-            // Right
-            if (j < tile_count -1) {
-                int target_index = getGridIndex(i, j+1, tile_count);
-                odds = SCALE_FACTOR;
-                if (((float)rand())/((float)RAND_MAX) < odds) {
-                    for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
-                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
-                        grid[vertex_index].col[1] = 0;
-                    }
-                }
-            }
-            // Down
-            if (i > 0) {
-                int target_index = getGridIndex(i-1, j, tile_count);
-                odds = SCALE_FACTOR;
-                if (((float)rand())/((float)RAND_MAX) < odds) {
-                    for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
-                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
-                        grid[vertex_index].col[1] = 0;
-                    }
-                }
-            }
-            // Up
-            if (i < tile_count-1) {
-                int target_index = getGridIndex(i+1, j, tile_count);
-                odds = SCALE_FACTOR;
-                if (((float)rand())/((float)RAND_MAX) < odds) {
-                    for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
-                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
-                        grid[vertex_index].col[1] = 0;
-                    }
-                }
-            }
-            for (int v = 0; v < 6; v++) {
-                grid[src_index+v].col[0] -= 0.005;
-                if (grid[src_index].col[0] < 0) {
-                    grid[src_index+v].col[0] = 0;
-                }
-            }
-        }
-
-    }
-}
-inline int getGridIndex(int i, int j, int tile_count) {
-    return i*tile_count*2*3+ j*6;
-}
-
-unsigned int *genIndices(int vertex_count) {
-    unsigned int *indices = (unsigned int *)std::malloc(sizeof(unsigned int)*vertex_count);
-    for (int i = 0; i < vertex_count; i++) {
-        indices[i] = i;
-    }
-    return indices;
-}
-Vertex *genGrid(int tile_count) {
-    float increment = 2.0/tile_count;
-    Vertex *grid = (Vertex *) std::malloc(sizeof(Vertex)*2*3*tile_count*tile_count);
-    // Generate fuel amount per tile
-    srand( std::chrono::system_clock::now().time_since_epoch().count());
-    for (int i = 0; i < tile_count; i++) {
-        int curRow = i*tile_count*2*3;
-        float base_y = i*increment-1;
-        for (int j = 0; j < tile_count; j++) {
-            float fuel = ((((float)rand())/((float)RAND_MAX))/ 2.f) + 0.5f;
-
-            float base_x = j*increment-1;
-            int start_index = curRow + j*6;
-            // First Triangle
-            grid[start_index] = {{base_x, base_y}, {0.f, fuel, 0.f}}; // Bottom left
-            grid[start_index+1] = {{base_x+increment, base_y}, {0.f, fuel, 0.f}}; // Top left
-            grid[start_index+2] = {{base_x, base_y+increment}, {0.f, fuel, 0.f}}; // Bottom right
-            // Second Triangle
-            grid[start_index+3] = {{base_x+increment, base_y+increment}, {0.f, fuel, 0.f}}; // Top right
-            grid[start_index+4] = {{base_x+increment, base_y}, {0.f, fuel, 0.f}}; // Bottom right
-            grid[start_index+5] = {{base_x, base_y+increment}, {0.f, fuel, 0.f}}; // Top left
-        }    
-    }
-    return grid;
-}
-
-void checkGLError(const char *text) {
-    GLenum err;
-    
-    while ((err = glGetError()) != GL_NO_ERROR) {
-        std::cout << text << ": ";
-        if (err == GL_INVALID_ENUM) 
-            std::cout << "ENUM" << std::endl;
-        else if (err == GL_INVALID_OPERATION) 
-            std::cout << "OPERATION" << std::endl;
-        else if (err == GL_INVALID_VALUE)
-            std::cout << "VALUE" << std::endl;
-        else if (err == GL_INVALID_FRAMEBUFFER_OPERATION)
-            std::cout << "FRAME OPP" << std::endl;
-        else if (err == GL_INVALID_OPERATION) 
-            std::cout<< "OPP" << std::endl;
-        else if (err == GL_OUT_OF_MEMORY)
-            std::cout << "MEMORY" << std::endl;
-    }
+#define GLAD_GL_IMPLEMENTATION
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+ 
+#include "grid.h"
+#include "lod.h"
+#include "command.h"
+#include "landscape.h"
+#include "palette.h"
+ 
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+
+static const Vertex vertices_const[6] =
+{
+    { { -0.5f, -.5f}, { 0.f, 0.f, 0.f } }, // Bottom left: 0
+    { {  -.5f, .5f}, { 0.f, 0.f, 0.f } }, // Top left: 1
+    { {   .5f,  -.5f}, { 0.f, 0.f, 0.f } }, // Bottom right: 2
+    { {  -0.5f, 0.5f}, { 0.f, 0.f, 0.f } }, // Top left: 3
+    { {  .5f, .5f}, { 0.f, 0.f, 0.f } }, // Top right: 4
+    { {   0.5f,  -0.5f}, { 0.f, 0.f, 0.f } } // Bottom right: 5
+};
+
+unsigned int indices_const[] = {
+    0, 1, 2,
+    3, 4, 5
+};
+
+// Two triangles covering the framebuffer; the grid is drawn as a texture on it
+static const vec2 screen_quad[6] =
+{
+    { -1.f, -1.f }, { 1.f, -1.f }, { -1.f, 1.f },
+    { 1.f, 1.f }, { 1.f, -1.f }, { -1.f, 1.f }
+};
+ 
+static const char* vertex_shader_text =
+"#version 330\n"
+"in vec2 vPos;\n"
+"out vec2 texCoord;\n"
+"void main()\n"
+"{\n"
+"    gl_Position = vec4(vPos, 0.0, 1.0);\n"
+"    texCoord = vPos*0.5 + 0.5;\n"
+"}\n";
+ 
+// view holds the state bytes renderLod writes; the colors come from a row of
+// the palette texture, or the row under it where the palette's channel is 0.
+static const char* fragment_shader_text =
+"#version 330\n"
+"uniform sampler2D view;\n"
+"uniform sampler2D palettes;\n"
+"uniform int palette;\n"
+"uniform int channel;\n"
+"uniform int under;\n"
+"uniform int under_channel;\n"
+"in vec2 texCoord;\n"
+"out vec4 fragment;\n"
+"void main()\n"
+"{\n"
+"    ivec4 state = ivec4(texture(view, texCoord)*255.0 + 0.5);\n"
+"    if (state.b == 255) {\n"
+"        fragment = vec4(0.2, 0.3, 0.3, 1.0);\n"
+"        return;\n"
+"    }\n"
+"    ivec2 entry = ivec2(state[channel], palette);\n"
+"    if (entry.x == 0 && under >= 0)\n"
+"        entry = ivec2(state[under_channel], under);\n"
+"    fragment = vec4(texelFetch(palettes, entry, 0).rgb, 1.0);\n"
+"}\n";
+
+// What part of the grid is on screen. Arrows pan, +/- zoom, Home fits the
+// whole grid, M switches between max intensity and burning fraction and P
+// steps through the palettes. The mouse does the same: middle drag pans and
+// the wheel zooms.
+static LodView view;
+static int lod_mode = LOD_MAX_INTENSITY;
+static int palette = PALETTE_FIRE;
+static bool view_reset = true;
+static bool panning = false;
+static double pan_x, pan_y;
+
+// Left click ignites a tile and right drag lays a firebreak. Both go through
+// the queue and are applied by the simulation thread between steps.
+static CommandQueue command_queue;
+static bool breaking = false;
+static int64_t break_i, break_j;
+
+// Roads and breaks read from the features file given after the grid size. O
+// reads it again after it is edited, and only the features that changed are
+// redrawn.
+static const char *features_path = NULL;
+static GridOverlay *grid_overlay = NULL;
+
+// The simulation thread owns the grid and never shares it; the render thread
+// draws from the LOD copy the simulation last published.
+static LodPyramid *grid_lod = NULL;
+static std::atomic<bool> sim_running(true);
+ 
+Vertex *genGrid(int64_t width, int64_t height, int clump);
+unsigned int *genIndices(int vertex_count);
+void checkGLError(const char *);
+void startFire(Vertex *grid, int64_t width, int64_t height);
+void updateGrid(Vertex *grid, int64_t width, int64_t height, LodPyramid *lod, int step);
+void simLoop(Vertex *grid, int64_t width, int64_t height, LodPyramid *lod);
+static bool loadFeatures();
+
+static void error_callback(int error, const char* description)
+{
+    fprintf(stderr, "Error: %s\n", description);
+}
+ 
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    if (action != GLFW_PRESS && action != GLFW_REPEAT)
+        return;
+    double pan = 64*view.tiles_per_pixel;
+    if (key == GLFW_KEY_LEFT)
+        view.center_j -= pan;
+    else if (key == GLFW_KEY_RIGHT)
+        view.center_j += pan;
+    else if (key == GLFW_KEY_DOWN)
+        view.center_i -= pan;
+    else if (key == GLFW_KEY_UP)
+        view.center_i += pan;
+    else if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) && view.tiles_per_pixel > 1.0/16)
+        view.tiles_per_pixel /= 2;
+    else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT)
+        view.tiles_per_pixel *= 2;
+    else if (key == GLFW_KEY_HOME)
+        view_reset = true;
+    else if (key == GLFW_KEY_M)
+        lod_mode = lod_mode == LOD_MAX_INTENSITY ? LOD_BURNING_FRACTION : LOD_MAX_INTENSITY;
+    else if (key == GLFW_KEY_P) {
+        palette = (palette + 1) % PALETTE_COUNT;
+        glfwSetWindowTitle(window, palettes[palette].name);
+    }
+    else if (key == GLFW_KEY_O && action == GLFW_PRESS && features_path != NULL)
+        loadFeatures();
+}
+
+// Queues the features file's features for the simulation thread. A file that
+// cannot be read or has a bad line leaves the overlay as it was.
+static bool loadFeatures()
+{
+    FILE *file = fopen(features_path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s\n", features_path);
+        return false;
+    }
+    Command command = {CMD_OVERLAY, 0, 0, 0, 0, {}};
+    bool ok = readOverlayFeatures(file, &command.features);
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Bad feature in %s after %zu good ones; overlay not changed\n", features_path,
+                command.features.size());
+        return false;
+    }
+    pushCommand(&command_queue, command);
+    return true;
+}
+ 
+// Cursor position in framebuffer pixels with y up, the layout renderLod uses
+static void cursorToPixel(GLFWwindow* window, double x, double y, double *px, double *py)
+{
+    int window_width, window_height, width, height;
+    glfwGetWindowSize(window, &window_width, &window_height);
+    glfwGetFramebufferSize(window, &width, &height);
+    *px = x * width / window_width;
+    *py = (window_height - y) * height / window_height;
+}
+
+static bool cursorToTile(GLFWwindow* window, double x, double y, int64_t *i, int64_t *j)
+{
+    int width, height;
+    double px, py;
+    glfwGetFramebufferSize(window, &width, &height);
+    cursorToPixel(window, x, y, &px, &py);
+    return lodPixelToTile(grid_lod, &view, width, height, px, py, i, j);
+}
+
+static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    double x, y;
+    int64_t i, j;
+    glfwGetCursorPos(window, &x, &y);
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        if (cursorToTile(window, x, y, &i, &j))
+            pushCommand(&command_queue, {CMD_IGNITE, i, j, i, j, {}});
+    } else if (button == GLFW_MOUSE_BUTTON_RIGHT) {
+        breaking = action == GLFW_PRESS && cursorToTile(window, x, y, &break_i, &break_j);
+        if (breaking)
+            pushCommand(&command_queue, {CMD_FIREBREAK, break_i, break_j, break_i, break_j, {}});
+    } else if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
+        panning = action == GLFW_PRESS;
+        cursorToPixel(window, x, y, &pan_x, &pan_y);
+    }
+}
+
+static void cursor_pos_callback(GLFWwindow* window, double x, double y)
+{
+    if (panning) {
+        double px, py;
+        cursorToPixel(window, x, y, &px, &py);
+        view.center_j -= (px - pan_x)*view.tiles_per_pixel;
+        view.center_i -= (py - pan_y)*view.tiles_per_pixel;
+        pan_x = px;
+        pan_y = py;
+    }
+    int64_t i, j;
+    if (breaking && cursorToTile(window, x, y, &i, &j) && (i != break_i || j != break_j)) {
+        pushCommand(&command_queue, {CMD_FIREBREAK, break_i, break_j, i, j, {}});
+        break_i = i;
+        break_j = j;
+    }
+}
+
+// Zooms about the cursor, so the tile under it stays put.
+static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    if (yoffset == 0 || (yoffset > 0 && view.tiles_per_pixel <= 1.0/16))
+        return;
+    int width, height;
+    double x, y, px, py;
+    glfwGetFramebufferSize(window, &width, &height);
+    glfwGetCursorPos(window, &x, &y);
+    cursorToPixel(window, x, y, &px, &py);
+    double tile_i = view.center_i + (py - height/2.0)*view.tiles_per_pixel;
+    double tile_j = view.center_j + (px - width/2.0)*view.tiles_per_pixel;
+    view.tiles_per_pixel *= yoffset > 0 ? 0.5 : 2.0;
+    view.center_i = tile_i - (py - height/2.0)*view.tiles_per_pixel;
+    view.center_j = tile_j - (px - width/2.0)*view.tiles_per_pixel;
+}
+ 
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    glViewport(0, 0, width, height);
+}  
+
+// ./main [width height [clump]] sets the grid size in tiles and, with clump,
+// lays fuel out in patches about clump tiles across
+int main(int argc, char **argv)
+{
+    // Error checking
+    int  success;
+    char infoLog[512];
+    glfwSetErrorCallback(error_callback);
+ 
+    if (!glfwInit())
+        exit(EXIT_FAILURE);
+ 
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+ 
+    GLFWwindow* window = glfwCreateWindow(640, 480, "OpenGL Triangle", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+ 
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetCursorPosCallback(window, cursor_pos_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+ 
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    glfwSwapInterval(1);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);  
+   
+    const GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex_shader, 1, &vertex_shader_text, NULL);
+    glCompileShader(vertex_shader);
+    // Error checking
+    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
+    if(!success)
+    {
+        glGetShaderInfoLog(vertex_shader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+ 
+    const GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment_shader, 1, &fragment_shader_text, NULL);
+    glCompileShader(fragment_shader);
+    // Error checking
+    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
+    if(!success)
+    {
+        glGetShaderInfoLog(fragment_shader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+    // Build the shader program for the GPU
+    const GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    // Error checking
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success) {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+    }
+    
+    const GLint vpos_location = glGetAttribLocation(program, "vPos");
+    const GLint palettes_location = glGetUniformLocation(program, "palettes");
+    const GLint palette_location = glGetUniformLocation(program, "palette");
+    const GLint channel_location = glGetUniformLocation(program, "channel");
+    const GLint under_location = glGetUniformLocation(program, "under");
+    const GLint under_channel_location = glGetUniformLocation(program, "under_channel");
+    
+    int64_t grid_width = 1000;
+    int64_t grid_height = 1000;
+    int clump = 1;
+    if (argc > 2) {
+        grid_width = atoll(argv[1]);
+        grid_height = atoll(argv[2]);
+    }
+    if (argc > 3)
+        clump = atoi(argv[3]);
+    if (argc > 4)
+        features_path = argv[4];
+    Vertex *grid = genGrid(grid_width, grid_height, clump);
+    // unsigned int *indices = genIndices(vertex_count);
+
+    // GLuint VBO;
+    GLuint VAO, VBO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    // glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+    
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    checkGLError("bind");
+    glBufferData(GL_ARRAY_BUFFER, sizeof(screen_quad), screen_quad, GL_STATIC_DRAW);
+    checkGLError("data");
+    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // Locations of the vpos on GPU
+    glEnableVertexAttribArray(vpos_location);
+    // Tells the shader how to interpret the array of verticies. 
+    glVertexAttribPointer(vpos_location, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(vec2), (void*) 0);
+
+    // Every palette as one row of a texture on unit 1, uploaded once, so
+    // switching palettes only changes uniforms
+    uint8_t palette_rgb[3*PALETTE_SIZE*PALETTE_COUNT];
+    fillPalettes(palette_rgb);
+    GLuint palette_texture;
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &palette_texture);
+    glBindTexture(GL_TEXTURE_2D, palette_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, PALETTE_SIZE, PALETTE_COUNT, 0, GL_RGB, GL_UNSIGNED_BYTE, palette_rgb);
+    checkGLError("palettes");
+    glActiveTexture(GL_TEXTURE0);
+
+    // The visible part of the grid as state bytes, one texel per framebuffer
+    // pixel
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    int texture_width = 0, texture_height = 0;
+    uint8_t *pixels = NULL;
+
+    
+    // startFire(grid, vertex_count);
+    startFire(grid, grid_width, grid_height);
+    LodPyramid *lod = newLod(grid, grid_width, grid_height);
+    grid_lod = lod;
+    if (features_path != NULL) {
+        grid_overlay = newGridOverlay(grid, grid_width, grid_height);
+        loadFeatures();
+    }
+    std::thread sim_thread(simLoop, grid, grid_width, grid_height, lod);
+    while (!glfwWindowShouldClose(window))
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        const float ratio = width / (float) height;
+
+        if (view_reset) {
+            view = fitLodView(lod, width, height);
+            view_reset = false;
+        }
+        if (width != texture_width || height != texture_height) {
+            texture_width = width;
+            texture_height = height;
+            pixels = (uint8_t *) std::realloc(pixels, 4*width*height);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            checkGLError("texture");
+        }
+        renderLod(lod, &view, width, height, lod_mode, pixels);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+ 
+        glViewport(0, 0, width, height);
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+ 
+        glUseProgram(program);
+        const Palette *shown = &palettes[palette];
+        glUniform1i(palettes_location, 1);
+        glUniform1i(palette_location, palette);
+        glUniform1i(channel_location, shown->channel);
+        glUniform1i(under_location, shown->under);
+        glUniform1i(under_channel_location, shown->under >= 0 ? palettes[shown->under].channel : 0);
+        glBindVertexArray(VAO);
+        checkGLError("bind VAO");
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // glDrawElements(GL_TRIANGLES, vertex_count, GL_UNSIGNED_INT, indices);
+
+ 
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        std::this_thread::sleep_for(33ms);
+    }
+ 
+    sim_running = false;
+    sim_thread.join();
+    glfwDestroyWindow(window);
+    free(grid);
+    free(pixels);
+    freeLod(lod);
+    freeGridOverlay(grid_overlay);
+ 
+    glfwTerminate();
+    exit(EXIT_SUCCESS);
+}
+// Two steps per frame at the old 33ms frame pacing. Queued edits are applied
+// first, so they land between steps and only their tiles are marked dirty.
+void simLoop(Vertex *grid, int64_t width, int64_t height, LodPyramid *lod) {
+    int step = 0;
+    while (sim_running) {
+        applyCommands(&command_queue, grid, width, height, lod, step, grid_overlay);
+        updateGrid(grid, width, height, lod, step);
+        updateLod(lod, grid);
+        step++;
+        std::this_thread::sleep_for(16ms);
+    }
+}
+
+void startFire(Vertex *grid, int64_t width, int64_t height) {
+    int64_t start_index = getGridIndex(height / 2, width/2, width);
+    // int start_index = vertex_count - 6;
+    for (int i = 0; i < 6; i++) {
+        grid[start_index+i].col[1] = 0;
+        grid[start_index+i].col[0] = 1;
+        grid[start_index+i].col[2] = 1;
+    }
+}
+
+// A tile whose fuel is taken in this step records step + 1 in col[2], as
+// grid.h describes.
+void updateGrid(Vertex *grid, int64_t width, int64_t height, LodPyramid *lod, int step) {
+    float fire_source_fuel;
+    float SCALE_FACTOR = 1.f/10.f;
+    for (int64_t i = 0; i < height; i++) {
+        int64_t curRow = i*width*2*3;
+        for (int64_t j = 0; j < width; j++) {
+            float odds;
+            int64_t src_index = curRow + j*6;
+            if ((fire_source_fuel = grid[src_index].col[0]) == 0)
+                continue;
+            // Left
+            if (j > 0) {
+                int64_t target_index = getGridIndex(i, j-1, width);
+                odds = SCALE_FACTOR;
+                // std::cout << "(" << i << ", " << j-1 << "): " << odds << std::endl;
+                if (((float)rand())/((float)RAND_MAX) < odds) {
+                    float arrival = grid[target_index].col[1] != 0 ? step + 1 : grid[target_index].col[2];
+                    for (int v = 0; v < 6; v++) {
+                        int64_t vertex_index = target_index + v;
+                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
+                        grid[vertex_index].col[1] = 0;
+                        grid[vertex_index].col[2] = arrival;
+                    }
+                    markLodDirty(lod, i, j-1);
+                }
+            }
+            // Right
+            if (j < width -1) {
+                int64_t target_index = getGridIndex(i, j+1, width);
+                odds = SCALE_FACTOR;
+                if (((float)rand())/((float)RAND_MAX) < odds) {
+                    float arrival = grid[target_index].col[1] != 0 ? step + 1 : grid[target_index].col[2];
+                    for (int v = 0; v < 6; v++) {
+                        int64_t vertex_index = target_index + v;
+                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
+                        grid[vertex_index].col[1] = 0;
+                        grid[vertex_index].col[2] = arrival;
+                    }
+                    markLodDirty(lod, i, j+1);
+                }
+            }
+            // Down
+            if (i > 0) {
+                int64_t target_index = getGridIndex(i-1, j, width);
+                odds = SCALE_FACTOR;
+                if (((float)rand())/((float)RAND_MAX) < odds) {
+                    float arrival = grid[target_index].col[1] != 0 ? step + 1 : grid[target_index].col[2];
+                    for (int v = 0; v < 6; v++) {
+                        int64_t vertex_index = target_index + v;
+                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
+                        grid[vertex_index].col[1] = 0;
+                        grid[vertex_index].col[2] = arrival;
+                    }
+                    markLodDirty(lod, i-1, j);
+                }
+            }
+            // Up
+            if (i < height-1) {
+                int64_t target_index = getGridIndex(i+1, j, width);
+                odds = SCALE_FACTOR;
+                if (((float)rand())/((float)RAND_MAX) < odds) {
+                    float arrival = grid[target_index].col[1] != 0 ? step + 1 : grid[target_index].col[2];
+                    for (int v = 0; v < 6; v++) {
+                        int64_t vertex_index = target_index + v;
+                        grid[vertex_index].col[0] = grid[vertex_index].col[1];
+                        grid[vertex_index].col[1] = 0;
+                        grid[vertex_index].col[2] = arrival;
+                    }
+                    markLodDirty(lod, i+1, j);
+                }
+            }
+            for (int v = 0; v < 6; v++) {
+                grid[src_index+v].col[0] -= 0.005;
+                if (grid[src_index].col[0] < 0) {
+                    grid[src_index+v].col[0] = 0;
+                }
+            }
+            markLodDirty(lod, i, j);
+        }
+
+    }
+}
+
+unsigned int *genIndices(int vertex_count) {
+    unsigned int *indices = (unsigned int *)std::malloc(sizeof(unsigned int)*vertex_count);
+    for (int i = 0; i < vertex_count; i++) {
+        indices[i] = i;
+    }
+    return indices;
+}
+// Fuel is drawn on every core from a seed that changes every run
+Vertex *genGrid(int64_t width, int64_t height, int clump) {
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    FuelNoise noise = clump > 1 ? clumpedFuelNoise(seed, clump) : whiteFuelNoise(seed);
+    Scheduler *scheduler = newScheduler(std::thread::hardware_concurrency());
+    Vertex *grid = genLandscape(width, height, &noise, scheduler);
+    freeScheduler(scheduler);
+    return grid;
+}
+
+void checkGLError(const char *text) {
+    GLenum err;
+    
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        std::cout << text << ": ";
+        if (err == GL_INVALID_ENUM) 
+            std::cout << "ENUM" << std::endl;
+        else if (err == GL_INVALID_OPERATION) 
+            std::cout << "OPERATION" << std::endl;
+        else if (err == GL_INVALID_VALUE)
+            std::cout << "VALUE" << std::endl;
+        else if (err == GL_INVALID_FRAMEBUFFER_OPERATION)
+            std::cout << "FRAME OPP" << std::endl;
+        else if (err == GL_INVALID_OPERATION) 
+            std::cout<< "OPP" << std::endl;
+        else if (err == GL_OUT_OF_MEMORY)
+            std::cout << "MEMORY" << std::endl;
+    }
 }
\ No newline at end of file
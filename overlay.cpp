@@ -0,0 +1,478 @@
+#include "overlay.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+// Rows redrawn together after an edit. Fewer rasterize each feature nearby
+// more often; more let long diagonal edits pull in features that only pass
+// the run's bounds and not its spans.
+#define OVERLAY_REDRAW_ROWS 16
+
+static OverlayBox featureBox(const OverlayFeature *feature, int64_t width, int64_t height);
+static void featurePieces(const OverlayFeature *feature, int64_t width, int64_t height, std::vector<OverlayBox> *pieces);
+static void fileFeature(Overlay *overlay, int64_t id, bool add);
+static void redrawSpans(Overlay *overlay, const std::vector<OverlaySpan> &dirty);
+static void rasterizeWindow(const OverlayFeature *feature, int64_t width, int64_t height, const OverlayBox *window,
+                            std::vector<OverlaySpan> *spans);
+static bool featureFinite(const OverlayFeature *feature);
+static bool isFinite(double value);
+static int64_t clampTile(double at, int64_t low, int64_t high);
+static void fillSpans(Overlay *overlay, const std::vector<OverlaySpan> &spans, float fuel);
+static void normalizeSpans(std::vector<OverlaySpan> *spans);
+static void addCenterLine(const OverlayPoint *from, const OverlayPoint *to, int64_t width, int64_t height,
+                          int64_t first_row, int64_t last_row, std::vector<OverlaySpan> *spans);
+static void addPolygon(const OverlayPoint *points, int64_t count, int64_t width, int64_t first_row,
+                       int64_t last_row, std::vector<OverlaySpan> *spans);
+static bool clipSegment(const OverlayPoint *from, const OverlayPoint *to, double min_i, double max_i, double min_j,
+                        double max_j, double *enter, double *leave);
+
+Overlay *newOverlay(float *fuel, int64_t width, int64_t height,
+                    float (*base_fuel)(void *context, int64_t i, int64_t j), void *base_context) {
+    Overlay *overlay = new Overlay;
+    overlay->width = width;
+    overlay->height = height;
+    overlay->fuel = fuel;
+    overlay->base_fuel = base_fuel;
+    overlay->base_context = base_context;
+    overlay->bucket_cols = (width + OVERLAY_BUCKET-1) / OVERLAY_BUCKET;
+    int64_t bucket_rows = (height + OVERLAY_BUCKET-1) / OVERLAY_BUCKET;
+    overlay->buckets.resize(overlay->bucket_cols*bucket_rows);
+    overlay->stamp = 0;
+    overlay->bucket_stamps.assign(overlay->buckets.size(), 0);
+    return overlay;
+}
+
+void freeOverlay(Overlay *overlay) {
+    delete overlay;
+}
+
+void setOverlayPlane(Overlay *overlay, float *fuel) {
+    overlay->fuel = fuel;
+}
+
+int64_t addOverlayFeature(Overlay *overlay, const OverlayFeature *feature) {
+    int64_t id = overlay->features.size();
+    overlay->features.push_back(*feature);
+    overlay->boxes.push_back(featureBox(feature, overlay->width, overlay->height));
+    overlay->feature_stamps.push_back(0);
+    fileFeature(overlay, id, true);
+    rasterizeFeature(feature, overlay->width, overlay->height, &overlay->changed);
+    fillSpans(overlay, overlay->changed, feature->fuel);
+    return id;
+}
+
+void setOverlayFeature(Overlay *overlay, int64_t id, const OverlayFeature *feature) {
+    std::vector<OverlaySpan> &dirty = overlay->changed;
+    std::vector<OverlaySpan> spans;
+    rasterizeFeature(&overlay->features[id], overlay->width, overlay->height, &dirty);
+    rasterizeFeature(feature, overlay->width, overlay->height, &spans);
+    dirty.insert(dirty.end(), spans.begin(), spans.end());
+    normalizeSpans(&dirty);
+
+    fileFeature(overlay, id, false);
+    overlay->features[id] = *feature;
+    overlay->boxes[id] = featureBox(feature, overlay->width, overlay->height);
+    fileFeature(overlay, id, true);
+
+    for (const OverlaySpan &span : dirty) {
+        float *row = overlay->fuel + span.i*overlay->width;
+        for (int64_t j = span.first_j; j < span.end_j; j++)
+            row[j] = overlay->base_fuel(overlay->base_context, span.i, j);
+    }
+    redrawSpans(overlay, dirty);
+}
+
+void removeOverlayFeature(Overlay *overlay, int64_t id) {
+    OverlayFeature removed = {overlay->features[id].kind, 0, 0, {}};
+    setOverlayFeature(overlay, id, &removed);
+}
+
+void rasterizeFeature(const OverlayFeature *feature, int64_t width, int64_t height, std::vector<OverlaySpan> *spans) {
+    OverlayBox window = {0, height-1, 0, width-1};
+    rasterizeWindow(feature, width, height, &window, spans);
+    normalizeSpans(spans);
+}
+
+// The spans of the rows of window, as rasterizing the whole feature would give
+// them but unsorted and possibly overlapping. Parts of a line that cannot
+// reach the window's columns are left out, so spans outside them may be
+// missing and the caller clips to the window.
+static void rasterizeWindow(const OverlayFeature *feature, int64_t width, int64_t height, const OverlayBox *window,
+                            std::vector<OverlaySpan> *spans) {
+    spans->clear();
+    const std::vector<OverlayPoint> &points = feature->points;
+    int64_t first_row = window->min_i, last_row = window->max_i;
+    if (points.empty() || first_row > last_row || !featureFinite(feature))
+        return;
+    if (feature->kind == OVERLAY_POLYGON) {
+        addPolygon(points.data(), points.size(), width, first_row, last_row, spans);
+    } else {
+        double half = feature->width / 2;
+        for (size_t k = 0; k < points.size(); k++) {
+            const OverlayPoint *p = &points[k];
+            const OverlayPoint *q = &points[k+1 < points.size() ? k+1 : k];
+            // Nothing of the segment or its end squares reaches the window
+            double enter, leave;
+            if (!clipSegment(p, q, first_row - half - 1, last_row + half + 2, window->min_j - half - 1,
+                             window->max_j + half + 2, &enter, &leave))
+                continue;
+            if (k+1 < points.size())
+                addCenterLine(p, &points[k+1], width, height, first_row, last_row, spans);
+            else if (points.size() == 1)
+                addCenterLine(p, p, width, height, first_row, last_row, spans);
+            if (half <= 0.5)
+                continue;
+            // A square on each point joins the segments' rectangles
+            OverlayPoint square[4] = {{p->i - half, p->j - half}, {p->i - half, p->j + half},
+                                      {p->i + half, p->j + half}, {p->i + half, p->j - half}};
+            addPolygon(square, 4, width, first_row, last_row, spans);
+            if (k+1 == points.size())
+                continue;
+            double di = q->i - p->i, dj = q->j - p->j;
+            double length = sqrt(di*di + dj*dj);
+            if (length == 0)
+                continue;
+            double ni = -dj / length * half, nj = di / length * half;
+            OverlayPoint band[4] = {{p->i + ni, p->j + nj}, {q->i + ni, q->j + nj},
+                                    {q->i - ni, q->j - nj}, {p->i - ni, p->j - nj}};
+            addPolygon(band, 4, width, first_row, last_row, spans);
+        }
+    }
+}
+
+bool readOverlayFeatures(FILE *file, std::vector<OverlayFeature> *features) {
+    char *line = NULL;
+    size_t capacity = 0;
+    bool ok = true;
+    while (getline(&line, &capacity, file) >= 0) {
+        std::string text = line;
+        size_t comment = text.find('#');
+        if (comment != std::string::npos)
+            text.resize(comment);
+        std::istringstream words(text);
+        std::string kind;
+        if (!(words >> kind))
+            continue;
+        OverlayFeature feature = {OVERLAY_LINE, 0, 0, {}};
+        if (kind == "line") {
+            ok = words >> feature.width >> feature.fuel && isFinite(feature.width);
+        } else if (kind == "polygon") {
+            feature.kind = OVERLAY_POLYGON;
+            ok = (bool) (words >> feature.fuel);
+        } else {
+            ok = false;
+        }
+        ok = ok && isFinite(feature.fuel);
+        std::string point;
+        while (ok && words >> point) {
+            OverlayPoint p;
+            char comma;
+            std::istringstream coordinates(point);
+            ok = coordinates >> p.i >> comma >> p.j && comma == ',' && isFinite(p.i) && isFinite(p.j);
+            feature.points.push_back(p);
+        }
+        if (!ok || feature.points.empty()) {
+            ok = false;
+            break;
+        }
+        features->push_back(feature);
+    }
+    free(line);
+    return ok;
+}
+
+// Every tile any part of the feature can cover, clipped to the grid; empty
+// (min past max) for a feature that covers nothing
+static OverlayBox featureBox(const OverlayFeature *feature, int64_t width, int64_t height) {
+    OverlayBox box = {height, -1, width, -1};
+    if (!featureFinite(feature))
+        return box;
+    double reach = feature->kind == OVERLAY_LINE ? feature->width/2 + 1 : 1;
+    for (const OverlayPoint &p : feature->points) {
+        box.min_i = std::min(box.min_i, clampTile(floor(p.i - reach), 0, height));
+        box.max_i = std::max(box.max_i, clampTile(ceil(p.i + reach), -1, height-1));
+        box.min_j = std::min(box.min_j, clampTile(floor(p.j - reach), 0, width));
+        box.max_j = std::max(box.max_j, clampTile(ceil(p.j + reach), -1, width-1));
+    }
+    return box;
+}
+
+// The boxes the feature is filed under: one for an area, one per segment of
+// a line, each clipped to the grid and left out if nothing of it is inside
+static void featurePieces(const OverlayFeature *feature, int64_t width, int64_t height, std::vector<OverlayBox> *pieces) {
+    pieces->clear();
+    const std::vector<OverlayPoint> &points = feature->points;
+    if (points.empty() || !featureFinite(feature))
+        return;
+    if (feature->kind == OVERLAY_POLYGON) {
+        pieces->push_back(featureBox(feature, width, height));
+    } else {
+        double reach = feature->width/2 + 1;
+        for (size_t k = 0; k == 0 || k+1 < points.size(); k++) {
+            const OverlayPoint *p = &points[k], *q = &points[k+1 < points.size() ? k+1 : k];
+            pieces->push_back({clampTile(floor(std::min(p->i, q->i) - reach), 0, height),
+                               clampTile(ceil(std::max(p->i, q->i) + reach), -1, height-1),
+                               clampTile(floor(std::min(p->j, q->j) - reach), 0, width),
+                               clampTile(ceil(std::max(p->j, q->j) + reach), -1, width-1)});
+        }
+    }
+    pieces->erase(std::remove_if(pieces->begin(), pieces->end(), [](const OverlayBox &box) {
+        return box.min_i > box.max_i || box.min_j > box.max_j;
+    }), pieces->end());
+}
+
+// Files feature id under its buckets, or takes it out of them.
+static void fileFeature(Overlay *overlay, int64_t id, bool add) {
+    std::vector<OverlayBox> pieces;
+    featurePieces(&overlay->features[id], overlay->width, overlay->height, &pieces);
+    for (const OverlayBox &piece : pieces) {
+        for (int64_t bi = piece.min_i / OVERLAY_BUCKET; bi <= piece.max_i / OVERLAY_BUCKET; bi++) {
+            for (int64_t bj = piece.min_j / OVERLAY_BUCKET; bj <= piece.max_j / OVERLAY_BUCKET; bj++) {
+                std::vector<int64_t> &bucket = overlay->buckets[bi*overlay->bucket_cols + bj];
+                // Pieces of one feature that share a bucket file it once
+                if (add && (bucket.empty() || bucket.back() != id)) {
+                    bucket.push_back(id);
+                } else if (!add) {
+                    auto found = std::find(bucket.begin(), bucket.end(), id);
+                    if (found != bucket.end())
+                        bucket.erase(found);
+                }
+            }
+        }
+    }
+}
+
+// Draws the features into dirty, which has just gone back to the base fuel.
+// Dirty rows are taken in runs of up to OVERLAY_REDRAW_ROWS adjacent rows, so
+// a feature moved across the grid redraws around its old and new places and
+// not everything between. Each run gathers the features filed under the
+// buckets its spans touch and rasterizes each, in id order, inside the run's
+// bounds, where only the segments of a line that pass near them are drawn.
+static void redrawSpans(Overlay *overlay, const std::vector<OverlaySpan> &dirty) {
+    std::vector<int64_t> found;
+    std::vector<OverlaySpan> run, spans;
+    std::vector<size_t> row_starts;
+    for (size_t first = 0; first < dirty.size(); ) {
+        size_t end = first + 1;
+        while (end < dirty.size() && dirty[end].i <= dirty[end-1].i + 1
+               && dirty[end].i < dirty[first].i + OVERLAY_REDRAW_ROWS)
+            end++;
+        run.assign(dirty.begin() + first, dirty.begin() + end);
+        first = end;
+        // The run's spans of row i start at row_starts[i - reach.min_i]
+        OverlayBox reach = {run.front().i, run.back().i, overlay->width, -1};
+        row_starts.assign(reach.max_i - reach.min_i + 2, run.size());
+        for (size_t k = run.size(); k-- > 0; ) {
+            const OverlaySpan &span = run[k];
+            row_starts[span.i - reach.min_i] = k;
+            reach.min_j = std::min(reach.min_j, span.first_j);
+            reach.max_j = std::max(reach.max_j, span.end_j - 1);
+        }
+
+        uint64_t stamp = ++overlay->stamp;
+        found.clear();
+        for (const OverlaySpan &span : run) {
+            int64_t bi = span.i / OVERLAY_BUCKET;
+            for (int64_t bj = span.first_j / OVERLAY_BUCKET; bj <= (span.end_j - 1) / OVERLAY_BUCKET; bj++) {
+                int64_t bucket = bi*overlay->bucket_cols + bj;
+                if (overlay->bucket_stamps[bucket] == stamp)
+                    continue;
+                overlay->bucket_stamps[bucket] = stamp;
+                for (int64_t id : overlay->buckets[bucket]) {
+                    if (overlay->feature_stamps[id] != stamp) {
+                        overlay->feature_stamps[id] = stamp;
+                        found.push_back(id);
+                    }
+                }
+            }
+        }
+        std::sort(found.begin(), found.end());
+        for (int64_t id : found) {
+            const OverlayBox *box = &overlay->boxes[id];
+            OverlayBox window = {std::max(reach.min_i, box->min_i), std::min(reach.max_i, box->max_i),
+                                 std::max(reach.min_j, box->min_j), std::min(reach.max_j, box->max_j)};
+            if (window.min_i > window.max_i || window.min_j > window.max_j)
+                continue;
+            rasterizeWindow(&overlay->features[id], overlay->width, overlay->height, &window, &spans);
+            float fuel = overlay->features[id].fuel;
+            for (const OverlaySpan &span : spans) {
+                float *row = overlay->fuel + span.i*overlay->width;
+                for (size_t k = row_starts[span.i - reach.min_i]; k < run.size() && run[k].i == span.i; k++) {
+                    int64_t first_j = std::max(span.first_j, run[k].first_j);
+                    int64_t end_j = std::min(span.end_j, run[k].end_j);
+                    if (first_j < end_j)
+                        std::fill(row + first_j, row + end_j, fuel);
+                }
+            }
+        }
+    }
+}
+
+static bool featureFinite(const OverlayFeature *feature) {
+    if (feature->kind == OVERLAY_LINE && !isFinite(feature->width))
+        return false;
+    for (const OverlayPoint &p : feature->points) {
+        if (!isFinite(p.i) || !isFinite(p.j))
+            return false;
+    }
+    return true;
+}
+
+// By the bits, since -Ofast lets the compiler assume std::isfinite is true
+static bool isFinite(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 52 & 0x7ff) != 0x7ff;
+}
+
+// Rounds a tile coordinate already floored or ceiled into [low, high] before
+// converting, since a far-off point would not fit an int64_t
+static int64_t clampTile(double at, int64_t low, int64_t high) {
+    if (at <= low)
+        return low;
+    if (at >= high)
+        return high;
+    return (int64_t) at;
+}
+
+static void fillSpans(Overlay *overlay, const std::vector<OverlaySpan> &spans, float fuel) {
+    for (const OverlaySpan &span : spans) {
+        float *row = overlay->fuel + span.i*overlay->width;
+        std::fill(row + span.first_j, row + span.end_j, fuel);
+    }
+}
+
+static void normalizeSpans(std::vector<OverlaySpan> *spans) {
+    std::sort(spans->begin(), spans->end(), [](const OverlaySpan &a, const OverlaySpan &b) {
+        return a.i != b.i ? a.i < b.i : a.first_j < b.first_j;
+    });
+    size_t kept = 0;
+    for (size_t k = 0; k < spans->size(); k++) {
+        OverlaySpan &span = (*spans)[k];
+        if (kept > 0 && (*spans)[kept-1].i == span.i && span.first_j <= (*spans)[kept-1].end_j)
+            (*spans)[kept-1].end_j = std::max((*spans)[kept-1].end_j, span.end_j);
+        else
+            (*spans)[kept++] = span;
+    }
+    spans->resize(kept);
+}
+
+// Bresenham between the tiles holding the two points, one axis at a time as
+// in drawFirebreak, keeping the tiles in rows first_row to last_row. The
+// segment is first clipped to a tile around the grid, so the walk never
+// leaves it by more than a step however far off the points are.
+static void addCenterLine(const OverlayPoint *from, const OverlayPoint *to, int64_t width, int64_t height,
+                          int64_t first_row, int64_t last_row, std::vector<OverlaySpan> *spans) {
+    double di_real = to->i - from->i, dj_real = to->j - from->j;
+    double enter, leave;
+    if (!clipSegment(from, to, -1, height + 1, -1, width + 1, &enter, &leave))
+        return;
+    int64_t i = floor(from->i + enter*di_real), j = floor(from->j + enter*dj_real);
+    int64_t i1 = floor(from->i + leave*di_real), j1 = floor(from->j + leave*dj_real);
+    int64_t di = llabs(i1 - i), dj = llabs(j1 - j);
+    int64_t si = i < i1 ? 1 : -1, sj = j < j1 ? 1 : -1;
+    int64_t err = dj - di;
+    while (true) {
+        if (i >= first_row && i <= last_row && i < height && j >= 0 && j < width)
+            spans->push_back({i, j, j+1});
+        if (i == i1 && j == j1)
+            break;
+        if (2*err > -di && j != j1) {
+            err -= di;
+            j += sj;
+        } else {
+            err += dj;
+            i += si;
+        }
+    }
+}
+
+// Scanline fill of the tiles whose centers are inside, even-odd. Edges are
+// taken in order of their first row and dropped after their last, so each
+// row only looks at the edges that cross it.
+static void addPolygon(const OverlayPoint *points, int64_t count, int64_t width, int64_t first_row,
+                       int64_t last_row, std::vector<OverlaySpan> *spans) {
+    typedef struct Edge
+    {
+        int64_t first_row;
+        int64_t last_row;
+        double from_i;
+        double from_j;
+        double slope;
+    } Edge;
+    std::vector<Edge> edges;
+    for (int64_t k = 0; k < count; k++) {
+        const OverlayPoint *p = &points[k], *q = &points[(k+1) % count];
+        if (p->i == q->i)
+            continue;
+        if (p->i > q->i)
+            std::swap(p, q);
+        // Rows whose center line i + 0.5 lies in [p->i, q->i), of those asked for
+        int64_t edge_first = clampTile(ceil(p->i - 0.5), first_row, last_row + 1);
+        int64_t edge_last = clampTile(ceil(q->i - 0.5) - 1, first_row - 1, last_row);
+        if (edge_first > edge_last)
+            continue;
+        double slope = (q->j - p->j) / (q->i - p->i);
+        edges.push_back({edge_first, edge_last, p->i, p->j, slope});
+    }
+    if (edges.empty())
+        return;
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.first_row < b.first_row; });
+
+    std::vector<const Edge *> active;
+    std::vector<double> crossings;
+    size_t next = 0;
+    for (int64_t row = edges[0].first_row; next < edges.size() || !active.empty(); row++) {
+        while (next < edges.size() && edges[next].first_row == row)
+            active.push_back(&edges[next++]);
+        active.erase(std::remove_if(active.begin(), active.end(), [row](const Edge *edge) {
+            return edge->last_row < row;
+        }), active.end());
+        if (active.empty()) {
+            if (next < edges.size())
+                row = edges[next].first_row - 1;
+            continue;
+        }
+        crossings.clear();
+        for (const Edge *edge : active)
+            // From the edge's end rather than the window's first row, so
+            // any window gives the same crossings
+            crossings.push_back(edge->from_j + (row + 0.5 - edge->from_i)*edge->slope);
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t c = 0; c+1 < crossings.size(); c += 2) {
+            // Tiles whose center j + 0.5 lies in [crossings[c], crossings[c+1])
+            int64_t first_j = clampTile(ceil(crossings[c] - 0.5), 0, width);
+            int64_t end_j = clampTile(ceil(crossings[c+1] - 0.5), 0, width);
+            if (first_j < end_j)
+                spans->push_back({row, first_j, end_j});
+        }
+    }
+}
+
+// Liang-Barsky: the part of the segment from + t*(to - from) inside
+// [min_i, max_i] x [min_j, max_j] is t in [enter, leave]. False if none is.
+static bool clipSegment(const OverlayPoint *from, const OverlayPoint *to, double min_i, double max_i, double min_j,
+                        double max_j, double *enter, double *leave) {
+    double di = to->i - from->i, dj = to->j - from->j;
+    double toward[4] = {-di, di, -dj, dj};
+    double room[4] = {from->i - min_i, max_i - from->i, from->j - min_j, max_j - from->j};
+    *enter = 0;
+    *leave = 1;
+    for (int side = 0; side < 4; side++) {
+        if (toward[side] == 0) {
+            if (room[side] < 0)
+                return false;
+            continue;
+        }
+        double at = room[side] / toward[side];
+        if (toward[side] < 0)
+            *enter = std::max(*enter, at);
+        else
+            *leave = std::min(*leave, at);
+    }
+    return *enter <= *leave;
+}
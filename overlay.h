@@ -0,0 +1,109 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+enum {
+    OVERLAY_LINE = 0,
+    OVERLAY_POLYGON = 1
+};
+
+// Points are in tiles: tile (i, j) covers [i, i+1) x [j, j+1).
+typedef struct OverlayPoint
+{
+    double i;
+    double j;
+} OverlayPoint;
+
+// A road, river or dozer line (a polyline width tiles wide), or an area (a
+// polygon, even-odd filled), that sets the fuel of the tiles it covers. The
+// center line of a line is always drawn 4-connected, so however thin and
+// whatever its angle, fire cannot slip through it diagonally.
+typedef struct OverlayFeature
+{
+    int kind;
+    float width;
+    float fuel;
+    std::vector<OverlayPoint> points;
+} OverlayFeature;
+
+// Tiles (i, first_j) to (i, end_j-1)
+typedef struct OverlaySpan
+{
+    int64_t i;
+    int64_t first_j;
+    int64_t end_j;
+} OverlaySpan;
+
+typedef struct OverlayBox
+{
+    int64_t min_i;
+    int64_t max_i;
+    int64_t min_j;
+    int64_t max_j;
+} OverlayBox;
+
+// Side in tiles of the buckets an overlay files its features under
+#define OVERLAY_BUCKET 64
+
+// Features burned into a fuel plane (width x height floats, row by row, like
+// the landscape's fuel rows or a band's owned rows). A band's rows move to the
+// other buffer every step, so an overlay on a band must be pointed at the
+// current ones with setOverlayPlane before each edit. Features are kept as
+// vectors and rasterized again when needed, so memory goes with their points
+// and not with the tiles they cover. Where features overlap the later one
+// wins. Editing a feature only touches its old and new footprints: they go
+// back to the base fuel and the features filed under the buckets they cover
+// are drawn into them again, in order, rasterizing only the rows they span.
+// Features with coordinates or a width that are not finite cover nothing.
+typedef struct Overlay
+{
+    int64_t width;
+    int64_t height;
+    float *fuel;
+    // Fuel without features, with the SparseFuel signature (fuelNoiseAt
+    // for a landscape)
+    float (*base_fuel)(void *context, int64_t i, int64_t j);
+    void *base_context;
+    // Indexed by feature id; removed features have no points
+    std::vector<OverlayFeature> features;
+    std::vector<OverlayBox> boxes;
+    // Feature ids by bucket of OVERLAY_BUCKET x OVERLAY_BUCKET tiles, row by
+    // row. A line is filed under the buckets each segment's box meets, not
+    // every bucket its whole box does, so a long diagonal road stays cheap.
+    int64_t bucket_cols;
+    std::vector<std::vector<int64_t>> buckets;
+    // Stamps for gathering each feature and bucket once per redraw
+    uint64_t stamp;
+    std::vector<uint64_t> feature_stamps;
+    std::vector<uint64_t> bucket_stamps;
+    // Tiles the last add, edit or remove may have changed, for callers that
+    // mirror the plane elsewhere (a Vertex grid, the LOD pyramid)
+    std::vector<OverlaySpan> changed;
+} Overlay;
+
+Overlay *newOverlay(float *fuel, int64_t width, int64_t height,
+                    float (*base_fuel)(void *context, int64_t i, int64_t j), void *base_context);
+void freeOverlay(Overlay *overlay);
+// Points the overlay at fuel, a plane holding what the old one did, such as
+// bandRow(band->fuel, band, 1) after stepBand has swapped the buffers.
+void setOverlayPlane(Overlay *overlay, float *fuel);
+// Draws a feature over everything so far and returns its id.
+int64_t addOverlayFeature(Overlay *overlay, const OverlayFeature *feature);
+void setOverlayFeature(Overlay *overlay, int64_t id, const OverlayFeature *feature);
+void removeOverlayFeature(Overlay *overlay, int64_t id);
+
+// The tiles a feature covers inside a width x height grid, sorted by row then
+// column, without overlaps.
+void rasterizeFeature(const OverlayFeature *feature, int64_t width, int64_t height, std::vector<OverlaySpan> *spans);
+
+// Reads features, one a line, '#' starting a comment:
+//   line <width> <fuel> <i>,<j> <i>,<j> ...
+//   polygon <fuel> <i>,<j> <i>,<j> ...
+// Returns false at the first line that is neither or has a number that is not
+// finite, leaving the features read before it in features.
+bool readOverlayFeatures(FILE *file, std::vector<OverlayFeature> *features);
+
+#endif
@@ -0,0 +1,62 @@
+#include "palette.h"
+
+typedef struct ColorStop
+{
+    float at;
+    uint8_t rgb[3];
+} ColorStop;
+
+static void fillRamp(uint8_t *rgb, const ColorStop *stops, int count);
+
+const Palette palettes[PALETTE_COUNT] = {
+    {"fire", STATE_INTENSITY, PALETTE_FUEL},
+    {"fuel", STATE_FUEL, -1},
+    {"intensity", STATE_INTENSITY, -1},
+    {"arrival", STATE_ARRIVAL, PALETTE_FUEL},
+    {"burned", STATE_BURNED, -1}
+};
+
+// Colors at points from 0 to 1 along each palette, linear in between
+static const ColorStop fire_stops[] = {
+    {0.f, {96, 0, 0}}, {0.5f, {255, 64, 0}}, {1.f, {255, 255, 160}}
+};
+static const ColorStop fuel_stops[] = {
+    {0.f, {30, 20, 15}}, {0.5f, {60, 110, 30}}, {1.f, {40, 220, 60}}
+};
+static const ColorStop intensity_stops[] = {
+    {0.f, {0, 0, 0}}, {0.3f, {140, 0, 0}}, {0.7f, {255, 140, 0}}, {1.f, {255, 255, 200}}
+};
+static const ColorStop arrival_stops[] = {
+    {0.f, {50, 50, 50}}, {0.004f, {60, 20, 150}}, {0.5f, {30, 160, 150}}, {1.f, {250, 230, 30}}
+};
+static const ColorStop burned_stops[] = {
+    {0.f, {0, 0, 0}}, {0.35f, {110, 30, 130}}, {0.7f, {240, 100, 60}}, {1.f, {255, 250, 190}}
+};
+
+#define STOPS(stops) stops, sizeof(stops)/sizeof(ColorStop)
+
+void fillPalettes(uint8_t *rgb) {
+    fillRamp(rgb + 3*PALETTE_SIZE*PALETTE_FIRE, STOPS(fire_stops));
+    fillRamp(rgb + 3*PALETTE_SIZE*PALETTE_FUEL, STOPS(fuel_stops));
+    fillRamp(rgb + 3*PALETTE_SIZE*PALETTE_INTENSITY, STOPS(intensity_stops));
+    fillRamp(rgb + 3*PALETTE_SIZE*PALETTE_ARRIVAL, STOPS(arrival_stops));
+    fillRamp(rgb + 3*PALETTE_SIZE*PALETTE_BURNED, STOPS(burned_stops));
+}
+
+static void fillRamp(uint8_t *rgb, const ColorStop *stops, int count) {
+    int stop = 0;
+    for (int k = 0; k < PALETTE_SIZE; k++) {
+        float at = k / (PALETTE_SIZE - 1.f);
+        while (stop < count - 2 && at > stops[stop+1].at)
+            stop++;
+        const ColorStop *a = &stops[stop];
+        const ColorStop *b = &stops[stop+1];
+        float t = (at - a->at) / (b->at - a->at);
+        if (t < 0)
+            t = 0;
+        if (t > 1)
+            t = 1;
+        for (int c = 0; c < 3; c++)
+            rgb[3*k + c] = (uint8_t) (a->rgb[c] + (b->rgb[c] - a->rgb[c])*t + 0.5f);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+// Entries per palette, one per value a state byte can take
+#define PALETTE_SIZE 256
+
+// Channels of the per-pixel state renderLod writes, one byte each
+enum {
+    STATE_INTENSITY = 0,
+    STATE_FUEL = 1,
+    STATE_ARRIVAL = 2,
+    STATE_BURNED = 3
+};
+
+// STATE_BURNED is the fraction of the tiles under a pixel this run has burned,
+// not a probability over runs. STATE_ARRIVAL is 0 where the fire has not been and 1-254 from the first
+// arrival to the latest; 255 marks pixels off the grid.
+#define STATE_ARRIVAL_OFF_GRID 255
+
+enum {
+    PALETTE_FIRE = 0,
+    PALETTE_FUEL = 1,
+    PALETTE_INTENSITY = 2,
+    PALETTE_ARRIVAL = 3,
+    PALETTE_BURNED = 4,
+    PALETTE_COUNT = 5
+};
+
+// A palette colors one state channel. Where that channel is 0 the palette
+// under it shows through instead, if it has one (-1 if not).
+typedef struct Palette
+{
+    const char *name;
+    int channel;
+    int under;
+} Palette;
+
+extern const Palette palettes[PALETTE_COUNT];
+
+// PALETTE_COUNT rows of PALETTE_SIZE RGB bytes, row p for palette p, for
+// uploading once as a texture the shader looks colors up in.
+void fillPalettes(uint8_t *rgb);
+
+#endif
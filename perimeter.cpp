@@ -0,0 +1,233 @@
+#include "perimeter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static PerimeterBlock *findPerimeterBlock(Perimeter *perimeter, int64_t ci, int64_t cj, bool create);
+static uint8_t squareCase(const SparseGrid *sparse, int64_t ci, int64_t cj);
+static bool burnedAt(const SparseGrid *sparse, int64_t i, int64_t j);
+static int segmentEnd(uint8_t square_case, int edge);
+static void writeVarint(FILE *file, int64_t value);
+
+Perimeter *newPerimeter(SparseGrid *sparse) {
+    Perimeter *perimeter = new Perimeter;
+    perimeter->width = sparse->width;
+    perimeter->height = sparse->height;
+    // Squares run one past the last tile on each side
+    perimeter->blocks_wide = (sparse->width + PERIMETER_BLOCK) / PERIMETER_BLOCK;
+    perimeter->next_ring = 0;
+    sparse->burned_log = &perimeter->pending;
+    return perimeter;
+}
+
+void freePerimeter(Perimeter *perimeter, SparseGrid *sparse) {
+    if (sparse->burned_log == &perimeter->pending)
+        sparse->burned_log = NULL;
+    for (const auto &entry : perimeter->blocks)
+        free(entry.second);
+    delete perimeter;
+}
+
+static PerimeterBlock *findPerimeterBlock(Perimeter *perimeter, int64_t ci, int64_t cj, bool create) {
+    int64_t key = (ci / PERIMETER_BLOCK)*perimeter->blocks_wide + cj / PERIMETER_BLOCK;
+    auto found = perimeter->blocks.find(key);
+    if (found != perimeter->blocks.end())
+        return found->second;
+    if (!create)
+        return NULL;
+    PerimeterBlock *block = (PerimeterBlock *) malloc(sizeof(PerimeterBlock));
+    memset(block->cases, 0, sizeof(block->cases));
+    memset(block->ring, 0xff, sizeof(block->ring));
+    perimeter->blocks[key] = block;
+    return block;
+}
+
+// Square (ci, cj) has tiles (ci-1, cj-1), (ci-1, cj), (ci, cj), (ci, cj-1) at
+// its corners, bits 1, 2, 4 and 8 of its case, going counterclockwise. Edge k
+// runs from corner k to corner k+1.
+static uint8_t squareCase(const SparseGrid *sparse, int64_t ci, int64_t cj) {
+    return burnedAt(sparse, ci-1, cj-1)
+        | burnedAt(sparse, ci-1, cj) << 1
+        | burnedAt(sparse, ci, cj) << 2
+        | burnedAt(sparse, ci, cj-1) << 3;
+}
+
+static bool burnedAt(const SparseGrid *sparse, int64_t i, int64_t j) {
+    if (i < 0 || i >= sparse->height || j < 0 || j >= sparse->width)
+        return false;
+    return sparseBurned(sparse, i, j);
+}
+
+// The edge the segment starting on edge ends on, or -1 if none starts there.
+// A segment starts where the burned area leaves the square, across an edge
+// from a burned corner to an unburned one, and runs back to where it came in,
+// which keeps diagonal corners apart.
+static int segmentEnd(uint8_t square_case, int edge) {
+    if (!(square_case >> edge & 1) || (square_case >> ((edge+1)%4) & 1))
+        return -1;
+    for (int back = 1; back < 4; back++) {
+        int e = (edge + 4 - back) % 4;
+        if (!(square_case >> e & 1) && (square_case >> ((e+1)%4) & 1))
+            return e;
+    }
+    return -1;
+}
+
+int64_t updatePerimeter(Perimeter *perimeter, const SparseGrid *sparse) {
+    int64_t width = perimeter->width;
+    // Swap the segments of every square whose case changed. A segment ends on
+    // the edge the next one starts on, so a ring that gains a segment has also
+    // lost one, and marking the rings that lose segments covers both. A
+    // square shared by several new tiles is unchanged by the time it comes
+    // round again.
+    int64_t recased = 0;
+    for (int64_t tile : perimeter->pending) {
+        int64_t i = tile / width;
+        int64_t j = tile % width;
+        for (int64_t ci = i; ci <= i+1; ci++) {
+            for (int64_t cj = j; cj <= j+1; cj++) {
+                uint8_t new_case = squareCase(sparse, ci, cj);
+                // Squares all inside have no segments and need no block
+                PerimeterBlock *block = findPerimeterBlock(perimeter, ci, cj, new_case != 15);
+                if (block == NULL)
+                    continue;
+                int t = (ci % PERIMETER_BLOCK)*PERIMETER_BLOCK + cj % PERIMETER_BLOCK;
+                uint8_t old_case = block->cases[t];
+                if (old_case == new_case)
+                    continue;
+                recased++;
+                int64_t square = ci*(width+1) + cj;
+                for (int k = 0; k < 4; k++) {
+                    if (block->ring[t][k] != -1)
+                        perimeter->dirty.insert(block->ring[t][k]);
+                    block->ring[t][k] = -1;
+                    if (segmentEnd(new_case, k) != -1)
+                        perimeter->starts.push_back(square*4 + k);
+                }
+                block->cases[t] = new_case;
+            }
+        }
+    }
+    perimeter->pending.clear();
+    return recased;
+}
+
+void tracePerimeter(Perimeter *perimeter) {
+    int64_t width = perimeter->width;
+    // Segments of a changed ring that are still there are walked again, into
+    // whatever rings they are on now
+    for (int64_t id : perimeter->dirty) {
+        for (int64_t segment : perimeter->rings[id].segments) {
+            int64_t ci = segment / 4 / (width+1);
+            int64_t cj = segment / 4 % (width+1);
+            PerimeterBlock *block = findPerimeterBlock(perimeter, ci, cj, false);
+            int t = (ci % PERIMETER_BLOCK)*PERIMETER_BLOCK + cj % PERIMETER_BLOCK;
+            if (block->ring[t][segment % 4] == id) {
+                block->ring[t][segment % 4] = -1;
+                perimeter->starts.push_back(segment);
+            }
+        }
+        perimeter->rings.erase(id);
+    }
+    perimeter->dirty.clear();
+
+    // The square across each edge, where the next segment starts on the
+    // opposite edge
+    const int64_t across_i[4] = {-1, 0, 1, 0};
+    const int64_t across_j[4] = {0, 1, 0, -1};
+    // Crossing point on each edge, relative to (2*cj, 2*ci)
+    const int64_t edge_x[4] = {-1, 0, -1, -2};
+    const int64_t edge_y[4] = {-2, -1, 0, -1};
+    std::vector<int64_t> corners;
+    for (int64_t start : perimeter->starts) {
+        int64_t ci = start / 4 / (width+1);
+        int64_t cj = start / 4 % (width+1);
+        int k = start % 4;
+        PerimeterBlock *block = findPerimeterBlock(perimeter, ci, cj, false);
+        int t = (ci % PERIMETER_BLOCK)*PERIMETER_BLOCK + cj % PERIMETER_BLOCK;
+        if (block == NULL || block->ring[t][k] != -1 || segmentEnd(block->cases[t], k) == -1)
+            continue;
+        int32_t id = perimeter->next_ring++;
+        PerimeterRing *ring = &perimeter->rings[id];
+        corners.clear();
+        int64_t segment = start;
+        do {
+            block->ring[t][k] = id;
+            ring->segments.push_back(segment);
+            corners.push_back(2*cj + edge_x[k]);
+            corners.push_back(2*ci + edge_y[k]);
+            int end = segmentEnd(block->cases[t], k);
+            int64_t next_i = ci + across_i[end];
+            int64_t next_j = cj + across_j[end];
+            if (next_i / PERIMETER_BLOCK != ci / PERIMETER_BLOCK || next_j / PERIMETER_BLOCK != cj / PERIMETER_BLOCK)
+                block = findPerimeterBlock(perimeter, next_i, next_j, false);
+            ci = next_i;
+            cj = next_j;
+            k = (end + 2) % 4;
+            t = (ci % PERIMETER_BLOCK)*PERIMETER_BLOCK + cj % PERIMETER_BLOCK;
+            segment = (ci*(width+1) + cj)*4 + k;
+        } while (segment != start);
+
+        int64_t count = corners.size()/2;
+        for (int64_t p = 0; p < count; p++) {
+            int64_t prev = (p + count - 1) % count;
+            int64_t after = (p + 1) % count;
+            int64_t dx0 = corners[2*p] - corners[2*prev], dy0 = corners[2*p+1] - corners[2*prev+1];
+            int64_t dx1 = corners[2*after] - corners[2*p], dy1 = corners[2*after+1] - corners[2*p+1];
+            if (dx0*dy1 - dy0*dx1 == 0)
+                continue;
+            ring->points.push_back(corners[2*p]);
+            ring->points.push_back(corners[2*p+1]);
+        }
+    }
+    perimeter->starts.clear();
+}
+
+void writePerimeterJson(Perimeter *perimeter, int step, FILE *file) {
+    tracePerimeter(perimeter);
+    fprintf(file, "{\"type\":\"Feature\",\"properties\":{\"step\":%d},"
+            "\"geometry\":{\"type\":\"MultiLineString\",\"coordinates\":[", step);
+    bool first = true;
+    for (const auto &entry : perimeter->rings) {
+        const std::vector<int64_t> &points = entry.second.points;
+        fprintf(file, first ? "[" : ",[");
+        first = false;
+        for (size_t p = 0; p <= points.size(); p += 2) {
+            size_t at = p % points.size();
+            // Halves are exact in a double, and %.1f prints them exactly
+            // at any size where %g would round or switch to exponents
+            fprintf(file, "%s[%.1f,%.1f]", p ? "," : "", points[at]/2.0, points[at+1]/2.0);
+        }
+        fprintf(file, "]");
+    }
+    fprintf(file, "]}}\n");
+}
+
+void writePerimeterBinary(Perimeter *perimeter, int step, FILE *file) {
+    tracePerimeter(perimeter);
+    uint32_t header[2] = {(uint32_t) step, (uint32_t) perimeter->rings.size()};
+    fwrite("FPER", 1, 4, file);
+    fwrite(header, sizeof(uint32_t), 2, file);
+    for (const auto &entry : perimeter->rings) {
+        const std::vector<int64_t> &points = entry.second.points;
+        writeVarint(file, points.size()/2);
+        int64_t x = 0, y = 0;
+        for (size_t p = 0; p < points.size(); p += 2) {
+            writeVarint(file, points[p] - x);
+            writeVarint(file, points[p+1] - y);
+            x = points[p];
+            y = points[p+1];
+        }
+    }
+}
+
+static void writeVarint(FILE *file, int64_t value) {
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    do {
+        uint8_t byte = zigzag & 0x7f;
+        zigzag >>= 7;
+        if (zigzag)
+            byte |= 0x80;
+        fputc(byte, file);
+    } while (zigzag);
+}
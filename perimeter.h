@@ -0,0 +1,78 @@
+#ifndef PERIMETER_H
+#define PERIMETER_H
+
+#include "sparse.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Squares per side of a block of cases
+#define PERIMETER_BLOCK 64
+
+typedef struct PerimeterRing
+{
+    // Every segment of the ring in order, as square*4 + the edge it leaves by
+    std::vector<int64_t> segments;
+    // The corners only, as x, y pairs, first point not repeated
+    std::vector<int64_t> points;
+} PerimeterRing;
+
+// Cases of a block of squares, allocated once the edge reaches it, and the
+// ring each square's segments are on by the edge they leave by (-1 until
+// walked). A segment ends on an edge shared with the next square, so rings are
+// walked from square to square without looking segments up.
+typedef struct PerimeterBlock
+{
+    uint8_t cases[PERIMETER_BLOCK*PERIMETER_BLOCK];
+    int32_t ring[PERIMETER_BLOCK*PERIMETER_BLOCK][4];
+} PerimeterBlock;
+
+// The edge of the burned area as closed rings, by marching squares over the
+// burned mask of a SparseGrid. The squares have tile centers at their corners,
+// with tiles off the grid unburned so every ring closes. Diagonal neighbors
+// are kept apart, as in the perimeter of FireStats. Rings run with the burned
+// side on their left, so with y pointing up outer edges go counterclockwise
+// and holes clockwise.
+//
+// Points are in half-tile units: tile (i, j) has its center at x = 2*j,
+// y = 2*i, and ring points lie halfway between tile centers. Points where a
+// ring goes straight on are left out.
+typedef struct Perimeter
+{
+    int64_t width;
+    int64_t height;
+    int64_t blocks_wide;
+    std::unordered_map<int64_t, PerimeterBlock *> blocks;
+    std::unordered_map<int64_t, PerimeterRing> rings;
+    int32_t next_ring;
+    // Rings that lost segments and new segments, waiting for tracePerimeter
+    std::unordered_set<int64_t> dirty;
+    std::vector<int64_t> starts;
+    // Tiles burned since the last update, appended by the grid
+    std::vector<int64_t> pending;
+} Perimeter;
+
+// Starts an empty perimeter and has the grid log burned tiles into it. Only
+// tiles that burn after this call are seen, so attach before igniting.
+Perimeter *newPerimeter(SparseGrid *sparse);
+// Detaches from the grid.
+void freePerimeter(Perimeter *perimeter, SparseGrid *sparse);
+// Re-cases only the squares around tiles burned since the last update and
+// swaps their segments. Returns the number of squares re-cased. Cheap enough
+// to call every step, which keeps pending short.
+int64_t updatePerimeter(Perimeter *perimeter, const SparseGrid *sparse);
+// Walks the rings that changed since the last trace; the others are kept as
+// they were. The writers trace first.
+void tracePerimeter(Perimeter *perimeter);
+
+// One GeoJSON Feature per call, a MultiLineString in tile coordinates with
+// each ring closed by repeating its first point.
+void writePerimeterJson(Perimeter *perimeter, int step, FILE *file);
+// "FPER", then step and ring count as little-endian uint32, then per ring its
+// point count followed by the first point and the deltas to each next point,
+// all as zigzag LEB128 varints in half-tile units.
+void writePerimeterBinary(Perimeter *perimeter, int step, FILE *file);
+
+#endif
@@ -0,0 +1,432 @@
+// Python bindings for the synchronous engine, built by make python as the
+// firesim module:
+//
+//     import firesim, numpy
+//     grid = firesim.Grid(4000, 4000, fuel_seed=1, clump=64)
+//     grid.ignite(2000, 2000)
+//     grid.run(odds=0.2, seed=1)
+//     arrival = numpy.asarray(grid.arrival)
+//
+// Planes are exported through the buffer protocol straight from the engine's
+// memory, so memoryview and numpy.asarray see them without a copy. Stepping
+// releases the GIL.
+//
+// Stepping swaps the engine's buffers and rewrites the planes, so a grid
+// refuses to ignite or step while any view of its planes is alive:
+//
+//     fuel = numpy.asarray(grid.fuel).copy()   # or del the view when done
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include "arrival.h"
+#include "ensemble.h"
+#include "landscape.h"
+#include "sim.h"
+
+#include <stdlib.h>
+
+// A whole grid as one band, with the arrival of every tile recorded
+typedef struct PyGrid
+{
+    PyObject_HEAD
+    SimBand *band;
+    ArrivalRaster *arrival;
+    int steps;
+    // Set while a call runs without the GIL, so a second thread cannot step
+    // the same grid at the same time
+    bool busy;
+    // Buffers taken of the grid's planes and not yet released
+    int64_t exports;
+} PyGrid;
+
+// A read-only 2D view of a plane. Grid planes are read through a pointer to
+// the engine's own pointer when a buffer is taken, since stepping swaps the
+// double buffers, and count against the grid's exports until the buffer is
+// released; ensemble counts are owned by the plane itself.
+typedef struct PyPlane
+{
+    PyObject_HEAD
+    PyObject *owner;
+    void **source;
+    void *owned;
+    Py_ssize_t offset;
+    const char *format;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} PyPlane;
+
+static PyTypeObject *grid_type;
+static PyTypeObject *plane_type;
+
+static int initGrid(PyGrid *self, PyObject *args, PyObject *kwargs);
+static void deallocGrid(PyGrid *self);
+static PyObject *igniteGrid(PyGrid *self, PyObject *args, PyObject *kwargs);
+static PyObject *stepGrid(PyGrid *self, PyObject *args, PyObject *kwargs);
+static PyObject *runGrid(PyGrid *self, PyObject *args, PyObject *kwargs);
+static PyObject *runGridEnsemble(PyGrid *self, PyObject *args, PyObject *kwargs);
+static PyObject *getIntensity(PyGrid *self, void *closure);
+static PyObject *getFuel(PyGrid *self, void *closure);
+static PyObject *getArrivalPlane(PyGrid *self, void *closure);
+static bool claimGrid(PyGrid *self, bool writes);
+static PyObject *newPlane(PyObject *owner, void **source, void *owned, Py_ssize_t offset,
+                          const char *format, Py_ssize_t itemsize, int64_t width, int64_t height);
+static void deallocPlane(PyPlane *self);
+static int getPlaneBuffer(PyPlane *self, Py_buffer *view, int flags);
+static void releasePlaneBuffer(PyPlane *self, Py_buffer *view);
+
+static int initGrid(PyGrid *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"width", "height", "fuel_seed", "clump", NULL};
+    long long width, height;
+    unsigned long long fuel_seed = 1;
+    int clump = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "LL|Ki", (char **) keywords,
+                                     &width, &height, &fuel_seed, &clump))
+        return -1;
+    if (width < 1 || height < 1 || clump < 1) {
+        PyErr_SetString(PyExc_ValueError, "width, height and clump must be positive");
+        return -1;
+    }
+    if (self->band != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "grid is already initialized");
+        return -1;
+    }
+    // Four float planes with halo rows, and the arrival raster, must have
+    // sizes that fit
+    if (width > PY_SSIZE_T_MAX / 16 / (height + 2)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    FuelNoise noise = clump > 1 ? clumpedFuelNoise(fuel_seed, clump) : whiteFuelNoise(fuel_seed);
+    SimBand *band;
+    ArrivalRaster *arrival;
+    Py_BEGIN_ALLOW_THREADS
+    band = newEmptyBand(width, 0, height);
+    arrival = newArrival(width, height, 4);
+    if (band != NULL && arrival != NULL) {
+        for (int64_t i = 0; i < height; i++)
+            fuelNoiseRow(&noise, i, 0, width, bandRow(band->fuel, band, i+1));
+    }
+    Py_END_ALLOW_THREADS
+    if (band == NULL || arrival == NULL) {
+        if (band != NULL)
+            freeBand(band);
+        if (arrival != NULL)
+            freeArrival(arrival);
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->band = band;
+    self->arrival = arrival;
+    self->band->arrival = self->arrival;
+    self->steps = 0;
+    self->busy = false;
+    self->exports = 0;
+    return 0;
+}
+
+static void deallocGrid(PyGrid *self) {
+    if (self->band != NULL) {
+        freeBand(self->band);
+        freeArrival(self->arrival);
+    }
+    PyTypeObject *type = Py_TYPE(self);
+    type->tp_free((PyObject *) self);
+    Py_DECREF(type);
+}
+
+// Sets tile (i, j) burning with the given intensity, arriving after the steps
+// taken so far.
+static PyObject *igniteGrid(PyGrid *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"i", "j", "intensity", NULL};
+    long long i, j;
+    float intensity = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "LL|f", (char **) keywords, &i, &j, &intensity))
+        return NULL;
+    if (!claimGrid(self, true))
+        return NULL;
+    SimBand *band = self->band;
+    if (i < 0 || i >= band->rows || j < 0 || j >= band->width || !(intensity > 0)) {
+        self->busy = false;
+        PyErr_SetString(PyExc_ValueError, "tile off the grid or intensity not positive");
+        return NULL;
+    }
+    float *cur = &bandRow(band->intensity, band, i+1)[j];
+    if (*cur == 0)
+        band->row_fire[i+1]++;
+    *cur = intensity;
+    bandRow(band->fuel, band, i+1)[j] = 0;
+    // The other buffer of this row no longer matches
+    band->row_settled[i+1] = 0;
+    setArrival(self->arrival, i*band->width + j, self->steps);
+    self->busy = false;
+    Py_RETURN_NONE;
+}
+
+// Advances one step and returns the number of tiles burning before it.
+static PyObject *stepGrid(PyGrid *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"odds", "seed", NULL};
+    float odds = 0.2f;
+    unsigned long long seed = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|fK", (char **) keywords, &odds, &seed))
+        return NULL;
+    if (!claimGrid(self, true))
+        return NULL;
+    int64_t fire_count;
+    Py_BEGIN_ALLOW_THREADS
+    fire_count = stepBand(self->band, odds, seed, self->steps);
+    Py_END_ALLOW_THREADS
+    self->steps++;
+    self->busy = false;
+    return PyLong_FromLongLong(fire_count);
+}
+
+// Steps until the fire is out or max_steps more have run (0 for no limit) and
+// returns the number of steps taken.
+static PyObject *runGrid(PyGrid *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"odds", "seed", "max_steps", NULL};
+    float odds = 0.2f;
+    unsigned long long seed = 1;
+    int max_steps = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|fKi", (char **) keywords, &odds, &seed, &max_steps))
+        return NULL;
+    if (!claimGrid(self, true))
+        return NULL;
+    int taken = 0;
+    Py_BEGIN_ALLOW_THREADS
+    while (max_steps <= 0 || taken < max_steps) {
+        if (stepBand(self->band, odds, seed, self->steps) == 0)
+            break;
+        self->steps++;
+        taken++;
+    }
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+    return PyLong_FromLong(taken);
+}
+
+// Runs 64 realizations on from the grid's current state, for steps steps or
+// until every one is out (0), without changing the grid. Returns a uint8
+// plane counting the realizations each tile ignited in.
+static PyObject *runGridEnsemble(PyGrid *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"odds", "seed", "steps", NULL};
+    float odds = 0.2f;
+    unsigned long long seed = 1;
+    int steps = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|fKi", (char **) keywords, &odds, &seed, &steps))
+        return NULL;
+    if (!claimGrid(self, false))
+        return NULL;
+    int64_t width = self->band->width;
+    int64_t height = self->band->rows;
+    uint8_t *counts = (uint8_t *) malloc(width*height);
+    if (counts == NULL) {
+        self->busy = false;
+        return PyErr_NoMemory();
+    }
+    Ensemble *ensemble;
+    Py_BEGIN_ALLOW_THREADS
+    ensemble = newBandEnsemble(self->band);
+    if (ensemble != NULL) {
+        for (int step = 0; steps <= 0 || step < steps; step++) {
+            if (stepEnsemble(ensemble, odds, seed, self->steps + step) == 0)
+                break;
+        }
+        ensembleBurnCounts(ensemble, counts);
+        freeEnsemble(ensemble);
+    }
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+    if (ensemble == NULL) {
+        free(counts);
+        return PyErr_NoMemory();
+    }
+    return newPlane(NULL, NULL, counts, 0, "B", 1, width, height);
+}
+
+static PyObject *getIntensity(PyGrid *self, void * /* closure */) {
+    if (self->band == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "grid is not initialized");
+        return NULL;
+    }
+    SimBand *band = self->band;
+    return newPlane((PyObject *) self, (void **) &band->intensity, NULL, sizeof(float)*band->width,
+                    "f", sizeof(float), band->width, band->rows);
+}
+
+static PyObject *getFuel(PyGrid *self, void * /* closure */) {
+    if (self->band == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "grid is not initialized");
+        return NULL;
+    }
+    SimBand *band = self->band;
+    return newPlane((PyObject *) self, (void **) &band->fuel, NULL, sizeof(float)*band->width,
+                    "f", sizeof(float), band->width, band->rows);
+}
+
+static PyObject *getArrivalPlane(PyGrid *self, void * /* closure */) {
+    if (self->band == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "grid is not initialized");
+        return NULL;
+    }
+    return newPlane((PyObject *) self, &self->arrival->steps, NULL, 0,
+                    "I", sizeof(uint32_t), self->arrival->width, self->arrival->height);
+}
+
+// Marks the grid busy for a call that reads it, or also changes it when
+// writes is set, which views of its planes would see happen under them.
+static bool claimGrid(PyGrid *self, bool writes) {
+    if (self->band == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "grid is not initialized");
+        return false;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "grid is being stepped by another thread");
+        return false;
+    }
+    if (writes && self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "views of the grid's planes are still alive; copy or release them first");
+        return false;
+    }
+    self->busy = true;
+    return true;
+}
+
+// Returns a memoryview of a new plane over *source, keeping owner alive, or
+// over owned, which the plane takes and frees.
+static PyObject *newPlane(PyObject *owner, void **source, void *owned, Py_ssize_t offset,
+                          const char *format, Py_ssize_t itemsize, int64_t width, int64_t height) {
+    PyPlane *plane = PyObject_New(PyPlane, plane_type);
+    if (plane == NULL) {
+        free(owned);
+        return NULL;
+    }
+    Py_XINCREF(owner);
+    plane->owner = owner;
+    plane->owned = owned;
+    plane->source = owned != NULL ? &plane->owned : source;
+    plane->offset = offset;
+    plane->format = format;
+    plane->shape[0] = height;
+    plane->shape[1] = width;
+    plane->strides[0] = width*itemsize;
+    plane->strides[1] = itemsize;
+    PyObject *view = PyMemoryView_FromObject((PyObject *) plane);
+    Py_DECREF(plane);
+    return view;
+}
+
+static void deallocPlane(PyPlane *self) {
+    Py_XDECREF(self->owner);
+    free(self->owned);
+    PyTypeObject *type = Py_TYPE(self);
+    PyObject_Free(self);
+    Py_DECREF(type);
+}
+
+static int getPlaneBuffer(PyPlane *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "planes are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    if (self->owner != NULL)
+        ((PyGrid *) self->owner)->exports++;
+    Py_INCREF(self);
+    view->obj = (PyObject *) self;
+    view->buf = (char *) *self->source + self->offset;
+    view->itemsize = self->strides[1];
+    view->len = self->shape[0]*self->strides[0];
+    view->readonly = 1;
+    view->format = (flags & PyBUF_FORMAT) ? (char *) self->format : NULL;
+    // Without PyBUF_ND the consumer takes the plane as flat bytes, which the
+    // rows are since they are contiguous, and must be told it is 1D
+    if (flags & PyBUF_ND) {
+        view->ndim = 2;
+        view->shape = self->shape;
+    } else {
+        view->ndim = 1;
+        view->shape = NULL;
+    }
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void releasePlaneBuffer(PyPlane *self, Py_buffer * /* view */) {
+    if (self->owner != NULL)
+        ((PyGrid *) self->owner)->exports--;
+}
+
+static PyMethodDef grid_methods[] = {
+    {"ignite", (PyCFunction) (void (*)(void)) igniteGrid, METH_VARARGS | METH_KEYWORDS,
+     "ignite(i, j, intensity=1.0): sets tile (i, j) burning"},
+    {"step", (PyCFunction) (void (*)(void)) stepGrid, METH_VARARGS | METH_KEYWORDS,
+     "step(odds=0.2, seed=1): advances one step, returns the tiles burning before it"},
+    {"run", (PyCFunction) (void (*)(void)) runGrid, METH_VARARGS | METH_KEYWORDS,
+     "run(odds=0.2, seed=1, max_steps=0): steps until the fire is out, returns the steps taken"},
+    {"ensemble", (PyCFunction) (void (*)(void)) runGridEnsemble, METH_VARARGS | METH_KEYWORDS,
+     "ensemble(odds=0.2, seed=1, steps=0): realizations (of 64) each tile ignites in from here on"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef grid_members[] = {
+    {"steps", T_INT, offsetof(PyGrid, steps), READONLY, "steps taken so far"},
+    {NULL, 0, 0, 0, NULL}
+};
+
+// Views are live on the engine's memory, which is why ignite, step and run
+// refuse to change the grid while any of them is still held.
+static PyGetSetDef grid_getset[] = {
+    {"intensity", (getter) getIntensity, NULL, "float32 intensity plane, height x width", NULL},
+    {"fuel", (getter) getFuel, NULL, "float32 fuel plane, height x width", NULL},
+    {"arrival", (getter) getArrivalPlane, NULL,
+     "uint32 step each tile arrived at, ARRIVAL_NONE where the fire has not been", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot grid_slots[] = {
+    {Py_tp_doc, (void *) "Grid(width, height, fuel_seed=1, clump=1): fuel from landscape noise, no fire yet"},
+    {Py_tp_new, (void *) PyType_GenericNew},
+    {Py_tp_init, (void *) initGrid},
+    {Py_tp_dealloc, (void *) deallocGrid},
+    {Py_tp_methods, grid_methods},
+    {Py_tp_members, grid_members},
+    {Py_tp_getset, grid_getset},
+    {0, NULL}
+};
+
+static PyType_Slot plane_slots[] = {
+    {Py_tp_dealloc, (void *) deallocPlane},
+    {Py_bf_getbuffer, (void *) getPlaneBuffer},
+    {Py_bf_releasebuffer, (void *) releasePlaneBuffer},
+    {0, NULL}
+};
+
+static PyType_Spec grid_spec = {"firesim.Grid", sizeof(PyGrid), 0, Py_TPFLAGS_DEFAULT, grid_slots};
+static PyType_Spec plane_spec = {"firesim.Plane", sizeof(PyPlane), 0, Py_TPFLAGS_DEFAULT, plane_slots};
+
+static PyModuleDef firesim_module = {
+    PyModuleDef_HEAD_INIT, "firesim", "Fire spread on a grid of fuel", -1,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_firesim(void) {
+    grid_type = (PyTypeObject *) PyType_FromSpec(&grid_spec);
+    plane_type = (PyTypeObject *) PyType_FromSpec(&plane_spec);
+    if (grid_type == NULL || plane_type == NULL)
+        return NULL;
+
+    PyObject *module = PyModule_Create(&firesim_module);
+    if (module == NULL)
+        return NULL;
+    Py_INCREF(grid_type);
+    if (PyModule_AddObject(module, "Grid", (PyObject *) grid_type) < 0
+        || PyModule_AddIntConstant(module, "ARRIVAL_NONE", ARRIVAL_NONE) < 0) {
+        Py_DECREF(grid_type);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -0,0 +1,153 @@
+#include "quant.h"
+#include "rng.h"
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void rollRow(const uint8_t *sources, int64_t width, uint64_t first_tile,
+                    float odds, uint64_t seed, int step, int dir, uint8_t *hits);
+
+QuantGrid *newQuant(Vertex *grid, int64_t width, int64_t height) {
+    QuantGrid *quant = (QuantGrid *) std::malloc(sizeof(QuantGrid));
+    int64_t plane_size = (height+2)*width;
+    quant->width = width;
+    quant->height = height;
+    quant->intensity = (uint8_t *) std::calloc(plane_size, 1);
+    quant->fuel = (uint8_t *) std::calloc(plane_size, 1);
+    quant->next_intensity = (uint8_t *) std::calloc(plane_size, 1);
+    quant->next_fuel = (uint8_t *) std::calloc(plane_size, 1);
+    quant->hits = (uint8_t *) std::malloc(width);
+    quant->row_fire = (int64_t *) std::calloc(height+2, sizeof(int64_t));
+    quant->next_row_fire = (int64_t *) std::calloc(height+2, sizeof(int64_t));
+    quant->row_settled = (char *) std::calloc(height+2, sizeof(char));
+    quant->arrival = NULL;
+
+    for (int64_t i = 0; i < height; i++) {
+        uint8_t *intensity = quantRow(quant->intensity, quant, i);
+        uint8_t *fuel = quantRow(quant->fuel, quant, i);
+        int64_t row_index = getGridIndex(i, 0, width);
+        for (int64_t j = 0; j < width; j++) {
+            intensity[j] = quantSteps(grid[row_index + j*6].col[0]);
+            fuel[j] = quantSteps(grid[row_index + j*6].col[1]);
+            if (intensity[j] != 0)
+                quant->row_fire[i+1]++;
+        }
+    }
+    return quant;
+}
+
+void freeQuant(QuantGrid *quant) {
+    std::free(quant->intensity);
+    std::free(quant->fuel);
+    std::free(quant->next_intensity);
+    std::free(quant->next_fuel);
+    std::free(quant->hits);
+    std::free(quant->row_fire);
+    std::free(quant->next_row_fire);
+    std::free(quant->row_settled);
+    std::free(quant);
+}
+
+// stepBand pulls rolls tile by tile; here each burning tile in and around the
+// row pushes its rolls into a row of hit counts first, and the update itself
+// is then a branch-free pass over bytes that the compiler vectorizes, with the
+// burn-down as a saturating subtract.
+int64_t stepQuant(QuantGrid *quant, float odds, uint64_t seed, int step) {
+    int64_t width = quant->width;
+    int64_t fire_count = 0;
+    uint8_t *hits = quant->hits;
+    for (int64_t i = 0; i < quant->height; i++) {
+        uint8_t *next_intensity = quantRow(quant->next_intensity, quant, i);
+        uint8_t *next_fuel = quantRow(quant->next_fuel, quant, i);
+        quant->next_row_fire[i+1] = 0;
+        if (quant->row_fire[i] == 0 && quant->row_fire[i+1] == 0 && quant->row_fire[i+2] == 0) {
+            if (!quant->row_settled[i+1]) {
+                memcpy(next_intensity, quantRow(quant->intensity, quant, i), width);
+                memcpy(next_fuel, quantRow(quant->fuel, quant, i), width);
+                quant->row_settled[i+1] = 1;
+            }
+            continue;
+        }
+        quant->row_settled[i+1] = 0;
+        fire_count += quant->row_fire[i+1];
+
+        const uint8_t *intensity = quantRow(quant->intensity, quant, i);
+        const uint8_t *fuel = quantRow(quant->fuel, quant, i);
+        memset(hits, 0, width);
+        if (quant->row_fire[i+1] != 0) {
+            // Rolls are drawn only for neighbors inside the grid, as in stepBand
+            rollRow(intensity + 1, width - 1, i*width + 1, odds, seed, step, DIR_LEFT, hits);
+            rollRow(intensity, width - 1, i*width, odds, seed, step, DIR_RIGHT, hits + 1);
+        }
+        if (quant->row_fire[i] != 0)
+            rollRow(quantRow(quant->intensity, quant, i-1), width, (i-1)*width, odds, seed, step, DIR_UP, hits);
+        if (quant->row_fire[i+2] != 0)
+            rollRow(quantRow(quant->intensity, quant, i+1), width, (i+1)*width, odds, seed, step, DIR_DOWN, hits);
+
+        int64_t row_fire = 0;
+        for (int64_t j = 0; j < width; j++) {
+            uint8_t cur = intensity[j];
+            uint8_t burnt = cur > 0 ? cur - 1 : 0;
+            uint8_t hit = hits[j];
+            uint8_t next = hit == 0 ? burnt : (hit == 1 ? fuel[j] : 0);
+            next_intensity[j] = next;
+            next_fuel[j] = hit == 0 ? fuel[j] : 0;
+            row_fire += next != 0;
+        }
+        quant->next_row_fire[i+1] = row_fire;
+        // Kept out of the loop above so it stays branch-free
+        if (quant->arrival != NULL) {
+            for (int64_t j = 0; j < width; j++) {
+                if (hits[j] != 0 && fuel[j] != 0)
+                    setArrival(quant->arrival, i*width + j, step + 1);
+            }
+        }
+    }
+
+    uint8_t *swap = quant->intensity;
+    quant->intensity = quant->next_intensity;
+    quant->next_intensity = swap;
+    swap = quant->fuel;
+    quant->fuel = quant->next_fuel;
+    quant->next_fuel = swap;
+    for (int64_t i = 0; i < quant->height; i++)
+        quant->row_fire[i+1] = quant->next_row_fire[i+1];
+    return fire_count;
+}
+
+// Adds the rolls that burning tiles in sources (tile ids starting at
+// first_tile) make in direction dir to hits[j] for source j. Eight tiles at a
+// time are tested for fire so unburning stretches of a row are skipped.
+static void rollRow(const uint8_t *sources, int64_t width, uint64_t first_tile,
+                    float odds, uint64_t seed, int step, int dir, uint8_t *hits) {
+    int64_t j = 0;
+    for (; j + 8 <= width; j += 8) {
+        uint64_t word;
+        memcpy(&word, sources + j, 8);
+        if (word == 0)
+            continue;
+        for (int64_t k = j; k < j + 8; k++) {
+            if (sources[k] != 0 && rngUniform(seed, step, first_tile + k, dir) < odds)
+                hits[k]++;
+        }
+    }
+    for (; j < width; j++) {
+        if (sources[j] != 0 && rngUniform(seed, step, first_tile + j, dir) < odds)
+            hits[j]++;
+    }
+}
+
+void writeQuant(const QuantGrid *quant, Vertex *grid) {
+    for (int64_t i = 0; i < quant->height; i++) {
+        const uint8_t *intensity = quantRow(quant->intensity, quant, i);
+        const uint8_t *fuel = quantRow(quant->fuel, quant, i);
+        int64_t row_index = getGridIndex(i, 0, quant->width);
+        for (int64_t j = 0; j < quant->width; j++) {
+            for (int v = 0; v < 6; v++) {
+                grid[row_index + j*6 + v].col[0] = intensity[j]*QUANT_STEP;
+                grid[row_index + j*6 + v].col[1] = fuel[j]*QUANT_STEP;
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+#include "arrival.h"
+#include "event.h"
+#include "grid.h"
+#include <stdint.h>
+
+// Float intensity per unit of quantized intensity and fuel
+#define QUANT_STEP 0.005f
+
+// The synchronous model with one byte per tile per plane instead of a float.
+// Burning takes a fixed 0.005 off the intensity each step, so both planes are
+// stored as burn steps: fuel f becomes burnSteps(f), the number of steps a tile
+// ignited with it burns for, and an intensity x becomes burnSteps(x), the steps
+// it has left. Decrementing the float and decrementing its step count reach
+// zero on the same step, so for the same seed this steps exactly like
+// stepBand. Going back to floats (writeQuant) gives steps*QUANT_STEP, which is
+// within one step of the float engine's value. Fuel above 1.275 (255 steps)
+// saturates.
+typedef struct QuantGrid
+{
+    int64_t width;
+    int64_t height;
+    // Planes have one empty halo row above and below the grid
+    uint8_t *intensity;
+    uint8_t *fuel;
+    uint8_t *next_intensity;
+    uint8_t *next_fuel;
+    // Hits taken by each tile of the row being stepped
+    uint8_t *hits;
+    int64_t *row_fire;
+    int64_t *next_row_fire;
+    char *row_settled;
+    // When set, tiles record their arrival step in it as they burn
+    ArrivalRaster *arrival;
+} QuantGrid;
+
+QuantGrid *newQuant(Vertex *grid, int64_t width, int64_t height);
+void freeQuant(QuantGrid *quant);
+// Same contract as stepBand for a band covering the whole grid.
+int64_t stepQuant(QuantGrid *quant, float odds, uint64_t seed, int step);
+void writeQuant(const QuantGrid *quant, Vertex *grid);
+
+// Burn steps for a float fuel or intensity, saturated to a byte
+inline uint8_t quantSteps(float value) {
+    int steps = burnSteps(value);
+    return steps > 255 ? 255 : steps;
+}
+
+inline uint8_t *quantRow(uint8_t *plane, const QuantGrid *quant, int64_t i) {
+    return plane + (i+1)*quant->width;
+}
+
+#endif
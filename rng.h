@@ -0,0 +1,32 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Counter-based random numbers: every roll is a pure function of the seed and
+// of what is being rolled (step, tile, direction), so any process or thread
+// can evaluate any roll without sharing generator state, and the outcome does
+// not depend on how the grid is split up or in what order tiles are visited.
+
+inline uint64_t rngMix(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t rngHash(uint64_t seed, uint64_t step, uint64_t tile, uint64_t stream) {
+    uint64_t h = rngMix(seed + 0x9e3779b97f4a7c15ULL*(step+1));
+    h = rngMix(h ^ tile);
+    return rngMix(h + stream);
+}
+
+// Uniform float in [0, 1)
+inline float rngUniform(uint64_t seed, uint64_t step, uint64_t tile, uint64_t stream) {
+    return (float)(rngHash(seed, step, tile, stream) >> 40) * (1.f/16777216.f);
+}
+
+#endif
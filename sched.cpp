@@ -0,0 +1,116 @@
+#include "sched.h"
+
+static void workerThread(Scheduler *scheduler, int worker);
+static void workLoop(Scheduler *scheduler, int worker);
+static bool takeTask(Scheduler *scheduler, int worker, int64_t *task);
+
+Scheduler *newScheduler(int workers) {
+    Scheduler *scheduler = new Scheduler;
+    scheduler->workers = workers < 1 ? 1 : workers;
+    scheduler->queues = new WorkerQueue[scheduler->workers];
+    scheduler->generation = 0;
+    scheduler->active = 0;
+    scheduler->stopping = false;
+    scheduler->remaining = 0;
+    scheduler->fn = NULL;
+    scheduler->context = NULL;
+    scheduler->executed.assign(scheduler->workers, 0);
+    scheduler->stolen.assign(scheduler->workers, 0);
+    for (int w = 1; w < scheduler->workers; w++)
+        scheduler->threads.push_back(std::thread(workerThread, scheduler, w));
+    return scheduler;
+}
+
+void freeScheduler(Scheduler *scheduler) {
+    {
+        std::lock_guard<std::mutex> guard(scheduler->lock);
+        scheduler->stopping = true;
+    }
+    scheduler->wake.notify_all();
+    for (std::thread &thread : scheduler->threads)
+        thread.join();
+    delete[] scheduler->queues;
+    delete scheduler;
+}
+
+void runTasks(Scheduler *scheduler, int64_t count, TaskFn fn, void *context) {
+    int workers = scheduler->workers;
+    for (int w = 0; w < workers; w++) {
+        scheduler->executed[w] = 0;
+        scheduler->stolen[w] = 0;
+    }
+    {
+        std::lock_guard<std::mutex> guard(scheduler->lock);
+        scheduler->fn = fn;
+        scheduler->context = context;
+        scheduler->remaining = count;
+        for (int w = 0; w < workers; w++) {
+            std::lock_guard<std::mutex> queue_guard(scheduler->queues[w].lock);
+            for (int64_t task = count*w/workers; task < count*(w+1)/workers; task++)
+                scheduler->queues[w].tasks.push_back(task);
+        }
+        scheduler->generation++;
+    }
+    scheduler->wake.notify_all();
+
+    workLoop(scheduler, 0);
+    std::unique_lock<std::mutex> guard(scheduler->lock);
+    scheduler->done.wait(guard, [scheduler] { return scheduler->remaining == 0 && scheduler->active == 0; });
+}
+
+static void workerThread(Scheduler *scheduler, int worker) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(scheduler->lock);
+    while (true) {
+        scheduler->wake.wait(guard, [&] { return scheduler->stopping || scheduler->generation != seen; });
+        if (scheduler->stopping)
+            return;
+        seen = scheduler->generation;
+        scheduler->active++;
+        guard.unlock();
+        workLoop(scheduler, worker);
+        guard.lock();
+        scheduler->active--;
+        if (scheduler->active == 0)
+            scheduler->done.notify_all();
+    }
+}
+
+// Works until every task of the current run has finished, not just until
+// there is nothing left to take: a task still running elsewhere is done when
+// remaining reaches zero.
+static void workLoop(Scheduler *scheduler, int worker) {
+    while (scheduler->remaining > 0) {
+        int64_t task;
+        if (!takeTask(scheduler, worker, &task)) {
+            std::this_thread::yield();
+            continue;
+        }
+        scheduler->fn(scheduler->context, task, worker);
+        scheduler->executed[worker]++;
+        scheduler->remaining--;
+    }
+}
+
+static bool takeTask(Scheduler *scheduler, int worker, int64_t *task) {
+    {
+        WorkerQueue *own = &scheduler->queues[worker];
+        std::lock_guard<std::mutex> guard(own->lock);
+        if (!own->tasks.empty()) {
+            *task = own->tasks.back();
+            own->tasks.pop_back();
+            return true;
+        }
+    }
+    for (int k = 1; k < scheduler->workers; k++) {
+        WorkerQueue *victim = &scheduler->queues[(worker + k) % scheduler->workers];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->tasks.empty()) {
+            *task = victim->tasks.front();
+            victim->tasks.pop_front();
+            scheduler->stolen[worker]++;
+            return true;
+        }
+    }
+    return false;
+}
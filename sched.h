@@ -0,0 +1,51 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs task number task on the given worker (0 is the calling thread)
+typedef void (*TaskFn)(void *context, int64_t task, int worker);
+
+typedef struct WorkerQueue
+{
+    std::mutex lock;
+    std::deque<int64_t> tasks;
+} WorkerQueue;
+
+// A fixed pool of workers with a deque each. runTasks deals tasks out in
+// contiguous runs, so neighboring tasks stay on one worker; a worker takes
+// from the back of its own deque and, once it is empty, steals from the front
+// of the others', so a worker that was dealt the busy part of the grid gets
+// help instead of holding up the step.
+typedef struct Scheduler
+{
+    int workers;
+    std::vector<std::thread> threads;
+    WorkerQueue *queues;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation;
+    int active;
+    bool stopping;
+    std::atomic<int64_t> remaining;
+    TaskFn fn;
+    void *context;
+    // Per worker, over the last runTasks
+    std::vector<int64_t> executed;
+    std::vector<int64_t> stolen;
+} Scheduler;
+
+// workers includes the calling thread, so 1 runs everything inline.
+Scheduler *newScheduler(int workers);
+void freeScheduler(Scheduler *scheduler);
+// Runs tasks 0..count-1 and returns once all of them have finished.
+void runTasks(Scheduler *scheduler, int64_t count, TaskFn fn, void *context);
+
+#endif
@@ -0,0 +1,36 @@
+#include "server.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <iostream>
+
+// ./serve [socket path] [workers] answers scenario requests until interrupted,
+// e.g. echo "width=2000 height=2000 clump=64 seed=3" | nc -U /tmp/firesim.sock
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "/tmp/firesim.sock";
+    int workers = argc > 2 ? atoi(argv[2]) : (int) std::thread::hardware_concurrency();
+
+    // Blocked before any thread starts so only sigwait below sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    Server *server = newServer(path, workers);
+    if (server == NULL) {
+        std::cerr << "Could not listen on " << path << std::endl;
+        return 1;
+    }
+    std::cout << "Listening on " << path << " with " << server->workers.size() << " workers" << std::endl;
+    int signum;
+    sigwait(&signals, &signum);
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        std::cout << "\nRequests: " << server->requests << "\tRuns: " << server->runs
+                  << "\tCache hits: " << server->cache_hits
+                  << "\tResults evicted: " << server->results_evicted << std::endl;
+    }
+    freeServer(server);
+    return 0;
+}
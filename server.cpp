@@ -0,0 +1,327 @@
+#include "server.h"
+#include "landscape.h"
+#include "rng.h"
+#include "sparse.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <new>
+#include <sstream>
+
+static void acceptLoop(Server *server);
+static void serveConnection(Server *server, int fd);
+static void workerLoop(Server *server);
+static std::string runScenario(const Scenario *scenario);
+static std::string jsonString(const std::string &text);
+static void sendAll(int fd, const std::string &text);
+
+Server *newServer(const char *path, int workers) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path))
+        return NULL;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return NULL;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    Server *server = new Server;
+    server->path = path;
+    server->listen_fd = fd;
+    server->stopping = false;
+    server->requests = 0;
+    server->runs = 0;
+    server->cache_hits = 0;
+    server->results_evicted = 0;
+    for (int w = 0; w < (workers < 1 ? 1 : workers); w++)
+        server->workers.push_back(std::thread(workerLoop, server));
+    server->acceptor = std::thread(acceptLoop, server);
+    return server;
+}
+
+void freeServer(Server *server) {
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        server->stopping = true;
+        for (int fd : server->connections)
+            shutdown(fd, SHUT_RDWR);
+    }
+    server->wake.notify_all();
+    // Wakes accept up with an error
+    shutdown(server->listen_fd, SHUT_RDWR);
+    server->acceptor.join();
+    close(server->listen_fd);
+    unlink(server->path.c_str());
+    for (std::thread &worker : server->workers)
+        worker.join();
+    std::unique_lock<std::mutex> guard(server->lock);
+    server->closed.wait(guard, [server] { return server->connections.empty(); });
+    guard.unlock();
+    delete server;
+}
+
+std::string serveRequest(Server *server, const std::string &request) {
+    Scenario scenario;
+    std::string error;
+    if (!parseScenario(request, &scenario, &error))
+        return "{\"error\":" + jsonString(error) + "}";
+    uint64_t hash = scenarioHash(&scenario);
+    char head[64];
+    snprintf(head, sizeof(head), "{\"hash\":\"%016llx\",", (unsigned long long) hash);
+
+    std::unique_lock<std::mutex> guard(server->lock);
+    server->requests++;
+    auto cached = server->results.find(hash);
+    if (cached != server->results.end()) {
+        server->cache_hits++;
+        server->result_order.splice(server->result_order.begin(), server->result_order, cached->second.order);
+        return head + std::string("\"cached\":true,") + cached->second.fields + "}";
+    }
+    if (server->stopping)
+        return "{\"error\":\"server is stopping\"}";
+    // Requests for a scenario that is already queued or running wait for
+    // that run instead of starting another
+    std::shared_ptr<ServerJob> job;
+    auto found = server->running.find(hash);
+    if (found != server->running.end()) {
+        job = found->second;
+    } else {
+        job = std::make_shared<ServerJob>();
+        job->scenario = scenario;
+        job->hash = hash;
+        job->done = false;
+        server->running[hash] = job;
+        server->queue.push_back(job);
+        server->wake.notify_one();
+    }
+    server->finished.wait(guard, [&job] { return job->done; });
+    return head + std::string("\"cached\":false,") + job->result + "}";
+}
+
+static void acceptLoop(Server *server) {
+    while (true) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        std::lock_guard<std::mutex> guard(server->lock);
+        if (server->stopping) {
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        if (fd < 0)
+            continue;
+        if (server->connections.size() >= SERVER_MAX_CONNECTIONS) {
+            sendAll(fd, "{\"error\":\"too many connections\"}\n");
+            close(fd);
+            continue;
+        }
+        server->connections.insert(fd);
+        std::thread(serveConnection, server, fd).detach();
+    }
+}
+
+// Answers each line the client sends until it hangs up or sends a line longer
+// than SERVER_MAX_LINE.
+static void serveConnection(Server *server, int fd) {
+    std::string pending;
+    char buffer[4096];
+    ssize_t count;
+    bool too_long = false;
+    while (!too_long && (count = read(fd, buffer, sizeof(buffer))) > 0) {
+        pending.append(buffer, count);
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos && end <= SERVER_MAX_LINE) {
+            sendAll(fd, serveRequest(server, pending.substr(0, end)) + "\n");
+            pending.erase(0, end + 1);
+        }
+        too_long = pending.size() > SERVER_MAX_LINE;
+    }
+    if (too_long)
+        sendAll(fd, "{\"error\":\"request longer than " + std::to_string(SERVER_MAX_LINE) + " bytes\"}\n");
+    close(fd);
+    std::lock_guard<std::mutex> guard(server->lock);
+    server->connections.erase(fd);
+    server->closed.notify_all();
+}
+
+// Gives up quietly if the client has gone.
+static void sendAll(int fd, const std::string &text) {
+    for (size_t sent = 0; sent < text.size(); ) {
+        ssize_t wrote = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (wrote <= 0)
+            return;
+        sent += wrote;
+    }
+}
+
+static void workerLoop(Server *server) {
+    std::unique_lock<std::mutex> guard(server->lock);
+    while (true) {
+        server->wake.wait(guard, [server] { return server->stopping || !server->queue.empty(); });
+        // Jobs already queued still run, since requests are waiting on them
+        if (server->queue.empty())
+            return;
+        std::shared_ptr<ServerJob> job = server->queue.front();
+        server->queue.pop_front();
+        guard.unlock();
+        // A run that cannot get memory fails on its own rather than taking
+        // the server down, and is not cached so it can be asked for again
+        std::string result;
+        bool ran = true;
+        try {
+            result = runScenario(&job->scenario);
+        } catch (const std::bad_alloc &) {
+            result = "\"error\":\"out of memory\"";
+            ran = false;
+        }
+        guard.lock();
+        job->result = result;
+        job->done = true;
+        if (ran) {
+            if (server->results.size() >= SERVER_RESULTS) {
+                server->results.erase(server->result_order.back());
+                server->result_order.pop_back();
+                server->results_evicted++;
+            }
+            server->result_order.push_front(job->hash);
+            server->results[job->hash] = {result, server->result_order.begin()};
+        }
+        server->running.erase(job->hash);
+        server->runs++;
+        server->finished.notify_all();
+    }
+}
+
+// Steps the sparse engine until the fire is out and reports its statistics,
+// as JSON fields without the braces.
+static std::string runScenario(const Scenario *scenario) {
+    auto start = std::chrono::high_resolution_clock::now();
+    FuelNoise noise = scenario->clump > 1 ? clumpedFuelNoise(scenario->fuel_seed, scenario->clump)
+                                          : whiteFuelNoise(scenario->fuel_seed);
+    SparseGrid *sparse = newSparse(scenario->width, scenario->height, fuelNoiseAt, &noise);
+    igniteSparse(sparse, scenario->ignite_i, scenario->ignite_j, 1);
+    int steps = 0;
+    while (scenario->max_steps == 0 || steps < scenario->max_steps) {
+        if (stepSparse(sparse, scenario->odds, scenario->seed, steps) == 0)
+            break;
+        steps++;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const FireStats *stats = &sparse->stats;
+    char fields[512];
+    snprintf(fields, sizeof(fields),
+             "\"steps\":%d,\"burned\":%lld,\"burning\":%lld,\"perimeter\":%lld,"
+             "\"min_i\":%lld,\"max_i\":%lld,\"min_j\":%lld,\"max_j\":%lld,\"run_ms\":%lld",
+             steps, (long long) stats->burned, (long long) stats->burning, (long long) stats->perimeter,
+             (long long) stats->min_i, (long long) stats->max_i, (long long) stats->min_j, (long long) stats->max_j,
+             (long long) std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
+    freeSparse(sparse);
+    return fields;
+}
+
+// Quotes text as a JSON string. Error messages repeat what the client sent.
+static std::string jsonString(const std::string &text) {
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20 || c >= 0x7f) {
+            // Bytes past ASCII are escaped one by one, so text that is not
+            // UTF-8 still makes valid JSON
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+bool parseScenario(const std::string &request, Scenario *scenario, std::string *error) {
+    *scenario = {1000, 1000, 1, 1, -1, -1, 0.2f, 1, 0};
+    std::istringstream words(request);
+    std::string word;
+    while (words >> word) {
+        size_t equals = word.find('=');
+        if (equals == std::string::npos) {
+            *error = "expected key=value, got " + word;
+            return false;
+        }
+        std::string key = word.substr(0, equals);
+        const char *value = word.c_str() + equals + 1;
+        char *end;
+        long long number = strtoll(value, &end, 10);
+        if (key == "odds")
+            scenario->odds = strtof(value, &end);
+        else if (key == "fuel_seed" || key == "seed")
+            (key == "seed" ? scenario->seed : scenario->fuel_seed) = strtoull(value, &end, 10);
+        else if (key == "width")
+            scenario->width = number;
+        else if (key == "height")
+            scenario->height = number;
+        else if (key == "clump" || key == "max_steps") {
+            // Checked before narrowing, so 2^32 + 1 is not taken for 1
+            if (number < 0 || number > INT_MAX) {
+                *error = key + " out of range";
+                return false;
+            }
+            (key == "clump" ? scenario->clump : scenario->max_steps) = (int) number;
+        } else if (key == "i")
+            scenario->ignite_i = number;
+        else if (key == "j")
+            scenario->ignite_j = number;
+        else {
+            *error = "unknown key " + key;
+            return false;
+        }
+        if (*end != '\0' || end == value) {
+            *error = "bad value for " + key;
+            return false;
+        }
+    }
+    if (scenario->ignite_i < 0)
+        scenario->ignite_i = scenario->height / 2;
+    if (scenario->ignite_j < 0)
+        scenario->ignite_j = scenario->width / 2;
+    if (scenario->width < 1 || scenario->height < 1 || scenario->clump < 1 || scenario->max_steps < 0
+        || scenario->ignite_i >= scenario->height || scenario->ignite_j >= scenario->width
+        || !(scenario->odds >= 0 && scenario->odds <= 1)) {
+        *error = "values out of range";
+        return false;
+    }
+    if (scenario->width > SERVER_MAX_TILES / scenario->height) {
+        *error = "more than " + std::to_string(SERVER_MAX_TILES) + " tiles";
+        return false;
+    }
+    return true;
+}
+
+// Fields are mixed in one at a time rather than hashing the struct's bytes,
+// which include padding.
+uint64_t scenarioHash(const Scenario *scenario) {
+    uint32_t odds;
+    memcpy(&odds, &scenario->odds, sizeof(odds));
+    uint64_t hash = rngMix(SERVER_MODEL_VERSION);
+    hash = rngMix(hash ^ scenario->width);
+    hash = rngMix(hash ^ scenario->height);
+    hash = rngMix(hash ^ scenario->fuel_seed);
+    hash = rngMix(hash ^ scenario->clump);
+    hash = rngMix(hash ^ scenario->ignite_i);
+    hash = rngMix(hash ^ scenario->ignite_j);
+    hash = rngMix(hash ^ odds);
+    hash = rngMix(hash ^ scenario->seed);
+    return rngMix(hash ^ scenario->max_steps);
+}
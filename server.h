@@ -0,0 +1,114 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Bumped whenever a change to the model would change results, so results
+// cached under the old rules are never served
+#define SERVER_MODEL_VERSION 1
+// Results kept at once; the one asked for longest ago goes first
+#define SERVER_RESULTS 65536
+// Longest request line a connection may send; past it the connection is
+// answered with an error and closed, so a client cannot grow its buffer
+// without end
+#define SERVER_MAX_LINE 4096
+// Connections served at once, each on a thread of its own; more are answered
+// with an error and closed
+#define SERVER_MAX_CONNECTIONS 64
+// Most tiles a scenario may cover. A fire that reaches all of them holds about
+// 5 bytes a tile in sparse blocks.
+#define SERVER_MAX_TILES (1LL << 28)
+
+// Everything a run depends on. Fuel comes from clumpedFuelNoise (or
+// whiteFuelNoise for clump 1) with fuel_seed, the fire starts at
+// (ignite_i, ignite_j) and spreads with the given odds and seed until it is
+// out or max_steps have run (0 for no limit).
+typedef struct Scenario
+{
+    int64_t width;
+    int64_t height;
+    uint64_t fuel_seed;
+    int clump;
+    int64_t ignite_i;
+    int64_t ignite_j;
+    float odds;
+    uint64_t seed;
+    int max_steps;
+} Scenario;
+
+// One run, shared by every request for the same scenario that arrives while
+// it is queued or running
+typedef struct ServerJob
+{
+    Scenario scenario;
+    uint64_t hash;
+    bool done;
+    std::string result;
+} ServerJob;
+
+typedef struct ServerResult
+{
+    std::string fields;
+    std::list<uint64_t>::iterator order;
+} ServerResult;
+
+// Runs scenarios on a fixed pool of worker threads and answers requests on a
+// Unix socket: one line of key=value pairs per request, one line of JSON per
+// answer. The last SERVER_RESULTS results are cached by a hash of the
+// scenario. Fuel is never stored as a plane: the sparse engine asks the noise
+// for it one block at a time as the fire reaches new blocks.
+typedef struct Server
+{
+    std::string path;
+    int listen_fd;
+    std::thread acceptor;
+    std::vector<std::thread> workers;
+    // Each connection is served by a detached thread of its own, at most
+    // SERVER_MAX_CONNECTIONS of them; stopping shuts their sockets down and
+    // waits for them to leave
+    std::unordered_set<int> connections;
+    std::condition_variable closed;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping;
+    std::deque<std::shared_ptr<ServerJob>> queue;
+    std::unordered_map<uint64_t, std::shared_ptr<ServerJob>> running;
+    std::unordered_map<uint64_t, ServerResult> results;
+    // Most recently asked for first
+    std::list<uint64_t> result_order;
+    // Since the server started
+    int64_t requests;
+    int64_t runs;
+    int64_t cache_hits;
+    int64_t results_evicted;
+} Server;
+
+// Listens on path (replacing a stale socket file) with the given number of
+// workers. Returns NULL if the socket cannot be set up.
+Server *newServer(const char *path, int workers);
+// Stops accepting, lets running jobs finish and removes the socket file.
+void freeServer(Server *server);
+// Answers one request line as a connection would, for callers in the same
+// process. Blocks until the result is ready.
+std::string serveRequest(Server *server, const std::string &request);
+
+// Parses "key=value ..." with keys width, height, fuel_seed, clump, i, j,
+// odds, seed and max_steps. Missing keys keep their defaults: 1000 x 1000,
+// white fuel from seed 1, fire in the middle, odds 0.2, seed 1, no limit.
+// Returns false and sets error on unknown keys, values out of range (clump and
+// max_steps must fit an int) or more than SERVER_MAX_TILES tiles.
+bool parseScenario(const std::string &request, Scenario *scenario, std::string *error);
+uint64_t scenarioHash(const Scenario *scenario);
+
+#endif
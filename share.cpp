@@ -0,0 +1,160 @@
+#include "share.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static Share *mapShare(const char *name, int fd, uint64_t size, bool writer);
+
+Share *newShare(const char *name, int64_t width, int64_t height) {
+    // Page aligned, so each slot starts on a page of its own
+    uint64_t data_offset = (sizeof(ShareHeader) + 4095) & ~4095ULL;
+    uint64_t slot_bytes = (2*width*height + 4095) & ~4095ULL;
+    uint64_t size = data_offset + SHARE_SLOTS*slot_bytes;
+    // A fresh object rather than resizing one a reader may still have mapped
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    Share *share = mapShare(name, fd, size, true);
+    if (share == NULL) {
+        shm_unlink(name);
+        return NULL;
+    }
+    // ftruncate zeroed it, so every slot's seq and published start at 0
+    ShareHeader *header = share->header;
+    header->version = SHARE_VERSION;
+    header->width = width;
+    header->height = height;
+    header->data_offset = data_offset;
+    header->slot_bytes = slot_bytes;
+    // Last, so a reader that sees the magic sees the rest
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, "FSHM", 4);
+    return share;
+}
+
+Share *openShare(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < sizeof(ShareHeader)) {
+        close(fd);
+        return NULL;
+    }
+    Share *share = mapShare(name, fd, info.st_size, false);
+    if (share == NULL)
+        return NULL;
+    const ShareHeader *header = share->header;
+    if (memcmp(header->magic, "FSHM", 4) != 0 || header->version != SHARE_VERSION
+        || header->data_offset + SHARE_SLOTS*header->slot_bytes > share->size) {
+        freeShare(share);
+        return NULL;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return share;
+}
+
+void freeShare(Share *share) {
+    munmap(share->base, share->size);
+    if (share->writer)
+        shm_unlink(share->name.c_str());
+    delete share;
+}
+
+uint8_t *beginShare(Share *share) {
+    ShareHeader *header = share->header;
+    int slot = header->published.load(std::memory_order_relaxed) % SHARE_SLOTS;
+    // Odd: readers of this slot now know to drop what they read
+    header->slots[slot].seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return share->base + header->data_offset + slot*header->slot_bytes;
+}
+
+void endShare(Share *share, int step, int64_t fire_count) {
+    ShareHeader *header = share->header;
+    uint64_t generation = header->published.load(std::memory_order_relaxed) + 1;
+    ShareSlot *slot = &header->slots[(generation - 1) % SHARE_SLOTS];
+    slot->generation.store(generation, std::memory_order_relaxed);
+    slot->step.store(step, std::memory_order_relaxed);
+    slot->fire_count.store(fire_count, std::memory_order_relaxed);
+    slot->seq.fetch_add(1, std::memory_order_release);
+    header->published.store(generation, std::memory_order_release);
+}
+
+// The quant planes are already in burn steps, so rows go across as they are.
+void shareQuant(Share *share, const QuantGrid *quant, int step, int64_t fire_count) {
+    int64_t tiles = quant->width*quant->height;
+    uint8_t *intensity = beginShare(share);
+    memcpy(intensity, quantRow(quant->intensity, quant, 0), tiles);
+    memcpy(intensity + tiles, quantRow(quant->fuel, quant, 0), tiles);
+    endShare(share, step, fire_count);
+}
+
+// Rounds to the nearest step rather than counting them out as burnSteps does;
+// a viewer does not need the exact count.
+void shareBand(Share *share, const SimBand *band, int step, int64_t fire_count) {
+    int64_t width = band->width;
+    uint8_t *intensity = beginShare(share);
+    uint8_t *fuel = intensity + width*band->rows;
+    for (int64_t r = 1; r <= band->rows; r++) {
+        const float *from_intensity = bandRow(band->intensity, band, r);
+        const float *from_fuel = bandRow(band->fuel, band, r);
+        for (int64_t j = 0; j < width; j++) {
+            float x = from_intensity[j]*(1/QUANT_STEP) + 0.5f;
+            float f = from_fuel[j]*(1/QUANT_STEP) + 0.5f;
+            intensity[j] = x < 255 ? (uint8_t) x : 255;
+            fuel[j] = f < 255 ? (uint8_t) f : 255;
+        }
+        intensity += width;
+        fuel += width;
+    }
+    endShare(share, step, fire_count);
+}
+
+bool readShare(const Share *share, ShareFrame *frame) {
+    const ShareHeader *header = share->header;
+    uint64_t published = header->published.load(std::memory_order_acquire);
+    if (published == 0)
+        return false;
+    frame->slot = (published - 1) % SHARE_SLOTS;
+    const ShareSlot *slot = &header->slots[frame->slot];
+    frame->seq = slot->seq.load(std::memory_order_acquire);
+    if (frame->seq & 1)
+        return false;
+    frame->generation = slot->generation.load(std::memory_order_relaxed);
+    frame->step = slot->step.load(std::memory_order_relaxed);
+    frame->fire_count = slot->fire_count.load(std::memory_order_relaxed);
+    frame->intensity = share->base + header->data_offset + frame->slot*header->slot_bytes;
+    frame->fuel = frame->intensity + header->width*header->height;
+    return true;
+}
+
+bool validShare(const Share *share, const ShareFrame *frame) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return share->header->slots[frame->slot].seq.load(std::memory_order_relaxed) == frame->seq;
+}
+
+static Share *mapShare(const char *name, int fd, uint64_t size, bool writer) {
+    void *base = mmap(NULL, size, writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid without the descriptor
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+    Share *share = new Share;
+    share->name = name;
+    share->writer = writer;
+    share->size = size;
+    share->base = (uint8_t *) base;
+    share->header = (ShareHeader *) base;
+    return share;
+}
@@ -0,0 +1,94 @@
+#ifndef SHARE_H
+#define SHARE_H
+
+#include "quant.h"
+#include "sim.h"
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Generations kept in the ring. A reader looking at the latest one has this
+// many publishes before the writer comes back around to it.
+#define SHARE_SLOTS 4
+#define SHARE_VERSION 1
+
+// Per slot: the seqlock, odd while the writer is filling the slot, and what
+// the generation in it is
+typedef struct ShareSlot
+{
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> generation;
+    std::atomic<int64_t> step;
+    std::atomic<int64_t> fire_count;
+} ShareSlot;
+
+// Start of the shared memory object. Slot k's data is at data_offset +
+// k*slot_bytes: an intensity plane then a fuel plane, width*height bytes
+// each, both in burn steps as QuantGrid stores them.
+typedef struct ShareHeader
+{
+    char magic[4];
+    uint32_t version;
+    int64_t width;
+    int64_t height;
+    uint64_t data_offset;
+    uint64_t slot_bytes;
+    // Generations published so far; the latest is in slot (published-1) %
+    // SHARE_SLOTS
+    std::atomic<uint64_t> published;
+    ShareSlot slots[SHARE_SLOTS];
+} ShareHeader;
+
+// A mapping of the shared memory object, by the simulation that publishes
+// into it or by a viewer attached read-only.
+typedef struct Share
+{
+    std::string name;
+    bool writer;
+    uint64_t size;
+    uint8_t *base;
+    ShareHeader *header;
+} Share;
+
+// What a reader saw when it took a frame, to check afterwards that the
+// writer has not started overwriting it.
+typedef struct ShareFrame
+{
+    int slot;
+    uint64_t seq;
+    uint64_t generation;
+    int64_t step;
+    int64_t fire_count;
+    const uint8_t *intensity;
+    const uint8_t *fuel;
+} ShareFrame;
+
+// Creates (or replaces) the POSIX shared memory object name, e.g. "/firesim",
+// for a width x height grid. Returns NULL on failure.
+Share *newShare(const char *name, int64_t width, int64_t height);
+// Attaches read-only to an existing object. Returns NULL if there is none or
+// it is not a layout this build knows.
+Share *openShare(const char *name);
+// Unmaps; the writer also removes the object, which attached readers keep
+// until they close it.
+void freeShare(Share *share);
+
+// Publishing is a seqlock write into the slot after the latest, so it never
+// waits for readers. beginShare returns the slot's intensity plane (the fuel
+// plane follows it) to be filled, endShare makes it the latest generation.
+uint8_t *beginShare(Share *share);
+void endShare(Share *share, int step, int64_t fire_count);
+// Publish an engine's current state as one generation, from a quant grid or
+// a band covering the whole grid.
+void shareQuant(Share *share, const QuantGrid *quant, int step, int64_t fire_count);
+void shareBand(Share *share, const SimBand *band, int step, int64_t fire_count);
+
+// Takes the latest generation, pointing into shared memory rather than
+// copying it. Returns false if nothing is published yet or the writer is in
+// the middle of the slot; try again.
+bool readShare(const Share *share, ShareFrame *frame);
+// True if the frame's planes were not touched by the writer since readShare.
+// Readers check this after using them and drop the frame if not.
+bool validShare(const Share *share, const ShareFrame *frame);
+
+#endif
@@ -0,0 +1,181 @@
+#include "sim.h"
+#include "rng.h"
+#include "spot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+SimBand *newEmptyBand(int64_t width, int64_t first_row, int64_t rows) {
+    SimBand *band = (SimBand *) std::malloc(sizeof(SimBand));
+    if (band == NULL)
+        return NULL;
+    int64_t plane_size = (rows+2)*width;
+    band->width = width;
+    band->first_row = first_row;
+    band->rows = rows;
+    // calloc so the halo rows start out empty
+    band->intensity = (float *) std::calloc(plane_size, sizeof(float));
+    band->fuel = (float *) std::calloc(plane_size, sizeof(float));
+    band->next_intensity = (float *) std::calloc(plane_size, sizeof(float));
+    band->next_fuel = (float *) std::calloc(plane_size, sizeof(float));
+    band->row_fire = (int64_t *) std::calloc(rows+2, sizeof(int64_t));
+    band->next_row_fire = (int64_t *) std::calloc(rows+2, sizeof(int64_t));
+    band->row_settled = (char *) std::calloc(rows+2, sizeof(char));
+    band->arrival = NULL;
+    band->spotting = NULL;
+    band->spread = NULL;
+    if (band->intensity == NULL || band->fuel == NULL || band->next_intensity == NULL || band->next_fuel == NULL
+        || band->row_fire == NULL || band->next_row_fire == NULL || band->row_settled == NULL) {
+        freeBand(band);
+        return NULL;
+    }
+    return band;
+}
+
+SimBand *newBand(Vertex *grid, int64_t width, int64_t first_row, int64_t rows) {
+    SimBand *band = newEmptyBand(width, first_row, rows);
+    for (int64_t r = 1; r <= rows; r++) {
+        float *intensity = bandRow(band->intensity, band, r);
+        float *fuel = bandRow(band->fuel, band, r);
+        int64_t row_index = getGridIndex(first_row + r - 1, 0, width);
+        for (int64_t j = 0; j < width; j++) {
+            intensity[j] = grid[row_index + j*6].col[0];
+            fuel[j] = grid[row_index + j*6].col[1];
+        }
+    }
+    countBandFire(band);
+    return band;
+}
+
+void countBandFire(SimBand *band) {
+    for (int64_t r = 1; r <= band->rows; r++) {
+        const float *intensity = bandRow(band->intensity, band, r);
+        band->row_fire[r] = 0;
+        band->row_settled[r] = 0;
+        for (int64_t j = 0; j < band->width; j++) {
+            if (intensity[j] != 0)
+                band->row_fire[r]++;
+        }
+    }
+}
+
+void freeBand(SimBand *band) {
+    std::free(band->intensity);
+    std::free(band->fuel);
+    std::free(band->next_intensity);
+    std::free(band->next_fuel);
+    std::free(band->row_fire);
+    std::free(band->next_row_fire);
+    std::free(band->row_settled);
+    std::free(band);
+}
+
+// The synchronous form of updateGrid: instead of each burning tile pushing
+// ignitions onto its neighbors, each tile pulls the rolls its neighbors made
+// against it. A tile hit once takes its fuel as intensity, a tile hit again
+// (or hit while burning) goes out, exactly as the pushes would play out.
+int64_t stepBand(SimBand *band, float odds, uint64_t seed, int step) {
+    int64_t width = band->width;
+    int64_t fire_count = 0;
+    // Embers thrown this step, sorted, taken off the front as their tiles come up
+    const int64_t *landing = NULL, *landings_end = NULL;
+    if (band->spotting != NULL) {
+        throwEmbers(band->spotting, band, seed, step);
+        landing = band->spotting->landings.data();
+        landings_end = landing + band->spotting->landings.size();
+    }
+    const uint16_t *spread = band->spread;
+    auto spreads = [spread, odds, seed, step](uint64_t tile, int dir) {
+        if (spread == NULL)
+            return rngUniform(seed, step, tile, dir) < odds;
+        uint16_t threshold = spread[4*tile + dir];
+        return threshold == SPREAD_CERTAIN || rngHash(seed, step, tile, dir) >> 48 < threshold;
+    };
+    for (int64_t r = 1; r <= band->rows; r++) {
+        float *next_intensity = bandRow(band->next_intensity, band, r);
+        float *next_fuel = bandRow(band->next_fuel, band, r);
+        uint64_t row = band->first_row + r - 1;
+        bool landed = landing != landings_end && *landing < (int64_t) ((row+1)*width);
+        band->next_row_fire[r] = 0;
+        // Active set: a row with no fire in or next to it cannot change,
+        // unless an ember landed in it.
+        if (band->row_fire[r-1] == 0 && band->row_fire[r] == 0 && band->row_fire[r+1] == 0 && !landed) {
+            if (!band->row_settled[r]) {
+                memcpy(next_intensity, bandRow(band->intensity, band, r), sizeof(float)*width);
+                memcpy(next_fuel, bandRow(band->fuel, band, r), sizeof(float)*width);
+                band->row_settled[r] = 1;
+            }
+            continue;
+        }
+        band->row_settled[r] = 0;
+        fire_count += band->row_fire[r];
+
+        const float *below = bandRow(band->intensity, band, r-1);
+        const float *intensity = bandRow(band->intensity, band, r);
+        const float *above = bandRow(band->intensity, band, r+1);
+        const float *fuel = bandRow(band->fuel, band, r);
+        for (int64_t j = 0; j < width; j++) {
+            float cur = intensity[j];
+            float left_fuel = fuel[j];
+            int hits = 0;
+            if (j > 0 && intensity[j-1] != 0 && spreads(row*width + j-1, DIR_RIGHT))
+                hits++;
+            if (j < width-1 && intensity[j+1] != 0 && spreads(row*width + j+1, DIR_LEFT))
+                hits++;
+            if (below[j] != 0 && spreads((row-1)*width + j, DIR_UP))
+                hits++;
+            if (above[j] != 0 && spreads((row+1)*width + j, DIR_DOWN))
+                hits++;
+            while (landing != landings_end && *landing == (int64_t) (row*width + j)) {
+                hits++;
+                landing++;
+            }
+
+            if (cur != 0) {
+                cur -= 0.005;
+                if (cur < 0)
+                    cur = 0;
+            }
+            if (hits > 0) {
+                if (band->arrival != NULL && left_fuel != 0)
+                    setArrival(band->arrival, row*width + j, step + 1);
+                cur = hits == 1 ? left_fuel : 0;
+                left_fuel = 0;
+            }
+            next_intensity[j] = cur;
+            next_fuel[j] = left_fuel;
+            if (cur != 0)
+                band->next_row_fire[r]++;
+        }
+    }
+
+    float *swap = band->intensity;
+    band->intensity = band->next_intensity;
+    band->next_intensity = swap;
+    swap = band->fuel;
+    band->fuel = band->next_fuel;
+    band->next_fuel = swap;
+    for (int64_t r = 1; r <= band->rows; r++)
+        band->row_fire[r] = band->next_row_fire[r];
+    return fire_count;
+}
+
+void markBandRowsChanged(SimBand *band, int64_t first_row, int64_t last_row) {
+    int64_t first = first_row - band->first_row + 1, last = last_row - band->first_row + 1;
+    for (int64_t r = first < 1 ? 1 : first; r <= last && r <= band->rows; r++)
+        band->row_settled[r] = 0;
+}
+
+void writeBand(const SimBand *band, Vertex *grid) {
+    for (int64_t r = 1; r <= band->rows; r++) {
+        const float *intensity = bandRow(band->intensity, band, r);
+        const float *fuel = bandRow(band->fuel, band, r);
+        int64_t row_index = getGridIndex(band->first_row + r - 1, 0, band->width);
+        for (int64_t j = 0; j < band->width; j++) {
+            for (int v = 0; v < 6; v++) {
+                grid[row_index + j*6 + v].col[0] = intensity[j];
+                grid[row_index + j*6 + v].col[1] = fuel[j];
+            }
+        }
+    }
+}
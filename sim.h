@@ -0,0 +1,77 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "arrival.h"
+#include "grid.h"
+#include <stdint.h>
+
+// Roll directions, in the order updateGrid rolls them.
+enum {
+    DIR_LEFT = 0,
+    DIR_RIGHT = 1,
+    DIR_DOWN = 2,
+    DIR_UP = 3
+};
+
+struct Spotting;
+
+// A band of whole rows of the grid stored as separate intensity and fuel
+// planes, double-buffered so every tile reads the state at the start of the
+// step. Each plane has one halo row above and below the band (local rows 0 and
+// rows+1); the owned rows are local rows 1..rows. A band covering the whole
+// grid keeps its halos empty.
+typedef struct SimBand
+{
+    int64_t width;
+    int64_t first_row;
+    int64_t rows;
+    float *intensity;
+    float *fuel;
+    float *next_intensity;
+    float *next_fuel;
+    // Burning tiles per local row, halos included
+    int64_t *row_fire;
+    int64_t *next_row_fire;
+    // Rows that were skipped last step and hold the same data in both buffers
+    char *row_settled;
+    // When set, tiles of the band record their arrival step in it as they
+    // burn. Bands of one grid can share it.
+    ArrivalRaster *arrival;
+    // When set, burning tiles also throw embers (spot.h)
+    struct Spotting *spotting;
+    // When set, the odds of spreading from each tile of the whole grid to each
+    // neighbor, 4 a tile in DIR_ order, used instead of the odds stepBand is
+    // given (weather.h builds them). Each is a threshold t for odds t/65536,
+    // SPREAD_CERTAIN for odds 1.
+    const uint16_t *spread;
+} SimBand;
+
+// Spread thresholds are compared against the top 16 bits of the roll, so odds
+// of t/65536 spread exactly as often as the same odds given as a float
+#define SPREAD_CERTAIN 65535
+
+// Copies rows [first_row, first_row+rows) out of a Vertex grid width tiles wide.
+SimBand *newBand(Vertex *grid, int64_t width, int64_t first_row, int64_t rows);
+// A band with every plane zeroed, for callers that fill the planes themselves
+// instead of going through a Vertex grid. Call countBandFire once filled.
+// Returns NULL if the planes cannot be allocated.
+SimBand *newEmptyBand(int64_t width, int64_t first_row, int64_t rows);
+void countBandFire(SimBand *band);
+void freeBand(SimBand *band);
+// Advances the band one step of the synchronous model and returns the number
+// of tiles that were burning at the start of the step. Rolls are drawn from
+// the counter-based generator in rng.h, so a grid stepped as one band or as
+// many bands with exchanged halos evolves identically for the same seed.
+int64_t stepBand(SimBand *band, float odds, uint64_t seed, int step);
+// Copies the band's owned rows back into a Vertex grid.
+void writeBand(const SimBand *band, Vertex *grid);
+// Call after editing grid rows [first_row, last_row] of the planes between
+// steps (an overlay drawing into the fuel): rows the fire has left are only
+// copied into the other buffer once, and would lose the edit at the next swap.
+void markBandRowsChanged(SimBand *band, int64_t first_row, int64_t last_row);
+
+inline float *bandRow(float *plane, const SimBand *band, int64_t local_row) {
+    return plane + local_row*band->width;
+}
+
+#endif
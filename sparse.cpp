@@ -0,0 +1,535 @@
+#include "sparse.h"
+#include "quant.h"
+#include "rng.h"
+#include "sim.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_set>
+
+static SparseBlock *findBlock(const SparseGrid *sparse, int64_t block_i, int64_t block_j);
+static SparseBlock *allocBlock(SparseGrid *sparse, int64_t block_i, int64_t block_j);
+static void stepBlock(const SparseGrid *sparse, SparseBlock *block, float odds, uint64_t seed, int step,
+                      SparseWorker *worker);
+static void stepFrontier(const SparseGrid *sparse, SparseBlock *block, float odds, uint64_t seed, int step,
+                         SparseWorker *worker);
+static void stepTask(void *context, int64_t task, int worker);
+static uint8_t intensityAt(const SparseBlock *block, int r, int c);
+static void setBlockDense(SparseBlock *block, int dense);
+static void reachNeighbors(SparseGrid *sparse, SparseBlock *block);
+static void addBurned(SparseGrid *sparse, const std::vector<int64_t> &tiles, uint32_t arrived);
+
+SparseGrid *newSparse(int64_t width, int64_t height, SparseFuel fuel, void *context) {
+    SparseGrid *sparse = new SparseGrid;
+    int64_t blocks_wide = (width + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    int64_t blocks_high = (height + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    int64_t supers_high = (blocks_high + SPARSE_SUPER - 1) / SPARSE_SUPER;
+    sparse->width = width;
+    sparse->height = height;
+    sparse->supers_wide = (blocks_wide + SPARSE_SUPER - 1) / SPARSE_SUPER;
+    sparse->directory = (SparseSuper **) std::calloc(sparse->supers_wide*supers_high, sizeof(SparseSuper *));
+    sparse->fuel = fuel;
+    sparse->context = context;
+    // Starts with no room so the first block opens a slab
+    sparse->slab_used = SPARSE_SLAB;
+    sparse->supers = 0;
+    sparse->policy = SPARSE_ADAPTIVE;
+    sparse->scheduler = NULL;
+    sparse->workers.resize(1);
+    sparse->burned_log = NULL;
+    sparse->arrival = NULL;
+    sparse->stats = {0, 0, 0, 0, 0, height, -1, width, -1};
+    sparse->dense_blocks = 0;
+    sparse->frontier_blocks = 0;
+    sparse->to_dense = 0;
+    sparse->to_frontier = 0;
+    return sparse;
+}
+
+void freeSparse(SparseGrid *sparse) {
+    int64_t blocks_high = (sparse->height + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    int64_t supers_high = (blocks_high + SPARSE_SUPER - 1) / SPARSE_SUPER;
+    for (int64_t s = 0; s < sparse->supers_wide*supers_high; s++)
+        std::free(sparse->directory[s]);
+    std::free(sparse->directory);
+    for (SparseBlock *slab : sparse->slabs)
+        std::free(slab);
+    delete sparse;
+}
+
+void setSparsePolicy(SparseGrid *sparse, int policy) {
+    sparse->policy = policy;
+    for (SparseBlock *block : sparse->blocks) {
+        if (policy == SPARSE_DENSE)
+            setBlockDense(block, 1);
+        else if (policy == SPARSE_FRONTIER)
+            setBlockDense(block, 0);
+        else
+            setBlockDense(block, block->fire > SPARSE_FRONTIER_BELOW);
+    }
+}
+
+void setSparseScheduler(SparseGrid *sparse, Scheduler *scheduler) {
+    sparse->scheduler = scheduler;
+    sparse->workers.resize(scheduler ? scheduler->workers : 1);
+}
+
+void igniteSparse(SparseGrid *sparse, int64_t i, int64_t j, float intensity) {
+    int64_t block_i = i / SPARSE_BLOCK;
+    int64_t block_j = j / SPARSE_BLOCK;
+    SparseBlock *block = findBlock(sparse, block_i, block_j);
+    if (block == NULL)
+        block = allocBlock(sparse, block_i, block_j);
+    int64_t t = (i % SPARSE_BLOCK)*SPARSE_BLOCK + j % SPARSE_BLOCK;
+    if (block->intensity[block->current][t] == 0) {
+        block->fire++;
+        sparse->stats.burning++;
+        if (!block->dense)
+            block->frontier[block->frontier_size++] = t;
+    }
+    if (!(block->burned[t/64] >> (t%64) & 1)) {
+        block->burned[t/64] |= 1ULL << (t%64);
+        addBurned(sparse, std::vector<int64_t>(1, i*sparse->width + j), sparse->history.size());
+    }
+    block->intensity[block->current][t] = quantSteps(intensity);
+    block->fuel[t] = 0;
+    reachNeighbors(sparse, block);
+}
+
+typedef struct StepArgs
+{
+    SparseGrid *sparse;
+    SparseBlock **blocks;
+    float odds;
+    uint64_t seed;
+    int step;
+} StepArgs;
+
+// Only blocks with fire in or next to them are stepped; every other block
+// keeps its current buffer, which is still its state. Stepping a block writes
+// only to that block and its change list, so blocks are independent tasks.
+int64_t stepSparse(SparseGrid *sparse, float odds, uint64_t seed, int step) {
+    int64_t fire_count = 0;
+    std::vector<SparseBlock *> stepped;
+    for (SparseBlock *block : sparse->blocks) {
+        bool near_fire = block->fire != 0
+            || (block->left && block->left->fire != 0) || (block->right && block->right->fire != 0)
+            || (block->down && block->down->fire != 0) || (block->up && block->up->fire != 0);
+        if (!near_fire)
+            continue;
+        fire_count += block->fire;
+        stepped.push_back(block);
+    }
+    for (SparseWorker &worker : sparse->workers) {
+        worker.changes.clear();
+        worker.burned.clear();
+        worker.ignited = 0;
+        worker.extinguished = 0;
+    }
+    StepArgs args = {sparse, stepped.data(), odds, seed, step};
+    if (sparse->scheduler != NULL) {
+        runTasks(sparse->scheduler, stepped.size(), stepTask, &args);
+    } else {
+        for (int64_t task = 0; task < (int64_t) stepped.size(); task++)
+            stepTask(&args, task, 0);
+    }
+
+    std::vector<int64_t> burned;
+    for (const SparseWorker &worker : sparse->workers) {
+        for (const SparseChange &change : worker.changes)
+            change.block->intensity[change.block->current][change.tile] = change.intensity;
+        burned.insert(burned.end(), worker.burned.begin(), worker.burned.end());
+        sparse->stats.burning += worker.ignited - worker.extinguished;
+    }
+    double radius = sqrt(sparse->stats.burned / M_PI);
+    addBurned(sparse, burned, step + 1);
+    sparse->stats.front_velocity = sqrt(sparse->stats.burned / M_PI) - radius;
+    sparse->stats.step = step;
+    sparse->history.push_back(sparse->stats);
+    sparse->dense_blocks = 0;
+    sparse->frontier_blocks = 0;
+    sparse->to_dense = 0;
+    sparse->to_frontier = 0;
+    for (SparseBlock *block : stepped) {
+        if (block->dense) {
+            block->current ^= 1;
+            sparse->dense_blocks++;
+        } else {
+            sparse->frontier_blocks++;
+        }
+        block->fire = block->next_fire;
+        if (sparse->policy != SPARSE_ADAPTIVE)
+            continue;
+        if (!block->dense && block->fire > SPARSE_DENSE_ABOVE) {
+            setBlockDense(block, 1);
+            sparse->to_dense++;
+        } else if (block->dense && block->fire < SPARSE_FRONTIER_BELOW) {
+            setBlockDense(block, 0);
+            sparse->to_frontier++;
+        }
+    }
+    // Blocks allocated here start outside the fire, so the loop above would
+    // have skipped them anyway.
+    for (SparseBlock *block : stepped) {
+        if (block->fire != 0)
+            reachNeighbors(sparse, block);
+    }
+    return fire_count;
+}
+
+static void stepTask(void *context, int64_t task, int worker) {
+    StepArgs *args = (StepArgs *) context;
+    SparseBlock *block = args->blocks[task];
+    if (block->dense)
+        stepBlock(args->sparse, block, args->odds, args->seed, args->step, &args->sparse->workers[worker]);
+    else
+        stepFrontier(args->sparse, block, args->odds, args->seed, args->step, &args->sparse->workers[worker]);
+}
+
+// stepBand on one block. The block's current intensity and the facing edges of
+// its neighbors are gathered into a padded copy first so the loop below has no
+// block-boundary cases.
+static void stepBlock(const SparseGrid *sparse, SparseBlock *block, float odds, uint64_t seed, int step,
+                      SparseWorker *worker) {
+    const int pad = SPARSE_BLOCK + 2;
+    uint8_t padded[pad*pad];
+    memset(padded, 0, sizeof(padded));
+    const uint8_t *intensity = block->intensity[block->current];
+    for (int r = 0; r < SPARSE_BLOCK; r++)
+        memcpy(&padded[(r+1)*pad + 1], &intensity[r*SPARSE_BLOCK], SPARSE_BLOCK);
+    for (int k = 0; k < SPARSE_BLOCK; k++) {
+        if (block->left)
+            padded[(k+1)*pad] = block->left->intensity[block->left->current][k*SPARSE_BLOCK + SPARSE_BLOCK-1];
+        if (block->right)
+            padded[(k+1)*pad + pad-1] = block->right->intensity[block->right->current][k*SPARSE_BLOCK];
+        if (block->down)
+            padded[k+1] = block->down->intensity[block->down->current][(SPARSE_BLOCK-1)*SPARSE_BLOCK + k];
+        if (block->up)
+            padded[(pad-1)*pad + k+1] = block->up->intensity[block->up->current][k];
+    }
+
+    uint8_t *next_intensity = block->intensity[block->current ^ 1];
+    int64_t width = sparse->width;
+    int64_t next_fire = 0;
+    for (int r = 0; r < SPARSE_BLOCK; r++) {
+        uint64_t row = block->block_i*SPARSE_BLOCK + r;
+        uint64_t col = block->block_j*SPARSE_BLOCK;
+        const uint8_t *center = &padded[(r+1)*pad + 1];
+        const uint8_t *below = center - pad;
+        const uint8_t *above = center + pad;
+        for (int c = 0; c < SPARSE_BLOCK; c++) {
+            uint64_t tile = row*width + col + c;
+            uint8_t cur = center[c];
+            int hits = 0;
+            // Tiles past the grid's edge have no fuel and no fire, so rolls
+            // that land on them change nothing.
+            if (center[c-1] != 0 && rngUniform(seed, step, tile-1, DIR_RIGHT) < odds)
+                hits++;
+            if (center[c+1] != 0 && rngUniform(seed, step, tile+1, DIR_LEFT) < odds)
+                hits++;
+            if (below[c] != 0 && rngUniform(seed, step, tile-width, DIR_UP) < odds)
+                hits++;
+            if (above[c] != 0 && rngUniform(seed, step, tile+width, DIR_DOWN) < odds)
+                hits++;
+
+            int t = r*SPARSE_BLOCK + c;
+            uint8_t *fuel = &block->fuel[t];
+            if (cur != 0)
+                cur--;
+            if (hits > 0) {
+                if (*fuel != 0) {
+                    block->burned[t/64] |= 1ULL << (t%64);
+                    worker->burned.push_back(tile);
+                }
+                cur = hits == 1 ? *fuel : 0;
+                *fuel = 0;
+            }
+            worker->ignited += center[c] == 0 && cur != 0;
+            worker->extinguished += center[c] != 0 && cur == 0;
+            next_intensity[t] = cur;
+            if (cur != 0)
+                next_fire++;
+        }
+    }
+    block->next_fire = next_fire;
+}
+
+// The rule of stepBlock for only the tiles that can change: burning tiles,
+// their neighbors in the block, and edge tiles facing fire in a neighboring
+// block. New intensities are queued in changes because neighboring blocks
+// still read this block's current buffer during the step.
+static void stepFrontier(const SparseGrid *sparse, SparseBlock *block, float odds, uint64_t seed, int step,
+                         SparseWorker *worker) {
+    uint64_t marked[SPARSE_BLOCK*SPARSE_BLOCK/64] = {0};
+    uint16_t candidates[SPARSE_BLOCK*SPARSE_BLOCK];
+    int count = 0;
+    auto mark = [&](int r, int c) {
+        if (r < 0 || r >= SPARSE_BLOCK || c < 0 || c >= SPARSE_BLOCK)
+            return;
+        int t = r*SPARSE_BLOCK + c;
+        if (marked[t/64] >> (t%64) & 1)
+            return;
+        marked[t/64] |= 1ULL << (t%64);
+        candidates[count++] = t;
+    };
+    for (int f = 0; f < block->frontier_size; f++) {
+        int r = block->frontier[f] / SPARSE_BLOCK;
+        int c = block->frontier[f] % SPARSE_BLOCK;
+        mark(r, c);
+        mark(r, c-1);
+        mark(r, c+1);
+        mark(r-1, c);
+        mark(r+1, c);
+    }
+    for (int k = 0; k < SPARSE_BLOCK; k++) {
+        if (intensityAt(block, k, -1) != 0)
+            mark(k, 0);
+        if (intensityAt(block, k, SPARSE_BLOCK) != 0)
+            mark(k, SPARSE_BLOCK-1);
+        if (intensityAt(block, -1, k) != 0)
+            mark(0, k);
+        if (intensityAt(block, SPARSE_BLOCK, k) != 0)
+            mark(SPARSE_BLOCK-1, k);
+    }
+
+    const uint8_t *intensity = block->intensity[block->current];
+    int64_t width = sparse->width;
+    block->frontier_size = 0;
+    for (int n = 0; n < count; n++) {
+        int t = candidates[n];
+        int r = t / SPARSE_BLOCK;
+        int c = t % SPARSE_BLOCK;
+        uint64_t tile = (block->block_i*SPARSE_BLOCK + r)*width + block->block_j*SPARSE_BLOCK + c;
+        int hits = 0;
+        if (intensityAt(block, r, c-1) != 0 && rngUniform(seed, step, tile-1, DIR_RIGHT) < odds)
+            hits++;
+        if (intensityAt(block, r, c+1) != 0 && rngUniform(seed, step, tile+1, DIR_LEFT) < odds)
+            hits++;
+        if (intensityAt(block, r-1, c) != 0 && rngUniform(seed, step, tile-width, DIR_UP) < odds)
+            hits++;
+        if (intensityAt(block, r+1, c) != 0 && rngUniform(seed, step, tile+width, DIR_DOWN) < odds)
+            hits++;
+
+        uint8_t cur = intensity[t];
+        if (cur != 0)
+            cur--;
+        if (hits > 0) {
+            if (block->fuel[t] != 0) {
+                block->burned[t/64] |= 1ULL << (t%64);
+                worker->burned.push_back(tile);
+            }
+            cur = hits == 1 ? block->fuel[t] : 0;
+            block->fuel[t] = 0;
+        }
+        worker->ignited += intensity[t] == 0 && cur != 0;
+        worker->extinguished += intensity[t] != 0 && cur == 0;
+        if (cur != intensity[t])
+            worker->changes.push_back({block, (uint16_t) t, cur});
+        if (cur != 0)
+            block->frontier[block->frontier_size++] = t;
+    }
+    block->next_fire = block->frontier_size;
+}
+
+// Current intensity at (r, c) of the block, where r and c may step one tile
+// over the block's edge into a neighbor.
+static uint8_t intensityAt(const SparseBlock *block, int r, int c) {
+    if (c < 0)
+        return block->left ? block->left->intensity[block->left->current][r*SPARSE_BLOCK + SPARSE_BLOCK-1] : 0;
+    if (c >= SPARSE_BLOCK)
+        return block->right ? block->right->intensity[block->right->current][r*SPARSE_BLOCK] : 0;
+    if (r < 0)
+        return block->down ? block->down->intensity[block->down->current][(SPARSE_BLOCK-1)*SPARSE_BLOCK + c] : 0;
+    if (r >= SPARSE_BLOCK)
+        return block->up ? block->up->intensity[block->up->current][c] : 0;
+    return block->intensity[block->current][r*SPARSE_BLOCK + c];
+}
+
+// Folds tiles that burned in the same step into the statistics. An edge to a
+// tile burned earlier leaves the perimeter, an edge to an unburned tile joins
+// it, and an edge between two of the new tiles is inside the burned area.
+static void addBurned(SparseGrid *sparse, const std::vector<int64_t> &tiles, uint32_t arrived) {
+    FireStats *stats = &sparse->stats;
+    if (sparse->burned_log != NULL)
+        sparse->burned_log->insert(sparse->burned_log->end(), tiles.begin(), tiles.end());
+    if (sparse->arrival != NULL) {
+        for (int64_t tile : tiles)
+            setArrival(sparse->arrival, tile, arrived);
+    }
+    std::unordered_set<int64_t> fresh(tiles.begin(), tiles.end());
+    for (int64_t tile : tiles) {
+        int64_t i = tile / sparse->width;
+        int64_t j = tile % sparse->width;
+        const int64_t neighbors[4][2] = {{i, j-1}, {i, j+1}, {i-1, j}, {i+1, j}};
+        for (int n = 0; n < 4; n++) {
+            int64_t ni = neighbors[n][0], nj = neighbors[n][1];
+            if (ni < 0 || ni >= sparse->height || nj < 0 || nj >= sparse->width)
+                continue;
+            if (fresh.count(ni*sparse->width + nj))
+                continue;
+            stats->perimeter += sparseBurned(sparse, ni, nj) ? -1 : 1;
+        }
+        stats->burned++;
+        if (i < stats->min_i)
+            stats->min_i = i;
+        if (i > stats->max_i)
+            stats->max_i = i;
+        if (j < stats->min_j)
+            stats->min_j = j;
+        if (j > stats->max_j)
+            stats->max_j = j;
+    }
+}
+
+bool sparseBurned(const SparseGrid *sparse, int64_t i, int64_t j) {
+    const SparseBlock *block = findBlock(sparse, i / SPARSE_BLOCK, j / SPARSE_BLOCK);
+    if (block == NULL)
+        return false;
+    int t = (i % SPARSE_BLOCK)*SPARSE_BLOCK + j % SPARSE_BLOCK;
+    return block->burned[t/64] >> (t%64) & 1;
+}
+
+FireStats countSparseStats(const SparseGrid *sparse) {
+    FireStats stats = {sparse->stats.step, 0, 0, 0, sparse->stats.front_velocity,
+                       sparse->height, -1, sparse->width, -1};
+    for (const SparseBlock *block : sparse->blocks) {
+        for (int t = 0; t < SPARSE_BLOCK*SPARSE_BLOCK; t++) {
+            int64_t i = block->block_i*SPARSE_BLOCK + t / SPARSE_BLOCK;
+            int64_t j = block->block_j*SPARSE_BLOCK + t % SPARSE_BLOCK;
+            if (block->intensity[block->current][t] != 0)
+                stats.burning++;
+            if (!(block->burned[t/64] >> (t%64) & 1))
+                continue;
+            stats.burned++;
+            if (j > 0 && !sparseBurned(sparse, i, j-1))
+                stats.perimeter++;
+            if (j < sparse->width-1 && !sparseBurned(sparse, i, j+1))
+                stats.perimeter++;
+            if (i > 0 && !sparseBurned(sparse, i-1, j))
+                stats.perimeter++;
+            if (i < sparse->height-1 && !sparseBurned(sparse, i+1, j))
+                stats.perimeter++;
+            stats.min_i = i < stats.min_i ? i : stats.min_i;
+            stats.max_i = i > stats.max_i ? i : stats.max_i;
+            stats.min_j = j < stats.min_j ? j : stats.min_j;
+            stats.max_j = j > stats.max_j ? j : stats.max_j;
+        }
+    }
+    return stats;
+}
+
+static void setBlockDense(SparseBlock *block, int dense) {
+    if (!dense && block->dense) {
+        const uint8_t *intensity = block->intensity[block->current];
+        block->frontier_size = 0;
+        for (int t = 0; t < SPARSE_BLOCK*SPARSE_BLOCK; t++) {
+            if (intensity[t] != 0)
+                block->frontier[block->frontier_size++] = t;
+        }
+    }
+    block->dense = dense;
+}
+
+// Allocates the neighbors that fire on the block's edges could reach next step.
+static void reachNeighbors(SparseGrid *sparse, SparseBlock *block) {
+    const uint8_t *intensity = block->intensity[block->current];
+    bool left = false, right = false, down = false, up = false;
+    for (int k = 0; k < SPARSE_BLOCK; k++) {
+        left |= intensity[k*SPARSE_BLOCK] != 0;
+        right |= intensity[k*SPARSE_BLOCK + SPARSE_BLOCK-1] != 0;
+        down |= intensity[k] != 0;
+        up |= intensity[(SPARSE_BLOCK-1)*SPARSE_BLOCK + k] != 0;
+    }
+    int64_t block_i = block->block_i;
+    int64_t block_j = block->block_j;
+    if (left && !block->left && block_j > 0)
+        allocBlock(sparse, block_i, block_j - 1);
+    if (right && !block->right && (block_j+1)*SPARSE_BLOCK < sparse->width)
+        allocBlock(sparse, block_i, block_j + 1);
+    if (down && !block->down && block_i > 0)
+        allocBlock(sparse, block_i - 1, block_j);
+    if (up && !block->up && (block_i+1)*SPARSE_BLOCK < sparse->height)
+        allocBlock(sparse, block_i + 1, block_j);
+}
+
+static SparseBlock *findBlock(const SparseGrid *sparse, int64_t block_i, int64_t block_j) {
+    const SparseSuper *super = sparse->directory[(block_i / SPARSE_SUPER)*sparse->supers_wide + block_j / SPARSE_SUPER];
+    if (super == NULL)
+        return NULL;
+    return super->blocks[(block_i % SPARSE_SUPER)*SPARSE_SUPER + block_j % SPARSE_SUPER];
+}
+
+static SparseBlock *allocBlock(SparseGrid *sparse, int64_t block_i, int64_t block_j) {
+    SparseSuper **super = &sparse->directory[(block_i / SPARSE_SUPER)*sparse->supers_wide + block_j / SPARSE_SUPER];
+    if (*super == NULL) {
+        *super = (SparseSuper *) std::calloc(1, sizeof(SparseSuper));
+        sparse->supers++;
+    }
+    if (sparse->slab_used == SPARSE_SLAB) {
+        sparse->slabs.push_back((SparseBlock *) std::malloc(sizeof(SparseBlock)*SPARSE_SLAB));
+        sparse->slab_used = 0;
+    }
+    SparseBlock *block = &sparse->slabs.back()[sparse->slab_used++];
+    (*super)->blocks[(block_i % SPARSE_SUPER)*SPARSE_SUPER + block_j % SPARSE_SUPER] = block;
+    sparse->blocks.push_back(block);
+
+    block->block_i = block_i;
+    block->block_j = block_j;
+    block->current = 0;
+    block->dense = sparse->policy == SPARSE_DENSE;
+    block->frontier_size = 0;
+    block->fire = 0;
+    block->next_fire = 0;
+    memset(block->intensity, 0, sizeof(block->intensity));
+    memset(block->burned, 0, sizeof(block->burned));
+    for (int r = 0; r < SPARSE_BLOCK; r++) {
+        int64_t i = block_i*SPARSE_BLOCK + r;
+        for (int c = 0; c < SPARSE_BLOCK; c++) {
+            int64_t j = block_j*SPARSE_BLOCK + c;
+            bool inside = i < sparse->height && j < sparse->width;
+            block->fuel[r*SPARSE_BLOCK + c] = inside ? quantSteps(sparse->fuel(sparse->context, i, j)) : 0;
+        }
+    }
+
+    block->left = block_j > 0 ? findBlock(sparse, block_i, block_j - 1) : NULL;
+    block->right = (block_j+1)*SPARSE_BLOCK < sparse->width ? findBlock(sparse, block_i, block_j + 1) : NULL;
+    block->down = block_i > 0 ? findBlock(sparse, block_i - 1, block_j) : NULL;
+    block->up = (block_i+1)*SPARSE_BLOCK < sparse->height ? findBlock(sparse, block_i + 1, block_j) : NULL;
+    if (block->left)
+        block->left->right = block;
+    if (block->right)
+        block->right->left = block;
+    if (block->down)
+        block->down->up = block;
+    if (block->up)
+        block->up->down = block;
+    return block;
+}
+
+void writeSparse(const SparseGrid *sparse, Vertex *grid) {
+    for (const SparseBlock *block : sparse->blocks) {
+        const uint8_t *intensity = block->intensity[block->current];
+        for (int r = 0; r < SPARSE_BLOCK; r++) {
+            int64_t i = block->block_i*SPARSE_BLOCK + r;
+            for (int c = 0; c < SPARSE_BLOCK; c++) {
+                int64_t j = block->block_j*SPARSE_BLOCK + c;
+                if (i >= sparse->height || j >= sparse->width)
+                    continue;
+                int64_t index = getGridIndex(i, j, sparse->width);
+                for (int v = 0; v < 6; v++) {
+                    grid[index + v].col[0] = intensity[r*SPARSE_BLOCK + c]*QUANT_STEP;
+                    grid[index + v].col[1] = block->fuel[r*SPARSE_BLOCK + c]*QUANT_STEP;
+                }
+            }
+        }
+    }
+}
+
+int64_t sparseBytes(const SparseGrid *sparse) {
+    int64_t blocks_high = (sparse->height + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    int64_t supers_high = (blocks_high + SPARSE_SUPER - 1) / SPARSE_SUPER;
+    return (int64_t) sparse->slabs.size()*SPARSE_SLAB*sizeof(SparseBlock)
+        + sparse->supers*sizeof(SparseSuper)
+        + sparse->supers_wide*supers_high*sizeof(SparseSuper *);
+}
@@ -0,0 +1,140 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "arrival.h"
+#include "grid.h"
+#include "sched.h"
+#include "stats.h"
+#include <stdint.h>
+#include <vector>
+
+// Tiles per block side and blocks per superblock side
+#define SPARSE_BLOCK 64
+#define SPARSE_SUPER 16
+#define SPARSE_SLAB 256
+// A frontier block goes dense above this many burning tiles and a dense block
+// goes back below the second; the gap keeps blocks near the line from
+// switching every step.
+#define SPARSE_DENSE_ABOVE (SPARSE_BLOCK*SPARSE_BLOCK/8)
+#define SPARSE_FRONTIER_BELOW (SPARSE_BLOCK*SPARSE_BLOCK/32)
+
+// How blocks are stepped
+enum {
+    SPARSE_ADAPTIVE = 0,
+    SPARSE_DENSE = 1,
+    SPARSE_FRONTIER = 2
+};
+
+// Fuel of tile (i, j) for tiles that have not been allocated yet
+typedef float (*SparseFuel)(void *context, int64_t i, int64_t j);
+
+// A SPARSE_BLOCK x SPARSE_BLOCK piece of the grid in the byte-per-tile form of
+// quant.h. intensity[current] holds the state at the start of the step. A
+// dense block scans every tile into the other buffer and flips; a frontier
+// block only visits its burning tiles (frontier) and the tiles next to them,
+// and its changes are written into the current buffer once every block has
+// read it. Fuel only changes for the tile being updated, so it is stored once.
+typedef struct SparseBlock
+{
+    int64_t block_i;
+    int64_t block_j;
+    int current;
+    int dense;
+    int64_t fire;
+    int64_t next_fire;
+    int frontier_size;
+    uint16_t frontier[SPARSE_BLOCK*SPARSE_BLOCK];
+    // Neighboring blocks, NULL until allocated
+    struct SparseBlock *left, *right, *down, *up;
+    uint8_t intensity[2][SPARSE_BLOCK*SPARSE_BLOCK];
+    uint8_t fuel[SPARSE_BLOCK*SPARSE_BLOCK];
+    // One bit per tile the fire has taken the fuel of
+    uint64_t burned[SPARSE_BLOCK*SPARSE_BLOCK/64];
+} SparseBlock;
+
+typedef struct SparseSuper
+{
+    SparseBlock *blocks[SPARSE_SUPER*SPARSE_SUPER];
+} SparseSuper;
+
+typedef struct SparseChange
+{
+    SparseBlock *block;
+    uint16_t tile;
+    uint8_t intensity;
+} SparseChange;
+
+// What one worker saw change while stepping its blocks, reduced into the
+// grid's statistics after the step
+typedef struct SparseWorker
+{
+    std::vector<SparseChange> changes;
+    // Tile ids (i*width + j) that burned this step
+    std::vector<int64_t> burned;
+    int64_t ignited;
+    int64_t extinguished;
+} SparseWorker;
+
+// The synchronous model over a grid that is only stored where the fire has
+// been. Blocks are allocated from slabs the first time fire reaches the edge
+// next to them, and fill their fuel from fuel(context, i, j); everywhere else
+// the grid is implicitly unburnt. Lookups go through a directory with one
+// pointer per SPARSE_SUPER x SPARSE_SUPER blocks; superblocks are allocated
+// with their first block.
+typedef struct SparseGrid
+{
+    int64_t width;
+    int64_t height;
+    int64_t supers_wide;
+    SparseSuper **directory;
+    SparseFuel fuel;
+    void *context;
+    std::vector<SparseBlock *> blocks;
+    std::vector<SparseBlock *> slabs;
+    int slab_used;
+    int64_t supers;
+    int policy;
+    // Workers step blocks in parallel when set
+    Scheduler *scheduler;
+    std::vector<SparseWorker> workers;
+    // Kept up to date from the tiles that changed, never by recounting, and
+    // appended to history after every step
+    FireStats stats;
+    std::vector<FireStats> history;
+    // When set, every tile id that burns is appended to it
+    std::vector<int64_t> *burned_log;
+    // When set, tiles record their arrival step in it as they burn. Igniting
+    // counts as arriving after the steps taken so far.
+    ArrivalRaster *arrival;
+    // What the last step did, for instrumentation
+    int64_t dense_blocks;
+    int64_t frontier_blocks;
+    int64_t to_dense;
+    int64_t to_frontier;
+} SparseGrid;
+
+SparseGrid *newSparse(int64_t width, int64_t height, SparseFuel fuel, void *context);
+void freeSparse(SparseGrid *sparse);
+// Under SPARSE_ADAPTIVE (the default) each block switches between dense and
+// frontier stepping on its burning tile count, with hysteresis. The other two
+// pin every block to one strategy.
+void setSparsePolicy(SparseGrid *sparse, int policy);
+// Steps blocks as tasks on the scheduler's workers, one task per block near
+// fire, or serially again when scheduler is NULL.
+void setSparseScheduler(SparseGrid *sparse, Scheduler *scheduler);
+// Sets tile (i, j) burning with the given intensity and no fuel left.
+void igniteSparse(SparseGrid *sparse, int64_t i, int64_t j, float intensity);
+// Same contract as stepBand for a band covering the whole grid, and the same
+// outcome for the same seed.
+int64_t stepSparse(SparseGrid *sparse, float odds, uint64_t seed, int step);
+// Copies the allocated blocks into a Vertex grid, in floats as writeQuant does.
+void writeSparse(const SparseGrid *sparse, Vertex *grid);
+// Whether the fire has taken the fuel of tile (i, j).
+bool sparseBurned(const SparseGrid *sparse, int64_t i, int64_t j);
+// Statistics recounted from every allocated block, for checking stats. The
+// front velocity cannot be recounted and is copied.
+FireStats countSparseStats(const SparseGrid *sparse);
+// Bytes held by blocks and the directory.
+int64_t sparseBytes(const SparseGrid *sparse);
+
+#endif
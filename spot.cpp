@@ -0,0 +1,132 @@
+#include "spot.h"
+#include "rng.h"
+
+#include <math.h>
+#include <algorithm>
+#include <map>
+
+// Random streams for the launch roll and for where the ember lands
+#define SPOT_LAUNCH_STREAM 7
+#define SPOT_LAND_STREAM 8
+
+// Directions the distribution is tabulated at
+#define SPOT_SECTORS 32
+// Spread of the log distance
+const double SPOT_SIGMA = 0.5;
+
+static void buildAlias(Spotting *spotting, const std::vector<double> &weights);
+
+Spotting *newSpotting(const SpotParams *params) {
+    int min_distance = params->min_distance < 1 ? 1 : params->min_distance;
+    if (!(params->median_distance > 0) || params->max_distance < min_distance)
+        return NULL;
+    Spotting *spotting = new Spotting;
+    spotting->params = *params;
+    spotting->launched = 0;
+    spotting->landed = 0;
+
+    // Cells of (distance, direction) rounded to tiles, with the weights of
+    // cells that round to the same offset added together
+    double median = params->median_distance * (1 + params->wind_speed);
+    double kappa = 2*params->wind_speed;
+    std::map<std::pair<int, int>, double> cells;
+    for (int d = min_distance; d <= params->max_distance; d++) {
+        double z = (log((double) d) - log(median)) / SPOT_SIGMA;
+        double distance_weight = exp(-z*z/2) / d;
+        for (int s = 0; s < SPOT_SECTORS; s++) {
+            double theta = 2*M_PI*s/SPOT_SECTORS;
+            double weight = distance_weight * exp(kappa*cos(theta - params->wind_direction));
+            int di = lround(d*sin(theta));
+            int dj = lround(d*cos(theta));
+            cells[{di, dj}] += weight;
+        }
+    }
+    std::vector<double> weights;
+    double total = 0;
+    for (auto &cell : cells) {
+        spotting->offsets.push_back({cell.first.first, cell.first.second});
+        weights.push_back(cell.second);
+        total += cell.second;
+    }
+    // Distances so far from the median that every weight underflowed
+    if (!(total > 0 && total < INFINITY)) {
+        delete spotting;
+        return NULL;
+    }
+    buildAlias(spotting, weights);
+    return spotting;
+}
+
+void freeSpotting(Spotting *spotting) {
+    delete spotting;
+}
+
+void setBandSpotting(SimBand *band, Spotting *spotting) {
+    band->spotting = spotting;
+}
+
+// Only rows with fire in them are looked at, and only burning tiles roll.
+void throwEmbers(Spotting *spotting, const SimBand *band, uint64_t seed, int step) {
+    int64_t width = band->width;
+    spotting->landings.clear();
+    for (int64_t r = 1; r <= band->rows; r++) {
+        if (band->row_fire[r] == 0)
+            continue;
+        const float *intensity = bandRow(band->intensity, band, r);
+        uint64_t row = band->first_row + r - 1;
+        for (int64_t j = 0; j < width; j++) {
+            if (intensity[j] == 0)
+                continue;
+            uint64_t tile = row*width + j;
+            if (rngUniform(seed, step, tile, SPOT_LAUNCH_STREAM) >= spotting->params.launch_odds)
+                continue;
+            spotting->launched++;
+            SpotOffset offset = sampleSpot(spotting, rngHash(seed, step, tile, SPOT_LAND_STREAM));
+            int64_t i = r + offset.di;
+            int64_t to_j = j + offset.dj;
+            if (i < 1 || i > band->rows || to_j < 0 || to_j >= width)
+                continue;
+            // Only fuel catches; burning and burnt tiles ignore embers
+            if (bandRow(band->intensity, band, i)[to_j] != 0 || bandRow(band->fuel, band, i)[to_j] == 0)
+                continue;
+            spotting->landings.push_back((band->first_row + i - 1)*width + to_j);
+        }
+    }
+    spotting->landed += spotting->landings.size();
+    std::sort(spotting->landings.begin(), spotting->landings.end());
+}
+
+// Vose's method: scale the weights to average 1, then pair each offset below
+// 1 with one above to fill its slot up.
+static void buildAlias(Spotting *spotting, const std::vector<double> &weights) {
+    int64_t n = weights.size();
+    double total = 0;
+    for (double weight : weights)
+        total += weight;
+    std::vector<double> scaled(n);
+    std::vector<int64_t> small, large;
+    for (int64_t k = 0; k < n; k++) {
+        scaled[k] = weights[k] * n / total;
+        if (scaled[k] < 1)
+            small.push_back(k);
+        else
+            large.push_back(k);
+    }
+    spotting->keep.assign(n, UINT32_MAX);
+    spotting->alias.resize(n);
+    for (int64_t k = 0; k < n; k++)
+        spotting->alias[k] = k;
+    while (!small.empty() && !large.empty()) {
+        int64_t less = small.back();
+        small.pop_back();
+        int64_t more = large.back();
+        spotting->keep[less] = (uint32_t) (scaled[less] * 4294967296.);
+        spotting->alias[less] = more;
+        scaled[more] -= 1 - scaled[less];
+        if (scaled[more] < 1) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // Whatever is left is 1 up to rounding and always kept
+}
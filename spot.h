@@ -0,0 +1,76 @@
+#ifndef SPOT_H
+#define SPOT_H
+
+#include "sim.h"
+#include <stdint.h>
+#include <vector>
+
+// How burning tiles throw embers. Distances are in tiles.
+typedef struct SpotParams
+{
+    // Chance a burning tile throws an ember each step
+    float launch_odds;
+    // Direction the wind blows toward, in radians: 0 is toward +j (right),
+    // pi/2 toward +i (up)
+    float wind_direction;
+    // 0 is calm; embers go further and keep closer to downwind as it rises
+    float wind_speed;
+    // Median distance in calm air
+    float median_distance;
+    // Embers landing nearer than this are left to the neighbor rule, and none
+    // go further than max_distance
+    int min_distance;
+    int max_distance;
+} SpotParams;
+
+// One place an ember can land, relative to the tile that threw it
+typedef struct SpotOffset
+{
+    int32_t di;
+    int32_t dj;
+} SpotOffset;
+
+// Long-range spotting for a SimBand. The landing distribution is tabulated
+// once as offsets with an alias table over them, so picking where an ember
+// lands takes one random number and two lookups whatever the number of
+// offsets. Each step, stepBand has every burning tile roll for a launch and
+// counts each ember that lands on an unburnt tile as one more hit on it, with
+// the hits from its neighbors, so the ignite-once-put-out-twice rule and the
+// double buffering apply to embers unchanged. The cost is one roll per burning
+// tile plus the embers thrown.
+typedef struct Spotting
+{
+    SpotParams params;
+    std::vector<SpotOffset> offsets;
+    // Vose's alias table: offset k is kept if the low 32 random bits are
+    // below keep[k], otherwise alias[k] is taken
+    std::vector<uint32_t> keep;
+    std::vector<uint32_t> alias;
+    // Tiles (row*width + j) embers landed on this step, sorted
+    std::vector<int64_t> landings;
+    // Since the spotting was set up
+    int64_t launched;
+    int64_t landed;
+} Spotting;
+
+// The distance follows a lognormal around the median distance, stretched by
+// (1 + wind_speed); the direction a von Mises around the wind direction with
+// concentration 2*wind_speed. A Spotting belongs to one band, set with
+// setBandSpotting, which must cover the whole grid: embers landing outside
+// the band's rows are dropped. Returns NULL unless median_distance is
+// positive and max_distance reaches max(min_distance, 1), and so the table has
+// somewhere for embers to land.
+Spotting *newSpotting(const SpotParams *params);
+void freeSpotting(Spotting *spotting);
+void setBandSpotting(SimBand *band, Spotting *spotting);
+// Where an ember thrown with the 64 random bits lands
+inline SpotOffset sampleSpot(const Spotting *spotting, uint64_t random) {
+    uint64_t k = (random >> 32) * spotting->offsets.size() >> 32;
+    if ((uint32_t) random >= spotting->keep[k])
+        k = spotting->alias[k];
+    return spotting->offsets[k];
+}
+// Fills spotting->landings with this step's embers, for stepBand.
+void throwEmbers(Spotting *spotting, const SimBand *band, uint64_t seed, int step);
+
+#endif
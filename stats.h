@@ -0,0 +1,26 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Fire statistics after a step. A tile counts as burned once the fire has
+// taken its fuel, whether it ignited or was put out by a second hit before it
+// could. The perimeter counts the edges between burned and unburned tiles;
+// the grid's own border is not part of it.
+typedef struct FireStats
+{
+    int step;
+    int64_t burning;
+    int64_t burned;
+    int64_t perimeter;
+    // Growth over the step of the radius of a circle with the burned area,
+    // in tiles per step
+    double front_velocity;
+    // Bounding box of the burned tiles, inclusive; min > max while none are
+    int64_t min_i;
+    int64_t max_i;
+    int64_t min_j;
+    int64_t max_j;
+} FireStats;
+
+#endif
@@ -1,49 +1,281 @@
-#include <linmath.h>
+#include "grid.h"
+#include "event.h"
+#include "sim.h"
+#include "dist.h"
+#include "rng.h"
+#include "ensemble.h"
+#include "quant.h"
+#include "sparse.h"
+#include "perimeter.h"
+#include "arrival.h"
+#include "landscape.h"
+#include "server.h"
+#include "share.h"
+#include "frames.h"
+#include "writer.h"
+#include "batch.h"
+#include "spot.h"
+#include "weather.h"
+#include "overlay.h"
+#include <errno.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <string>
 #include <thread>
+#include <vector>
 #include <csignal>
 
 using namespace std::chrono_literals;
 
 
-typedef struct Vertex
-{
-    vec2 pos;
-    vec3 col;
-} Vertex;
-
-
-void startFire(Vertex *grid, int tile_count);
-int updateGrid(Vertex *grid, int tile_count);
-inline int getGridIndex(int i, int j, int tile_count);
-Vertex *genGrid(int tile_count);
+void startFire(Vertex *grid, int64_t width, int64_t height);
+int64_t updateGrid(Vertex *grid, int64_t width, int64_t height);
+Vertex *genGrid(int64_t width, int64_t height);
 void interruptHandler(int signum);
+void runEvent(Vertex *grid, int64_t width, int64_t height, int seeds);
+void measureBurn(const Vertex *grid, int64_t width, int64_t height, double *measures);
+int runSync(Vertex *grid, int64_t width, int64_t height);
+void runDist(int64_t width, int64_t height, int ranks);
+void checkDistRow(void *context, int64_t i, int64_t first_j, int64_t count, const float *intensity,
+                  const float *fuel);
+int squarestRows(int ranks);
+std::vector<DistIgnition> latticeIgnitions(int64_t width, int64_t height, int64_t spacing);
+void runBigCheck(int64_t width, int64_t height, int steps);
+void runEnsemble(Vertex *grid, int64_t width, int64_t height, int baseline_runs);
+void runQuant(Vertex *grid, int64_t width, int64_t height, int seeds);
+void runSparse(Vertex *grid, int64_t width, int64_t height);
+void runAdaptive(Vertex *grid, int64_t width, int64_t height);
+void runSteal(Vertex *grid, int64_t width, int64_t height, int workers);
+void runStats(Vertex *grid, int64_t width, int64_t height);
+void runPerimeter(Vertex *grid, int64_t width, int64_t height, int every);
+void runArrival(Vertex *grid, int64_t width, int64_t height);
+void runLandscape(int64_t width, int64_t height, int workers);
+void runServe(int workers);
+std::string askServer(const char *path, const std::string &request);
+void runShare(Vertex *grid, int64_t width, int64_t height, const char *name);
+uint64_t hashBytes(const uint8_t *bytes, int64_t count);
+void runFrames(Vertex *grid, int64_t width, int64_t height, int keyframe_every);
+void runWriter(Vertex *grid, int64_t width, int64_t height, int every);
+void runSweep(Vertex *grid, int64_t width, int64_t height, int seeds);
+void runConverge(Vertex *grid, int64_t width, int64_t height, int workers);
+void runSpot(Vertex *grid, int64_t width, int64_t height);
+void runWeather(Vertex *grid, int64_t width, int64_t height, int every);
+void runOverlay(Vertex *grid, int64_t width, int64_t height, int features);
+OverlayFeature randomFeature(int64_t width, int64_t height, uint64_t key);
+float gridFuel(void *context, int64_t i, int64_t j);
+float noiseFuel(void *context, int64_t i, int64_t j);
+std::ostream &mismatch();
+bool passed(bool ok);
 
-int max_us = 0;
-int total_us = 0;
-int counter = 0;
-int max_fire_count = 0;
+const float SCALE_FACTOR = 1.f/5.f;
+const uint64_t SEED = 1;
 
-int main() {
+int64_t max_us = 0;
+int64_t total_us = 0;
+int64_t counter = 0;
+int64_t max_fire_count = 0;
+// Checks that failed, so the bench exits non-zero for scripts to catch
+int64_t failed_checks = 0;
+
+int main(int argc, char **argv) {
     std::signal(SIGINT, interruptHandler);
 
-    int tile_count = 1000;
-    Vertex *grid = genGrid(tile_count);
-    startFire(grid, tile_count);
+    // -w and -h set the grid size, the remaining arguments pick the engine
+    int64_t width = 1000;
+    int64_t height = 1000;
+    std::vector<std::string> args;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "-w" && a+1 < argc)
+            width = atoll(argv[++a]);
+        else if (arg == "-h" && a+1 < argc)
+            height = atoll(argv[++a]);
+        else
+            args.push_back(arg);
+    }
+    std::string mode = args.empty() ? "" : args[0];
+
+    // ./bench big steps part of a grid with more than 2^31 tiles, which is
+    // too large to allocate whole here, and checks it against a reference
+    if (mode == "big") {
+        runBigCheck(50000, 50000, 300);
+        return failed_checks != 0;
+    }
+
+    // ./bench landscape N times genGrid against generating the grid on N
+    // workers, and generating 20k x 20k of fuel without the vertices
+    if (mode == "landscape") {
+        runLandscape(width, height, args.size() > 1 ? atoi(args[1].c_str()) : 4);
+        return failed_checks != 0;
+    }
+
+    // ./bench serve N starts the job server with N workers, sends it the
+    // same scenarios over its socket from several clients at once and checks
+    // each is run once, cached, and agrees with running it directly
+    if (mode == "serve") {
+        runServe(args.size() > 1 ? atoi(args[1].c_str()) : 2);
+        return failed_checks != 0;
+    }
+
+    // ./bench dist N checks N processes against the sync engine, as bands,
+    // columns and blocks, each building its own part of a landscape, then
+    // measures strong and weak scaling up to N ranks
+    if (mode == "dist" && args.size() > 1) {
+        runDist(width, height, atoi(args[1].c_str()));
+        return failed_checks != 0;
+    }
+
+    Vertex *grid = genGrid(width, height);
+    startFire(grid, width, height);
+
+    // ./bench event [N] runs the discrete-event engine instead of stepping,
+    // then compares what it burns over N seeds with the synchronous engine
+    // and the in-place sweep
+    if (mode == "event") {
+        runEvent(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 32);
+        return failed_checks != 0;
+    }
+    // ./bench sync steps the double-buffered engine
+    if (mode == "sync") {
+        runSync(grid, width, height);
+        return failed_checks != 0;
+    }
+    // ./bench ensemble [N] runs 64 realizations bit-sliced and compares the
+    // throughput with N realizations of updateGrid, 64 by default, and with
+    // the sync engine running one, after checking that at odds 1 every
+    // realization burns what the quant engine does
+    if (mode == "ensemble") {
+        runEnsemble(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : ENSEMBLE_LANES);
+        return failed_checks != 0;
+    }
+    // ./bench quant [N] steps the byte-per-tile engine next to the float one
+    // for N seeds and checks they agree
+    if (mode == "quant") {
+        runQuant(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 4);
+        return failed_checks != 0;
+    }
+    // ./bench sparse checks the lazily allocated engine against quant, then
+    // runs it on a domain far too big to allocate densely
+    if (mode == "sparse") {
+        runSparse(grid, width, height);
+        return failed_checks != 0;
+    }
+    // ./bench adaptive times the sparse engine with dense, frontier and
+    // switching blocks, and logs the switches
+    if (mode == "adaptive") {
+        runAdaptive(grid, width, height);
+        return failed_checks != 0;
+    }
+    // ./bench steal N steps the sparse engine on N work-stealing workers and
+    // checks it against stepping serially
+    if (mode == "steal" && args.size() > 1) {
+        runSteal(grid, width, height, atoi(args[1].c_str()));
+        return failed_checks != 0;
+    }
+    // ./bench stats prints the incrementally kept statistics and checks them
+    // against a full recount as it goes
+    if (mode == "stats") {
+        runStats(grid, width, height);
+        return failed_checks != 0;
+    }
+    // ./bench perimeter [N] keeps the perimeter up to date every step, writes
+    // it out every N steps, and checks it against tracing from scratch
+    if (mode == "perimeter") {
+        runPerimeter(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 50);
+        return failed_checks != 0;
+    }
+    // ./bench arrival records time of arrival in the float, quant and sparse
+    // engines, checks they agree and times the recording and the export
+    if (mode == "arrival") {
+        runArrival(grid, width, height);
+        return failed_checks != 0;
+    }
+    // ./bench share [name] publishes every step of the quant engine into
+    // shared memory (/firesim unless named) while another process reads it,
+    // times the publishing and checks that every frame the reader kept was
+    // whole. ./viewer can watch it meanwhile.
+    if (mode == "share") {
+        runShare(grid, width, height, args.size() > 1 ? args[1].c_str() : "/firesim");
+        return failed_checks != 0;
+    }
+    // ./bench frames [N] encodes every step of the quant engine as a frame
+    // stream with a keyframe every N frames, reports its size against full
+    // frames, and decodes it back to check it
+    if (mode == "frames") {
+        runFrames(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 1000);
+        return failed_checks != 0;
+    }
+    // ./bench writer [N] snapshots the planes and arrival every N steps and
+    // times the step loop writing them inline, through the async writer, and
+    // through it to storage slower than the snapshots come
+    if (mode == "writer") {
+        runWriter(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 10);
+        return failed_checks != 0;
+    }
+    // ./bench sweep [N] sweeps spread odds and burn rate over N seeds with
+    // common random numbers, one bit-sliced pass per seed and rate, checks
+    // lanes against separate quant runs and compares the variance of the
+    // differences between neighboring odds with independent runs
+    if (mode == "sweep") {
+        runSweep(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 16);
+        return failed_checks != 0;
+    }
+    // ./bench converge [N] runs ensembles on N workers until the burn
+    // probabilities and mean burned area are known to a target precision,
+    // compares with a fixed 1024 realizations, and checks the result does not
+    // depend on the worker count
+    if (mode == "converge") {
+        runConverge(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 2);
+        return failed_checks != 0;
+    }
+    // ./bench spot cuts a firebreak right of the fire and runs the band engine
+    // without and with ember spotting downwind, and checks spotting that never
+    // launches leaves the engine unchanged
+    if (mode == "spot") {
+        runSpot(grid, width, height);
+        return failed_checks != 0;
+    }
+    // ./bench weather [N] switches weather layers every N steps with the next
+    // spread table built ahead on a thread and built on demand, compares the
+    // step times around the switches, and checks calm dry weather steps like
+    // the fixed odds
+    if (mode == "weather") {
+        runWeather(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 100);
+        return failed_checks != 0;
+    }
+    // ./bench overlay [N] draws N random roads, dozer lines and areas into a
+    // landscape's fuel, edits and removes some, checks the result against
+    // drawing the final features from scratch, times the same on a grid ten
+    // times wider and higher, draws breaks into a band between steps and
+    // reads a feature file with a bad line
+    if (mode == "overlay") {
+        runOverlay(grid, width, height, args.size() > 1 ? atoi(args[1].c_str()) : 5000);
+        return failed_checks != 0;
+    }
 
     
     while (true) {
         auto start = std::chrono::high_resolution_clock::now();
-        int fire_count = updateGrid(grid, tile_count);
+        int64_t fire_count = updateGrid(grid, width, height);
         if (fire_count > max_fire_count)
             max_fire_count = fire_count;
         auto end =std::chrono::high_resolution_clock::now();
         auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
         auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration_us);
         if (counter % 60 == 0)
-            std::cout << "(" << (float)fire_count/1000000.f << ")\t" << duration_ms.count()  << "ms\t" << duration_us.count() << "us" << std::endl;
+            std::cout << "(" << (double)fire_count/(width*height) << ")\t" << duration_ms.count()  << "ms\t" << duration_us.count() << "us" << std::endl;
         
         if (duration_us.count() > max_us) 
             max_us = duration_us.count();
@@ -56,8 +288,8 @@ int main() {
 }
 
 
-void startFire(Vertex *grid, int tile_count) {
-    int start_index = getGridIndex(tile_count / 2, tile_count/2, tile_count);
+void startFire(Vertex *grid, int64_t width, int64_t height) {
+    int64_t start_index = getGridIndex(height / 2, width/2, width);
     // int start_index = vertex_count - 6;
     for (int i = 0; i < 6; i++) {
         grid[start_index+i].col[1] = 0;
@@ -65,38 +297,37 @@ void startFire(Vertex *grid, int tile_count) {
     }
 }
 
-int updateGrid(Vertex *grid, int tile_count) {
+int64_t updateGrid(Vertex *grid, int64_t width, int64_t height) {
     float fire_source_fuel;
-    float SCALE_FACTOR = 1.f/5.f;
-    int fire_count = 0;
-    for (int i = 0; i < tile_count; i++) {
-        int curRow = i*tile_count*2*3;
-        for (int j = 0; j < tile_count; j++) {
+    int64_t fire_count = 0;
+    for (int64_t i = 0; i < height; i++) {
+        int64_t curRow = i*width*2*3;
+        for (int64_t j = 0; j < width; j++) {
             float odds;
-            int src_index = curRow + j*6;
+            int64_t src_index = curRow + j*6;
             if ((fire_source_fuel = grid[src_index].col[0]) == 0)
                 continue;
             fire_count++;
             // Left
             if (j > 0) {
-                int target_index = getGridIndex(i, j-1, tile_count);
+                int64_t target_index = getGridIndex(i, j-1, width);
                 odds = SCALE_FACTOR;
                 // std::cout << "(" << i << ", " << j-1 << "): " << odds << std::endl;
                 if (((float)rand())/((float)RAND_MAX) < odds) {
                     for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
+                        int64_t vertex_index = target_index + v;
                         grid[vertex_index].col[0] = grid[vertex_index].col[1];
                         grid[vertex_index].col[1] = 0;
                     }
                 }
             }
             // Right
-            if (j < tile_count -1) {
-                int target_index = getGridIndex(i, j+1, tile_count);
+            if (j < width -1) {
+                int64_t target_index = getGridIndex(i, j+1, width);
                 odds = SCALE_FACTOR;
                 if (((float)rand())/((float)RAND_MAX) < odds) {
                     for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
+                        int64_t vertex_index = target_index + v;
                         grid[vertex_index].col[0] = grid[vertex_index].col[1];
                         grid[vertex_index].col[1] = 0;
                     }
@@ -104,23 +335,23 @@ int updateGrid(Vertex *grid, int tile_count) {
             }
             // Down
             if (i > 0) {
-                int target_index = getGridIndex(i-1, j, tile_count);
+                int64_t target_index = getGridIndex(i-1, j, width);
                 odds = SCALE_FACTOR;
                 if (((float)rand())/((float)RAND_MAX) < odds) {
                     for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
+                        int64_t vertex_index = target_index + v;
                         grid[vertex_index].col[0] = grid[vertex_index].col[1];
                         grid[vertex_index].col[1] = 0;
                     }
                 }
             }
             // Up
-            if (i < tile_count-1) {
-                int target_index = getGridIndex(i+1, j, tile_count);
+            if (i < height-1) {
+                int64_t target_index = getGridIndex(i+1, j, width);
                 odds = SCALE_FACTOR;
                 if (((float)rand())/((float)RAND_MAX) < odds) {
                     for (int v = 0; v < 6; v++) {
-                        int vertex_index = target_index + v;
+                        int64_t vertex_index = target_index + v;
                         grid[vertex_index].col[0] = grid[vertex_index].col[1];
                         grid[vertex_index].col[1] = 0;
                     }
@@ -141,38 +372,1774 @@ int updateGrid(Vertex *grid, int tile_count) {
     }
     return fire_count;
 }
-inline int getGridIndex(int i, int j, int tile_count) {
-    return i*tile_count*2*3+ j*6;
-}
-Vertex *genGrid(int tile_count) {
-    float increment = 2.0/tile_count;
-    Vertex *grid = (Vertex *) std::malloc(sizeof(Vertex)*2*3*tile_count*tile_count);
+Vertex *genGrid(int64_t width, int64_t height) {
+    float x_increment = 2.0/width;
+    float y_increment = 2.0/height;
+    Vertex *grid = (Vertex *) std::malloc(sizeof(Vertex)*2*3*width*height);
     // Generate fuel amount per tile
     srand( std::chrono::system_clock::now().time_since_epoch().count());
-    for (int i = 0; i < tile_count; i++) {
-        int curRow = i*tile_count*2*3;
-        float base_y = i*increment-1;
-        for (int j = 0; j < tile_count; j++) {
+    for (int64_t i = 0; i < height; i++) {
+        int64_t curRow = i*width*2*3;
+        float base_y = i*y_increment-1;
+        for (int64_t j = 0; j < width; j++) {
             float fuel = ((((float)rand())/((float)RAND_MAX))/ 2.f) + 0.5f;
 
-            float base_x = j*increment-1;
-            int start_index = curRow + j*6;
+            float base_x = j*x_increment-1;
+            int64_t start_index = curRow + j*6;
             // First Triangle
             grid[start_index] = {{base_x, base_y}, {0.f, fuel, 0.f}}; // Bottom left
-            grid[start_index+1] = {{base_x+increment, base_y}, {0.f, fuel, 0.f}}; // Top left
-            grid[start_index+2] = {{base_x, base_y+increment}, {0.f, fuel, 0.f}}; // Bottom right
+            grid[start_index+1] = {{base_x+x_increment, base_y}, {0.f, fuel, 0.f}}; // Top left
+            grid[start_index+2] = {{base_x, base_y+y_increment}, {0.f, fuel, 0.f}}; // Bottom right
             // Second Triangle
-            grid[start_index+3] = {{base_x+increment, base_y+increment}, {0.f, fuel, 0.f}}; // Top right
-            grid[start_index+4] = {{base_x+increment, base_y}, {0.f, fuel, 0.f}}; // Bottom right
-            grid[start_index+5] = {{base_x, base_y+increment}, {0.f, fuel, 0.f}}; // Top left
+            grid[start_index+3] = {{base_x+x_increment, base_y+y_increment}, {0.f, fuel, 0.f}}; // Top right
+            grid[start_index+4] = {{base_x+x_increment, base_y}, {0.f, fuel, 0.f}}; // Bottom right
+            grid[start_index+5] = {{base_x, base_y+y_increment}, {0.f, fuel, 0.f}}; // Top left
         }    
     }
     return grid;
 }
 
+void runEvent(Vertex *grid, int64_t width, int64_t height, int seeds) {
+    int *arrival = (int *) std::malloc(sizeof(int)*width*height);
+    auto start = std::chrono::high_resolution_clock::now();
+    int steps = eventFire(grid, width, height, SCALE_FACTOR, -1, arrival);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+    int64_t burned = 0;
+    for (int64_t tile = 0; tile < width*height; tile++) {
+        if (arrival[tile] >= 0)
+            burned++;
+    }
+    std::cout << "Steps: " << steps << "\tBurned: " << burned << std::endl;
+    std::cout << "Total: " << duration_us.count()/1000 << "ms\t" << duration_us.count() << "us" << std::endl;
+    std::free(arrival);
+
+    // The same fires on a smaller grid for a fixed number of steps, each seed
+    // on its own fuel, from the event engine, stepBand and the in-place
+    // updateGrid. The first two evaluate the synchronous model and should
+    // agree in distribution; the sweep lets tiles it has just ignited to the
+    // right and above roll again in the same step, so its fires run further
+    // that way.
+    const int64_t side = 401;
+    const int steps_run = 100;
+    const int engines = 3, measures = 5;
+    const char *engine_names[engines] = {"Event", "Sync", "In-place"};
+    const char *measure_names[measures] = {"burned", "left", "right", "down", "up"};
+    std::vector<double> sums(engines*measures), squares(engines*measures);
+    Vertex *fuel = (Vertex *) std::malloc(sizeof(Vertex)*6*side*side);
+    Vertex *copy = (Vertex *) std::malloc(sizeof(Vertex)*6*side*side);
+    for (int s = 0; s < seeds; s++) {
+        Vertex *generated = genGrid(side, side);
+        memcpy(fuel, generated, sizeof(Vertex)*6*side*side);
+        std::free(generated);
+        startFire(fuel, side, side);
+        for (int e = 0; e < engines; e++) {
+            memcpy(copy, fuel, sizeof(Vertex)*6*side*side);
+            srand(SEED + s);
+            if (e == 0) {
+                eventFire(copy, side, side, SCALE_FACTOR, steps_run, NULL);
+            } else if (e == 1) {
+                SimBand *band = newBand(copy, side, 0, side);
+                for (int step = 0; step < steps_run; step++)
+                    stepBand(band, SCALE_FACTOR, SEED + s, step);
+                writeBand(band, copy);
+                freeBand(band);
+            } else {
+                for (int step = 0; step < steps_run; step++)
+                    updateGrid(copy, side, side);
+            }
+            double measured[measures];
+            measureBurn(copy, side, side, measured);
+            for (int m = 0; m < measures; m++) {
+                sums[e*measures + m] += measured[m];
+                squares[e*measures + m] += measured[m]*measured[m];
+            }
+        }
+    }
+    std::free(fuel);
+    std::free(copy);
+
+    // Differences in means over their standard error; the event and sync
+    // engines should stay within a few of each other
+    int64_t disagreements = 0;
+    std::cout << seeds << " seeds, " << steps_run << " steps on " << side << " x " << side << ", mean (sd):" << std::endl;
+    for (int e = 0; e < engines; e++) {
+        std::cout << engine_names[e];
+        for (int m = 0; m < measures; m++) {
+            double mean = sums[e*measures + m] / seeds;
+            double sd = sqrt(std::max(0.0, squares[e*measures + m] / seeds - mean*mean));
+            std::cout << "\t" << measure_names[m] << " " << mean << " (" << sd << ")";
+        }
+        std::cout << std::endl;
+    }
+    for (int e = 1; e < engines; e++) {
+        std::cout << "Event against " << engine_names[e] << ", z:";
+        for (int m = 0; m < measures; m++) {
+            double mean0 = sums[m] / seeds, mean1 = sums[e*measures + m] / seeds;
+            double var0 = std::max(0.0, squares[m] / seeds - mean0*mean0);
+            double var1 = std::max(0.0, squares[e*measures + m] / seeds - mean1*mean1);
+            double error = sqrt((var0 + var1) / seeds);
+            double z = error > 0 ? (mean0 - mean1) / error : 0;
+            std::cout << "\t" << measure_names[m] << " " << z;
+            if (e == 1 && fabs(z) > 4)
+                disagreements++;
+        }
+        std::cout << std::endl;
+    }
+    if (disagreements != 0)
+        mismatch() << "event and sync engines differ in " << disagreements << " measures" << std::endl;
+    else
+        std::cout << "Event and sync engines agree in distribution" << std::endl;
+}
+
+// Tiles whose fuel was taken, then how far the burn reached from the middle
+// tile startFire lights to the left, right, down and up.
+void measureBurn(const Vertex *grid, int64_t width, int64_t height, double *measures) {
+    int64_t burned = 0, min_i = height/2, max_i = height/2, min_j = width/2, max_j = width/2;
+    for (int64_t i = 0; i < height; i++) {
+        for (int64_t j = 0; j < width; j++) {
+            if (grid[getGridIndex(i, j, width)].col[1] != 0)
+                continue;
+            burned++;
+            min_i = std::min(min_i, i);
+            max_i = std::max(max_i, i);
+            min_j = std::min(min_j, j);
+            max_j = std::max(max_j, j);
+        }
+    }
+    measures[0] = burned;
+    measures[1] = width/2 - min_j;
+    measures[2] = max_j - width/2;
+    measures[3] = height/2 - min_i;
+    measures[4] = max_i - height/2;
+}
+
+int runSync(Vertex *grid, int64_t width, int64_t height) {
+    SimBand *band = newBand(grid, width, 0, height);
+    int steps = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    while (stepBand(band, SCALE_FACTOR, SEED, steps) != 0)
+        steps++;
+    steps++;
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    writeBand(band, grid);
+    freeBand(band);
+    std::cout << "Sync steps: " << steps << "\t" << duration_us.count()/1000 << "ms\t"
+              << duration_us.count()/steps << "us/step" << std::endl;
+    return steps;
+}
+
+// Rows distFire hands back, checked against a grid stepped in one process
+typedef struct DistCheck
+{
+    const Vertex *reference;
+    int64_t width;
+    int64_t tiles;
+    int64_t mismatches;
+} DistCheck;
+
+void checkDistRow(void *context, int64_t i, int64_t first_j, int64_t count, const float *intensity,
+                  const float *fuel) {
+    DistCheck *check = (DistCheck *) context;
+    for (int64_t k = 0; k < count; k++) {
+        const Vertex *tile = &check->reference[getGridIndex(i, first_j + k, check->width)];
+        if (tile->col[0] != intensity[k] || tile->col[1] != fuel[k])
+            check->mismatches++;
+    }
+    check->tiles += count;
+}
+
+// The most nearly square rank_rows x rank_cols with rank_rows <= rank_cols
+int squarestRows(int ranks) {
+    int rows = 1;
+    for (int r = 1; r*r <= ranks; r++) {
+        if (ranks % r == 0)
+            rows = r;
+    }
+    return rows;
+}
+
+// Fires every spacing tiles each way, so the work is spread over the grid
+std::vector<DistIgnition> latticeIgnitions(int64_t width, int64_t height, int64_t spacing) {
+    std::vector<DistIgnition> ignitions;
+    for (int64_t i = spacing/2; i < height; i += spacing) {
+        for (int64_t j = spacing/2; j < width; j += spacing)
+            ignitions.push_back({i, j, 1});
+    }
+    return ignitions;
+}
+
+void runDist(int64_t width, int64_t height, int ranks) {
+    // Ranks build their blocks from the noise; the reference is the same
+    // landscape whole, stepped as one band
+    FuelNoise noise = clumpedFuelNoise(SEED, 16);
+    Vertex *reference = genLandscape(width, height, &noise, NULL);
+    startFire(reference, width, height);
+    int sync_steps = runSync(reference, width, height);
+    DistScenario scenario = {width, height, fuelNoiseAt, &noise, {{height/2, width/2, 1}}, SCALE_FACTOR, SEED};
+
+    int square_rows = squarestRows(ranks);
+    int layouts[3][2] = {{ranks, 1}, {1, ranks}, {square_rows, ranks/square_rows}};
+    for (int l = 0; l < 3; l++) {
+        int rank_rows = layouts[l][0], rank_cols = layouts[l][1];
+        if (l == 2 && (rank_rows == 1 || rank_cols == 1))
+            break;
+        DistCheck check = {reference, width, 0, 0};
+        DistStats stats;
+        auto start = std::chrono::high_resolution_clock::now();
+        int steps = distFire(&scenario, rank_rows, rank_cols, -1, checkDistRow, &check, &stats);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        std::cout << rank_rows << " x " << rank_cols << " ranks: " << steps << " steps\t"
+                  << duration_us.count()/1000 << "ms\tedge messages: " << stats.messages << " (" << stats.bytes
+                  << " bytes)\tskipped: " << stats.skipped << "\treports: " << stats.reports << std::endl;
+        if (steps != sync_steps || check.tiles != width*height || check.mismatches != 0)
+            mismatch() << check.mismatches << " tiles differ, " << check.tiles << " returned" << std::endl;
+        else
+            std::cout << "Identical" << std::endl;
+    }
+    std::free(reference);
+
+    // Strong scaling: the same grid with a fire every 125 tiles on more and
+    // more ranks. Weak scaling: a 250 x 250 block per rank with the same fires,
+    // so each rank has the same work however many there are. Both for a fixed
+    // number of steps, nearly square layouts.
+    const int steps = 100;
+    const int64_t block = 250, spacing = 125;
+    std::cout << "Scaling over " << steps << " steps on " << std::thread::hardware_concurrency() << " CPUs" << std::endl;
+    std::cout << "ranks\tstrong ms\tspeedup\tefficiency\tweak grid\tweak ms\tefficiency" << std::endl;
+    int64_t strong_one = 0, weak_one = 0;
+    for (int p = 1; p <= ranks; p = p < ranks && 2*p > ranks ? ranks : 2*p) {
+        int rank_rows = squarestRows(p), rank_cols = p/rank_rows;
+        DistScenario strong = {width, height, fuelNoiseAt, &noise, latticeIgnitions(width, height, spacing),
+                               SCALE_FACTOR, SEED};
+        auto start = std::chrono::high_resolution_clock::now();
+        distFire(&strong, rank_rows, rank_cols, steps, NULL, NULL, NULL);
+        auto end = std::chrono::high_resolution_clock::now();
+        int64_t strong_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        int64_t weak_height = rank_rows*block, weak_width = rank_cols*block;
+        DistScenario weak = {weak_width, weak_height, fuelNoiseAt, &noise,
+                             latticeIgnitions(weak_width, weak_height, spacing), SCALE_FACTOR, SEED};
+        start = std::chrono::high_resolution_clock::now();
+        distFire(&weak, rank_rows, rank_cols, steps, NULL, NULL, NULL);
+        end = std::chrono::high_resolution_clock::now();
+        int64_t weak_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (p == 1) {
+            strong_one = strong_us;
+            weak_one = weak_us;
+        }
+        std::cout << p << "\t" << strong_us/1000 << "\t\t" << (double) strong_one/strong_us << "\t"
+                  << (double) strong_one/strong_us/p << "\t\t" << weak_height << " x " << weak_width << "\t"
+                  << weak_us/1000 << "\t" << (double) weak_one/weak_us << std::endl;
+        if (p == ranks)
+            break;
+    }
+}
+
+void runEnsemble(Vertex *grid, int64_t width, int64_t height, int baseline_runs) {
+    Ensemble *ensemble = newEnsemble(grid, width, height);
+    int steps = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    while (stepEnsemble(ensemble, SCALE_FACTOR, SEED, steps) != 0)
+        steps++;
+    steps++;
+    auto end = std::chrono::high_resolution_clock::now();
+    auto ensemble_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    uint8_t *counts = (uint8_t *) std::malloc(width*height);
+    ensembleBurnCounts(ensemble, counts);
+    int64_t burned = 0;
+    for (int64_t tile = 0; tile < width*height; tile++)
+        burned += counts[tile];
+    std::free(counts);
+    freeEnsemble(ensemble);
+
+    // At odds 1 every roll spreads, so each lane must burn exactly what the
+    // quant engine does, which is more than the fire started with
+    ensemble = newEnsemble(grid, width, height);
+    for (int step = 0; stepEnsemble(ensemble, 1, SEED, step) != 0; step++)
+        ;
+    int64_t lanes[ENSEMBLE_LANES];
+    ensembleLaneBurned(ensemble, lanes);
+    freeEnsemble(ensemble);
+    QuantGrid *quant = newQuant(grid, width, height);
+    for (int step = 0; stepQuant(quant, 1, SEED, step) != 0; step++)
+        ;
+    int64_t quant_burned = 0, started = 0;
+    for (int64_t i = 0; i < height; i++) {
+        const uint8_t *fuel = quantRow(quant->fuel, quant, i);
+        for (int64_t j = 0; j < width; j++) {
+            const Vertex *vertex = &grid[getGridIndex(i, j, width)];
+            quant_burned += fuel[j] == 0 && (vertex->col[0] != 0 || vertex->col[1] != 0);
+            started += vertex->col[0] != 0;
+        }
+    }
+    freeQuant(quant);
+    int64_t certain_mismatches = 0;
+    for (int k = 0; k < ENSEMBLE_LANES; k++)
+        certain_mismatches += lanes[k] != quant_burned;
+    std::cout << "At odds 1: " << lanes[0] << " burned per realization\tQuant: " << quant_burned
+              << "\tStarted burning: " << started << std::endl;
+    if (certain_mismatches != 0 || quant_burned <= started)
+        mismatch() << certain_mismatches << " lanes differ at odds 1" << std::endl;
+
+    // The baseline: updateGrid run once per realization, each on its own
+    // copy of the grid with its own rand() seed
+    Vertex *copy = (Vertex *) std::malloc(sizeof(Vertex)*6*width*height);
+    int64_t baseline_steps = 0, baseline_us = 0;
+    for (int run = 0; run < baseline_runs; run++) {
+        memcpy(copy, grid, sizeof(Vertex)*6*width*height);
+        srand(SEED + run);
+        start = std::chrono::high_resolution_clock::now();
+        while (updateGrid(copy, width, height) != 0)
+            baseline_steps++;
+        baseline_steps++;
+        end = std::chrono::high_resolution_clock::now();
+        baseline_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+    std::free(copy);
+
+    start = std::chrono::high_resolution_clock::now();
+    int sync_steps = runSync(grid, width, height);
+    end = std::chrono::high_resolution_clock::now();
+    auto sync_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    int64_t sync_burned = 0;
+    for (int64_t tile = 0; tile < width*height; tile++) {
+        if (grid[tile*6].col[1] == 0)
+            sync_burned++;
+    }
+
+    double ensemble_rate = (double)steps*ENSEMBLE_LANES / ensemble_us * 1e6;
+    double sync_rate = (double)sync_steps / sync_us * 1e6;
+    std::cout << "Ensemble steps: " << steps << "\t" << ensemble_us/1000 << "ms\t"
+              << (int64_t)ensemble_rate << " realization-steps/s" << std::endl;
+    if (baseline_runs > 0) {
+        double baseline_rate = (double)baseline_steps / baseline_us * 1e6;
+        std::cout << "updateGrid x" << baseline_runs << ": " << baseline_steps << " steps\t"
+                  << baseline_us/1000 << "ms\t" << (int64_t)baseline_rate << " realization-steps/s\tSpeedup: "
+                  << ensemble_rate / baseline_rate << "x" << std::endl;
+    }
+    std::cout << "Sync: " << (int64_t)sync_rate << " realization-steps/s\tSpeedup: "
+              << ensemble_rate / sync_rate << "x" << std::endl;
+    std::cout << "Burned per realization: " << (double)burned/ENSEMBLE_LANES
+              << "\tSync: " << sync_burned << std::endl;
+}
+
+void runQuant(Vertex *grid, int64_t width, int64_t height, int seeds) {
+    int64_t float_us = 0, quant_us = 0;
+    double float_burned = 0, quant_burned = 0;
+    int64_t mismatches = 0;
+    for (uint64_t seed = SEED; seed < SEED + seeds; seed++) {
+        SimBand *band = newBand(grid, width, 0, height);
+        QuantGrid *quant = newQuant(grid, width, height);
+        for (int step = 0; ; step++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            int64_t float_fire = stepBand(band, SCALE_FACTOR, seed, step);
+            auto mid = std::chrono::high_resolution_clock::now();
+            int64_t quant_fire = stepQuant(quant, SCALE_FACTOR, seed, step);
+            auto end = std::chrono::high_resolution_clock::now();
+            float_us += std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count();
+            quant_us += std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count();
+            if (float_fire != quant_fire)
+                mismatches++;
+            if (float_fire == 0 && quant_fire == 0)
+                break;
+        }
+        for (int64_t i = 0; i < height; i++) {
+            const float *fuel = bandRow(band->fuel, band, i+1);
+            const uint8_t *quant_fuel = quantRow(quant->fuel, quant, i);
+            for (int64_t j = 0; j < width; j++) {
+                bool burned = grid[getGridIndex(i, j, width)].col[1] != 0 && fuel[j] == 0;
+                bool quant_burned_tile = grid[getGridIndex(i, j, width)].col[1] != 0 && quant_fuel[j] == 0;
+                float_burned += burned;
+                quant_burned += quant_burned_tile;
+                if (burned != quant_burned_tile)
+                    mismatches++;
+            }
+        }
+        freeBand(band);
+        freeQuant(quant);
+    }
+    std::cout << "Float: " << float_us/1000 << "ms\tQuant: " << quant_us/1000 << "ms\tSpeedup: "
+              << (double)float_us/quant_us << "x" << std::endl;
+    std::cout << "Burned per seed: " << float_burned/seeds << "\tQuant: " << quant_burned/seeds << std::endl;
+    if (mismatches != 0)
+        mismatch() << mismatches << " steps or tiles differ" << std::endl;
+    else
+        std::cout << "Identical over " << seeds << " seeds" << std::endl;
+}
+
+typedef struct GridFuel
+{
+    Vertex *grid;
+    int64_t width;
+} GridFuel;
+
+float gridFuel(void *context, int64_t i, int64_t j) {
+    GridFuel *grid_fuel = (GridFuel *) context;
+    return grid_fuel->grid[getGridIndex(i, j, grid_fuel->width)].col[1];
+}
+
+// genGrid's fuel range from the counter generator, so any tile can be asked for
+float noiseFuel(void *context, int64_t i, int64_t j) {
+    int64_t width = *(int64_t *) context;
+    return 0.5f + rngUniform(SEED, 0, i*width + j, 4)/2.f;
+}
+
+void runSparse(Vertex *grid, int64_t width, int64_t height) {
+    GridFuel grid_fuel = {grid, width};
+    QuantGrid *quant = newQuant(grid, width, height);
+    SparseGrid *sparse = newSparse(width, height, gridFuel, &grid_fuel);
+    igniteSparse(sparse, height/2, width/2, 1);
+    int64_t mismatches = 0;
+    int steps = 0;
+    for (;; steps++) {
+        int64_t quant_fire = stepQuant(quant, SCALE_FACTOR, SEED, steps);
+        int64_t sparse_fire = stepSparse(sparse, SCALE_FACTOR, SEED, steps);
+        if (quant_fire != sparse_fire)
+            mismatches++;
+        if (quant_fire == 0 && sparse_fire == 0)
+            break;
+    }
+    int64_t vertex_count = width*height*2*3;
+    Vertex *quant_grid = (Vertex *) std::malloc(sizeof(Vertex)*vertex_count);
+    memcpy(quant_grid, grid, sizeof(Vertex)*vertex_count);
+    writeQuant(quant, quant_grid);
+    writeSparse(sparse, grid);
+    for (int64_t v = 0; v < vertex_count; v++) {
+        if (grid[v].col[0] != quant_grid[v].col[0] || grid[v].col[1] != quant_grid[v].col[1])
+            mismatches++;
+    }
+    std::cout << "Sparse steps: " << steps << "\t" << sparse->blocks.size() << " blocks\t"
+              << sparseBytes(sparse)/1000000 << "MB" << std::endl;
+    if (mismatches != 0)
+        mismatch() << mismatches << " steps or vertices differ" << std::endl;
+    else
+        std::cout << "Identical to quant" << std::endl;
+    std::free(quant_grid);
+    freeQuant(quant);
+    freeSparse(sparse);
+
+    // A million tiles on a side would take 24TB as Vertices
+    int64_t side = 1000000;
+    auto start = std::chrono::high_resolution_clock::now();
+    sparse = newSparse(side, side, noiseFuel, &side);
+    igniteSparse(sparse, side/2, side/2, 1);
+    int64_t fire_count = 0;
+    for (int step = 0; step < 600; step++)
+        fire_count = stepSparse(sparse, SCALE_FACTOR, SEED, step);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    std::cout << side << "x" << side << ", 600 steps: " << duration_ms.count() << "ms\t"
+              << fire_count << " burning\t" << sparse->blocks.size() << " blocks\t"
+              << sparseBytes(sparse)/1000000 << "MB" << std::endl;
+    freeSparse(sparse);
+}
+
+void runAdaptive(Vertex *grid, int64_t width, int64_t height) {
+    const char *names[] = {"Adaptive", "Dense", "Frontier"};
+    GridFuel grid_fuel = {grid, width};
+    std::vector<int64_t> fire_counts[3];
+    for (int policy = SPARSE_ADAPTIVE; policy <= SPARSE_FRONTIER; policy++) {
+        SparseGrid *sparse = newSparse(width, height, gridFuel, &grid_fuel);
+        setSparsePolicy(sparse, policy);
+        igniteSparse(sparse, height/2, width/2, 1);
+        int64_t total_us = 0, window_us = 0;
+        int64_t to_dense = 0, to_frontier = 0;
+        for (int step = 0; ; step++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            int64_t fire_count = stepSparse(sparse, SCALE_FACTOR, SEED, step);
+            auto end = std::chrono::high_resolution_clock::now();
+            int64_t duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            total_us += duration_us;
+            window_us += duration_us;
+            to_dense += sparse->to_dense;
+            to_frontier += sparse->to_frontier;
+            fire_counts[policy].push_back(fire_count);
+            if (policy == SPARSE_ADAPTIVE && step % 120 == 0) {
+                std::cout << "(" << (double)fire_count/(width*height) << ")\t" << window_us/120 << "us/step\t"
+                          << sparse->dense_blocks << " dense\t" << sparse->frontier_blocks << " frontier\t+"
+                          << to_dense << " to dense\t+" << to_frontier << " to frontier" << std::endl;
+                window_us = 0;
+                to_dense = 0;
+                to_frontier = 0;
+            }
+            if (fire_count == 0)
+                break;
+        }
+        std::cout << names[policy] << ": " << fire_counts[policy].size() << " steps\t"
+                  << total_us/1000 << "ms" << std::endl;
+        freeSparse(sparse);
+    }
+    if (fire_counts[SPARSE_DENSE] != fire_counts[SPARSE_ADAPTIVE] || fire_counts[SPARSE_FRONTIER] != fire_counts[SPARSE_ADAPTIVE])
+        mismatch() << "fire counts differ between policies" << std::endl;
+    else
+        std::cout << "Identical" << std::endl;
+}
+
+void runSteal(Vertex *grid, int64_t width, int64_t height, int workers) {
+    GridFuel grid_fuel = {grid, width};
+    Scheduler *scheduler = newScheduler(workers);
+    std::vector<int64_t> executed(workers, 0), stolen(workers, 0);
+    std::vector<int64_t> fire_counts[2];
+    for (int parallel = 0; parallel < 2; parallel++) {
+        SparseGrid *sparse = newSparse(width, height, gridFuel, &grid_fuel);
+        if (parallel)
+            setSparseScheduler(sparse, scheduler);
+        igniteSparse(sparse, height/2, width/2, 1);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int step = 0; ; step++) {
+            int64_t fire_count = stepSparse(sparse, SCALE_FACTOR, SEED, step);
+            fire_counts[parallel].push_back(fire_count);
+            for (int w = 0; parallel && w < workers; w++) {
+                executed[w] += scheduler->executed[w];
+                stolen[w] += scheduler->stolen[w];
+            }
+            if (fire_count == 0)
+                break;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        std::cout << (parallel ? "Stealing: " : "Serial: ") << fire_counts[parallel].size() << " steps\t"
+                  << duration_ms.count() << "ms" << std::endl;
+        freeSparse(sparse);
+    }
+    for (int w = 0; w < workers; w++)
+        std::cout << "Worker " << w << ": " << executed[w] << " blocks\t" << stolen[w] << " stolen" << std::endl;
+    freeScheduler(scheduler);
+    if (fire_counts[0] != fire_counts[1])
+        mismatch() << "fire counts differ" << std::endl;
+    else
+        std::cout << "Identical" << std::endl;
+}
+
+void runStats(Vertex *grid, int64_t width, int64_t height) {
+    GridFuel grid_fuel = {grid, width};
+    Scheduler *scheduler = newScheduler(2);
+    SparseGrid *sparse = newSparse(width, height, gridFuel, &grid_fuel);
+    setSparseScheduler(sparse, scheduler);
+    igniteSparse(sparse, height/2, width/2, 1);
+    int64_t mismatches = 0;
+    std::cout << "step\tburning\tburned\tperimeter\tvelocity\tbox" << std::endl;
+    for (int step = 0; stepSparse(sparse, SCALE_FACTOR, SEED, step) != 0; step++) {
+        const FireStats &stats = sparse->history.back();
+        if (step % 100 != 0)
+            continue;
+        FireStats counted = countSparseStats(sparse);
+        if (counted.burning != stats.burning || counted.burned != stats.burned || counted.perimeter != stats.perimeter
+            || counted.min_i != stats.min_i || counted.max_i != stats.max_i
+            || counted.min_j != stats.min_j || counted.max_j != stats.max_j)
+            mismatches++;
+        std::cout << stats.step << "\t" << stats.burning << "\t" << stats.burned << "\t" << stats.perimeter << "\t"
+                  << stats.front_velocity << "\t" << stats.min_i << "," << stats.min_j << "-"
+                  << stats.max_i << "," << stats.max_j << std::endl;
+    }
+    if (mismatches != 0)
+        mismatch() << mismatches << " samples differ from a recount" << std::endl;
+    else
+        std::cout << "Matches a recount at every sample" << std::endl;
+    freeSparse(sparse);
+    freeScheduler(scheduler);
+}
+
+void runPerimeter(Vertex *grid, int64_t width, int64_t height, int every) {
+    GridFuel grid_fuel = {grid, width};
+    SparseGrid *sparse = newSparse(width, height, gridFuel, &grid_fuel);
+    Perimeter *perimeter = newPerimeter(sparse);
+    igniteSparse(sparse, height/2, width/2, 1);
+    FILE *json = tmpfile();
+    FILE *binary = tmpfile();
+    int64_t step_us = 0, update_us = 0, trace_us = 0, export_us = 0;
+    int64_t exports = 0;
+    int step = 0;
+    for (;; step++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int64_t fire_count = stepSparse(sparse, SCALE_FACTOR, SEED, step);
+        auto stepped = std::chrono::high_resolution_clock::now();
+        updatePerimeter(perimeter, sparse);
+        auto updated = std::chrono::high_resolution_clock::now();
+        auto traced = updated;
+        if (step % every == 0 || fire_count == 0) {
+            tracePerimeter(perimeter);
+            traced = std::chrono::high_resolution_clock::now();
+            rewind(json);
+            rewind(binary);
+            writePerimeterJson(perimeter, step, json);
+            writePerimeterBinary(perimeter, step, binary);
+            exports++;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        step_us += std::chrono::duration_cast<std::chrono::microseconds>(stepped - start).count();
+        update_us += std::chrono::duration_cast<std::chrono::microseconds>(updated - stepped).count();
+        trace_us += std::chrono::duration_cast<std::chrono::microseconds>(traced - updated).count();
+        export_us += std::chrono::duration_cast<std::chrono::microseconds>(end - traced).count();
+        if (fire_count == 0)
+            break;
+    }
+    int64_t points = 0;
+    for (const auto &ring : perimeter->rings)
+        points += ring.second.points.size()/2;
+    std::cout << "Step: " << step_us/(step+1) << "us\tUpdate: " << update_us/(step+1) << "us\tEvery " << every << " steps, trace: "
+              << trace_us/exports << "us\twrite: " << export_us/exports << "us" << std::endl;
+    std::cout << perimeter->rings.size() << " rings\t" << points << " points\tJSON: " << ftell(json)
+              << " bytes\tBinary: " << ftell(binary) << " bytes" << std::endl;
+    fclose(json);
+    fclose(binary);
+
+    // Trace again with every burned tile pending at once
+    Perimeter *traced = newPerimeter(sparse);
+    for (int64_t i = 0; i < height; i++) {
+        for (int64_t j = 0; j < width; j++) {
+            if (sparseBurned(sparse, i, j))
+                traced->pending.push_back(i*width + j);
+        }
+    }
+    updatePerimeter(traced, sparse);
+    tracePerimeter(traced);
+    std::vector<size_t> sizes, traced_sizes;
+    for (const auto &ring : perimeter->rings)
+        sizes.push_back(ring.second.points.size());
+    for (const auto &ring : traced->rings)
+        traced_sizes.push_back(ring.second.points.size());
+    std::sort(sizes.begin(), sizes.end());
+    std::sort(traced_sizes.begin(), traced_sizes.end());
+    if (sizes != traced_sizes)
+        mismatch() << "incremental perimeter differs from tracing from scratch" << std::endl;
+    else
+        std::cout << "Same as tracing from scratch" << std::endl;
+    freePerimeter(traced, sparse);
+    freePerimeter(perimeter, sparse);
+    freeSparse(sparse);
+}
+
+void runArrival(Vertex *grid, int64_t width, int64_t height) {
+    SimBand *plain = newBand(grid, width, 0, height);
+    SimBand *band = newBand(grid, width, 0, height);
+    QuantGrid *quant = newQuant(grid, width, height);
+    GridFuel grid_fuel = {grid, width};
+    SparseGrid *sparse = newSparse(width, height, gridFuel, &grid_fuel);
+    band->arrival = newArrival(width, height, 4);
+    quant->arrival = newArrival(width, height, 2);
+    sparse->arrival = newArrival(width, height, 4);
+    seedArrival(band->arrival, grid);
+    seedArrival(quant->arrival, grid);
+    igniteSparse(sparse, height/2, width/2, 1);
+
+    int64_t plain_us = 0, band_us = 0;
+    int step = 0;
+    for (;; step++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int64_t fire_count = stepBand(plain, SCALE_FACTOR, SEED, step);
+        auto mid = std::chrono::high_resolution_clock::now();
+        stepBand(band, SCALE_FACTOR, SEED, step);
+        auto end = std::chrono::high_resolution_clock::now();
+        plain_us += std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count();
+        band_us += std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count();
+        stepQuant(quant, SCALE_FACTOR, SEED, step);
+        stepSparse(sparse, SCALE_FACTOR, SEED, step);
+        if (fire_count == 0)
+            break;
+    }
+
+    int64_t arrived = 0, mismatches = 0;
+    uint32_t last = 0;
+    for (int64_t i = 0; i < height; i++) {
+        const float *fuel = bandRow(band->fuel, band, i+1);
+        for (int64_t j = 0; j < width; j++) {
+            uint32_t at = getArrival(band->arrival, i, j);
+            if (at != getArrival(quant->arrival, i, j) || at != getArrival(sparse->arrival, i, j))
+                mismatches++;
+            // Reached exactly when the fuel is gone
+            if ((at == ARRIVAL_NONE) != (fuel[j] != 0))
+                mismatches++;
+            if (at != ARRIVAL_NONE) {
+                arrived++;
+                if (at > last)
+                    last = at;
+            }
+        }
+    }
+    std::cout << "Steps: " << step+1 << "\tArrived: " << arrived << "\tLast arrival: " << last << std::endl;
+    std::cout << "Float: " << plain_us/1000 << "ms\tRecording arrival: " << band_us/1000 << "ms" << std::endl;
+
+    ArrivalRaster *arrivals[2] = {quant->arrival, band->arrival};
+    for (ArrivalRaster *arrival : arrivals) {
+        FILE *file = tmpfile();
+        auto start = std::chrono::high_resolution_clock::now();
+        writeArrival(arrival, file);
+        fflush(file);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Export at " << arrival->bytes << " bytes per tile: " << ftell(file) << " bytes in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << std::endl;
+        fclose(file);
+    }
+    if (mismatches != 0)
+        mismatch() << mismatches << " tiles differ" << std::endl;
+    else
+        std::cout << "Same arrival in every engine" << std::endl;
+    freeArrival(band->arrival);
+    freeArrival(quant->arrival);
+    freeArrival(sparse->arrival);
+    freeBand(plain);
+    freeBand(band);
+    freeQuant(quant);
+    freeSparse(sparse);
+}
+
+void runLandscape(int64_t width, int64_t height, int workers) {
+    auto start = std::chrono::high_resolution_clock::now();
+    Vertex *grid = genGrid(width, height);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "genGrid: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
+    std::free(grid);
+
+    int64_t mismatches = 0;
+    FuelNoise noises[2] = {whiteFuelNoise(SEED), clumpedFuelNoise(SEED, 64)};
+    const char *names[2] = {"white", "clump 64"};
+    Scheduler *scheduler = newScheduler(workers);
+    for (int n = 0; n < 2; n++) {
+        start = std::chrono::high_resolution_clock::now();
+        Vertex *serial = genLandscape(width, height, &noises[n], NULL);
+        auto mid = std::chrono::high_resolution_clock::now();
+        Vertex *parallel = genLandscape(width, height, &noises[n], scheduler);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "Landscape, " << names[n] << ": "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count() << "ms serial\t"
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count() << "ms on "
+                  << workers << " workers" << std::endl;
+        if (memcmp(serial, parallel, sizeof(Vertex)*6*width*height) != 0)
+            mismatches++;
+        double sum = 0;
+        for (int64_t i = 0; i < height; i++) {
+            for (int64_t j = 0; j < width; j++) {
+                float fuel = serial[getGridIndex(i, j, width)].col[1];
+                sum += fuel;
+                if (fuel < 0.5f || fuel > 1.f)
+                    mismatches++;
+                // One tile at a time gives the same fuel as whole rows
+                if ((i*width + j) % 97 == 0 && fuelNoiseAt(&noises[n], i, j) != fuel)
+                    mismatches++;
+            }
+        }
+        std::cout << "Mean fuel: " << sum/(width*height) << std::endl;
+        std::free(serial);
+        std::free(parallel);
+
+        // Fuel alone for a 20k x 20k landscape, a row at a time
+        std::vector<float> row(20000);
+        start = std::chrono::high_resolution_clock::now();
+        for (int64_t i = 0; i < 20000; i++)
+            fuelNoiseRow(&noises[n], i, 0, 20000, row.data());
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "20k x 20k fuel, " << names[n] << ": "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
+    }
+    freeScheduler(scheduler);
+    if (mismatches != 0)
+        mismatch() << mismatches << " grids or tiles differ" << std::endl;
+    else
+        std::cout << "Same grid on any number of workers" << std::endl;
+}
+
+void runServe(int workers) {
+    const char *path = "/tmp/firesim-bench.sock";
+    Server *server = newServer(path, workers);
+    if (server == NULL) {
+        std::cout << "Could not listen on " << path << std::endl;
+        return;
+    }
+    int64_t mismatches = 0;
+    const char *requests[3] = {
+        "width=600 height=400 clump=32 seed=1",
+        "width=600 height=400 clump=32 seed=2",
+        "width=600 height=400 clump=32 seed=1 odds=0.25 i=10 j=10"
+    };
+    // Every client asks for every scenario, in a different order
+    const int clients = 4;
+    std::vector<std::string> answers(clients*3);
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++) {
+        threads.push_back(std::thread([&, c] {
+            for (int r = 0; r < 3; r++)
+                answers[c*3 + (r + c) % 3] = askServer(path, requests[(r + c) % 3]);
+        }));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << clients << " clients x 3 scenarios: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
+
+    for (int r = 0; r < 3; r++) {
+        start = std::chrono::high_resolution_clock::now();
+        std::string cached = askServer(path, requests[r]);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << cached << "\t" << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << std::endl;
+        // Identical apart from whether it was cached
+        std::string expect = cached.substr(0, cached.find("\"cached\":true"));
+        for (int c = 0; c < clients; c++) {
+            if (answers[c*3 + r].compare(0, expect.size(), expect) != 0)
+                mismatches++;
+        }
+
+        // The same scenario run here directly, on the same fuel
+        Scenario scenario;
+        std::string error;
+        parseScenario(requests[r], &scenario, &error);
+        FuelNoise noise = clumpedFuelNoise(scenario.fuel_seed, scenario.clump);
+        SparseGrid *sparse = newSparse(scenario.width, scenario.height, fuelNoiseAt, &noise);
+        igniteSparse(sparse, scenario.ignite_i, scenario.ignite_j, 1);
+        int steps = 0;
+        while (stepSparse(sparse, scenario.odds, scenario.seed, steps) != 0)
+            steps++;
+        std::string direct = "\"steps\":" + std::to_string(steps) + ",\"burned\":" + std::to_string(sparse->stats.burned) + ",";
+        if (cached.find(direct) == std::string::npos)
+            mismatches++;
+        freeSparse(sparse);
+    }
+    if (askServer(path, "width=10 nonsense=1").find("\"error\"") == std::string::npos)
+        mismatches++;
+    // Turned away before any memory is taken for it
+    if (askServer(path, "width=1000000 height=1000000").find("\"error\"") == std::string::npos)
+        mismatches++;
+    // What the client sent comes back escaped
+    if (askServer(path, "\"quoted\\=1").find("{\"error\":\"unknown key \\\"quoted\\\\\"}") == std::string::npos)
+        mismatches++;
+    // Too large for an int, rather than wrapping around to clump=1
+    if (askServer(path, "clump=4294967297").find("\"error\"") == std::string::npos)
+        mismatches++;
+    // A line past the cap ends the connection with an error
+    if (askServer(path, std::string(4*SERVER_MAX_LINE, 'x')).find("longer than") == std::string::npos)
+        mismatches++;
+    // With every connection taken, the next one is turned away
+    std::vector<int> idle;
+    for (int c = 0; c < SERVER_MAX_CONNECTIONS; c++) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0)
+            idle.push_back(fd);
+        else if (fd >= 0)
+            close(fd);
+    }
+    if (askServer(path, requests[0]).find("too many connections") == std::string::npos)
+        mismatches++;
+    for (int fd : idle)
+        close(fd);
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        std::cout << "Requests: " << server->requests << "\tRuns: " << server->runs
+                  << "\tCache hits: " << server->cache_hits << std::endl;
+        // Concurrent requests for a running scenario must wait for it rather
+        // than run it again
+        if (server->runs != 3)
+            mismatches++;
+    }
+    freeServer(server);
+    if (mismatches != 0)
+        mismatch() << mismatches << " answers differ" << std::endl;
+    else
+        std::cout << "Each scenario ran once and matches running it directly" << std::endl;
+}
+
+// Sends one request on a connection of its own and returns the answer line.
+std::string askServer(const char *path, const std::string &request) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(fd);
+        return "";
+    }
+    std::string line = request + "\n";
+    send(fd, line.data(), line.size(), MSG_NOSIGNAL);
+    std::string answer;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n')
+        answer += c;
+    close(fd);
+    return answer;
+}
+
+void runShare(Vertex *grid, int64_t width, int64_t height, const char *name) {
+    Share *share = newShare(name, width, height);
+    if (share == NULL) {
+        std::cout << "Could not create " << name << std::endl;
+        return;
+    }
+    int stop[2], results[2];
+    if (pipe(stop) != 0 || pipe(results) != 0)
+        return;
+    pid_t reader = fork();
+    if (reader == 0) {
+        // Takes frames as fast as it can until told to stop, hashing each in
+        // place, and sends back the hashes of the ones that were whole
+        close(stop[1]);
+        close(results[0]);
+        Share *view = openShare(name);
+        std::vector<uint64_t> kept;
+        int64_t torn = 0;
+        struct pollfd done = {stop[0], POLLIN, 0};
+        while (view != NULL && poll(&done, 1, 0) == 0) {
+            ShareFrame frame;
+            if (!readShare(view, &frame))
+                continue;
+            uint64_t hash = hashBytes(frame.intensity, 2*width*height);
+            if (!validShare(view, &frame)) {
+                torn++;
+                continue;
+            }
+            if (kept.empty() || kept[kept.size()-2] != frame.generation) {
+                kept.push_back(frame.generation);
+                kept.push_back(hash);
+            }
+        }
+        kept.push_back(torn);
+        write(results[1], kept.data(), sizeof(uint64_t)*kept.size());
+        _exit(0);
+    }
+    close(stop[0]);
+    close(results[1]);
+
+    // Stepping alone, then publishing every step with the reader attached.
+    // CPU time of this process only, since the reader shares the machine.
+    int64_t step_us[2] = {0, 0};
+    std::vector<uint64_t> published(1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        QuantGrid *quant = newQuant(grid, width, height);
+        for (int step = 0; ; step++) {
+            struct timespec start, end;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+            int64_t fire = stepQuant(quant, SCALE_FACTOR, SEED, step);
+            if (pass == 1)
+                shareQuant(share, quant, step, fire);
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+            step_us[pass] += (end.tv_sec - start.tv_sec)*1000000 + (end.tv_nsec - start.tv_nsec)/1000;
+            if (pass == 1) {
+                std::vector<uint8_t> planes(2*width*height);
+                memcpy(planes.data(), quantRow(quant->intensity, quant, 0), width*height);
+                memcpy(planes.data() + width*height, quantRow(quant->fuel, quant, 0), width*height);
+                published.push_back(hashBytes(planes.data(), planes.size()));
+            }
+            if (fire == 0)
+                break;
+        }
+        freeQuant(quant);
+    }
+    close(stop[1]);
+    std::vector<uint64_t> kept;
+    uint64_t word;
+    while (read(results[0], &word, sizeof(word)) == sizeof(word))
+        kept.push_back(word);
+    close(results[0]);
+    waitpid(reader, NULL, 0);
+    freeShare(share);
+
+    int64_t steps = published.size() - 1;
+    int64_t mismatches = 0;
+    for (size_t k = 0; k + 1 < kept.size(); k += 2) {
+        if (kept[k] >= published.size() || published[kept[k]] != kept[k+1])
+            mismatches++;
+    }
+    std::cout << steps << " steps, " << 2*width*height/1024 << "KB a frame" << std::endl;
+    std::cout << "Stepping: " << step_us[0]/steps << "us/step\tPublishing every step: "
+              << step_us[1]/steps << "us/step" << std::endl;
+    std::cout << "Reader kept " << kept.size()/2 << " frames, dropped "
+              << (kept.empty() ? 0 : kept.back()) << " torn ones" << std::endl;
+    if (kept.size() < 3 || mismatches != 0)
+        mismatch() << mismatches << " frames differ from what was published" << std::endl;
+    else
+        std::cout << "Every frame kept matches its generation" << std::endl;
+}
+
+void runFrames(Vertex *grid, int64_t width, int64_t height, int keyframe_every) {
+    const char *path = "/tmp/firesim.ffrm";
+    FILE *file = fopen(path, "wb");
+    FrameEncoder *encoder = newFrameEncoder(width, height, keyframe_every, file);
+    QuantGrid *quant = newQuant(grid, width, height);
+    std::vector<uint64_t> hashes;
+    std::vector<uint8_t> planes(2*width*height);
+    int64_t key_bytes = 0, delta_bytes = 0, keyframes = 0, deltas = 0, burning = 0;
+    int64_t encode_us = 0, step_us = 0;
+    for (int step = 0; ; step++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int64_t fire = stepQuant(quant, SCALE_FACTOR, SEED, step);
+        auto mid = std::chrono::high_resolution_clock::now();
+        bool keyframe = encoder->frames % keyframe_every == 0;
+        int64_t bytes = encodeQuant(encoder, quant, step + 1);
+        auto end = std::chrono::high_resolution_clock::now();
+        step_us += std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count();
+        encode_us += std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count();
+        (keyframe ? key_bytes : delta_bytes) += bytes;
+        (keyframe ? keyframes : deltas)++;
+        burning += fire;
+        memcpy(planes.data(), quantRow(quant->intensity, quant, 0), width*height);
+        memcpy(planes.data() + width*height, quantRow(quant->fuel, quant, 0), width*height);
+        hashes.push_back(hashBytes(planes.data(), planes.size()));
+        if (fire == 0)
+            break;
+    }
+    freeQuant(quant);
+    freeFrameEncoder(encoder);
+    fclose(file);
+
+    int64_t frames = hashes.size();
+    std::cout << frames << " frames, " << 2*width*height/1024 << "KB each in full" << std::endl;
+    std::cout << "Keyframes: " << key_bytes/keyframes/1024 << "KB\tDeltas: " << delta_bytes/std::max<int64_t>(deltas, 1)
+              << " bytes, for " << burning/frames << " burning tiles on average" << std::endl;
+    std::cout << "Stream: " << (key_bytes + delta_bytes)/1024 << "KB against " << frames*2*width*height/1024
+              << "KB in full" << std::endl;
+    std::cout << "Stepping: " << step_us/frames << "us/step\tEncoding: " << encode_us/frames << "us/frame" << std::endl;
+
+    file = fopen(path, "rb");
+    FrameDecoder *decoder = newFrameDecoder(file);
+    int64_t decoded = 0, mismatches = 0, decode_us = 0;
+    while (decoder != NULL) {
+        auto start = std::chrono::high_resolution_clock::now();
+        bool more = decodeFrame(decoder);
+        auto end = std::chrono::high_resolution_clock::now();
+        if (!more)
+            break;
+        decode_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        memcpy(planes.data(), decoder->intensity.data(), width*height);
+        memcpy(planes.data() + width*height, decoder->fuel.data(), width*height);
+        if (decoded >= frames || decoder->step != decoded + 1 || hashBytes(planes.data(), planes.size()) != hashes[decoded])
+            mismatches++;
+        decoded++;
+    }
+    std::cout << "Decoding: " << decode_us/std::max<int64_t>(decoded, 1)
+              << "us/frame" << std::endl;
+    if (decoder != NULL)
+        freeFrameDecoder(decoder);
+    fclose(file);
+    if (mismatches != 0 || decoded != frames)
+        mismatch() << mismatches << " frames differ, " << decoded << " of " << frames << " decoded" << std::endl;
+    else
+        std::cout << "Every frame decodes to the state it was encoded from" << std::endl;
+
+    // Headers that would wrap width*height or claim a payload larger than
+    // the grid can encode to are refused before anything is allocated
+    uint32_t version = FRAMES_VERSION;
+    uint64_t wrapping[2] = {1ULL << 33, (1ULL << 31) + 1};
+    file = tmpfile();
+    fwrite("FFRM", 1, 4, file);
+    fwrite(&version, sizeof(uint32_t), 1, file);
+    fwrite(wrapping, sizeof(uint64_t), 2, file);
+    rewind(file);
+    decoder = newFrameDecoder(file);
+    fclose(file);
+    uint64_t small[2] = {4, 4}, huge = 1ULL << 40;
+    uint32_t step = 1;
+    file = tmpfile();
+    fwrite("FFRM", 1, 4, file);
+    fwrite(&version, sizeof(uint32_t), 1, file);
+    fwrite(small, sizeof(uint64_t), 2, file);
+    fputc('K', file);
+    fwrite(&step, sizeof(uint32_t), 1, file);
+    fwrite(&huge, sizeof(uint64_t), 1, file);
+    rewind(file);
+    FrameDecoder *small_decoder = newFrameDecoder(file);
+    bool refused = decoder == NULL && small_decoder != NULL && !decodeFrame(small_decoder);
+    if (decoder != NULL)
+        freeFrameDecoder(decoder);
+    if (small_decoder != NULL)
+        freeFrameDecoder(small_decoder);
+    fclose(file);
+    if (!refused)
+        mismatch() << "a damaged header was decoded" << std::endl;
+    else
+        std::cout << "Wrapping sizes and oversized payloads are refused" << std::endl;
+}
+
+enum {
+    OUTPUT_NONE = 0,
+    OUTPUT_INLINE = 1,
+    OUTPUT_ASYNC = 2,
+    OUTPUT_SLOW_DROP = 3,
+    OUTPUT_SLOW_WAIT = 4
+};
+
+void runWriter(Vertex *grid, int64_t width, int64_t height, int every) {
+    const char *names[5] = {"No output", "Inline pwrite", "Async writer", "Slow storage, dropping", "Slow storage, waiting"};
+    const int steps = 600;
+    // The slow storage takes 40MB/s through a pipe, and the writer may hold
+    // 32MB, a handful of snapshots
+    const int64_t slow_rate = 40 << 20;
+    const int64_t budget = 32 << 20;
+    int64_t snapshot_bytes = 6*width*height;
+    for (int output = OUTPUT_NONE; output <= OUTPUT_SLOW_WAIT; output++) {
+        int fd = -1;
+        int slow[2] = {-1, -1};
+        std::thread drain;
+        if (output == OUTPUT_INLINE || output == OUTPUT_ASYNC) {
+            fd = open("/tmp/firesim-snapshots.bin", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        } else if (output != OUTPUT_NONE && pipe(slow) == 0) {
+            fd = slow[1];
+            drain = std::thread([&slow, slow_rate] {
+                std::vector<uint8_t> chunk(1 << 20);
+                ssize_t got;
+                while ((got = read(slow[0], chunk.data(), chunk.size())) > 0)
+                    std::this_thread::sleep_for(std::chrono::microseconds(got*1000000/slow_rate));
+            });
+        }
+        AsyncWriter *writer = output >= OUTPUT_ASYNC ? newAsyncWriter(budget) : NULL;
+        QuantGrid *quant = newQuant(grid, width, height);
+        quant->arrival = newArrival(width, height, 4);
+        seedArrival(quant->arrival, grid);
+        int64_t snapshots = 0, worst_us = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int step = 0; step < steps; step++) {
+            auto step_start = std::chrono::high_resolution_clock::now();
+            stepQuant(quant, SCALE_FACTOR, SEED, step);
+            if (output != OUTPUT_NONE && step % every == 0) {
+                // The simulation's own copy of this step's state, handed off
+                std::vector<uint8_t> snapshot(snapshot_bytes);
+                memcpy(snapshot.data(), quantRow(quant->intensity, quant, 0), width*height);
+                memcpy(snapshot.data() + width*height, quantRow(quant->fuel, quant, 0), width*height);
+                memcpy(snapshot.data() + 2*width*height, quant->arrival->steps, 4*width*height);
+                int64_t offset = output == OUTPUT_INLINE || output == OUTPUT_ASYNC ? snapshots*snapshot_bytes : -1;
+                if (writer == NULL)
+                    pwrite(fd, snapshot.data(), snapshot.size(), offset);
+                else
+                    queueWrite(writer, fd, offset, snapshot, output != OUTPUT_SLOW_DROP);
+                snapshots++;
+            }
+            auto step_end = std::chrono::high_resolution_clock::now();
+            worst_us = std::max<int64_t>(worst_us, std::chrono::duration_cast<std::chrono::microseconds>(step_end - step_start).count());
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << names[output] << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << "ms for " << steps << " steps, worst step " << worst_us/1000 << "ms";
+        if (writer != NULL) {
+            std::cout << ", stalled " << writer->stall_us/1000 << "ms, dropped " << writer->dropped << " of "
+                      << snapshots << ", " << writer->batches << " batches";
+            auto flush_start = std::chrono::high_resolution_clock::now();
+            bool flushed = flushAsyncWriter(writer);
+            auto flush_end = std::chrono::high_resolution_clock::now();
+            std::cout << ", then " << std::chrono::duration_cast<std::chrono::milliseconds>(flush_end - flush_start).count()
+                      << "ms to drain";
+            if (!flushed)
+                std::cout << ", " << writer->errors << " ERRORS";
+            if (writer->bytes_written != (snapshots - writer->dropped)*snapshot_bytes) {
+                std::cout << ", ";
+                mismatch() << writer->bytes_written << " bytes written";
+            }
+            freeAsyncWriter(writer);
+        }
+        std::cout << std::endl;
+        freeArrival(quant->arrival);
+        freeQuant(quant);
+        if (fd >= 0)
+            close(fd);
+        if (drain.joinable()) {
+            drain.join();
+            close(slow[0]);
+        }
+    }
+
+    // What the async writer left in the file is what inline writes leave
+    int fd = open("/tmp/firesim-snapshots.bin", O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size != (steps + every - 1)/every*snapshot_bytes)
+        mismatch() << "snapshot file is not the expected size" << std::endl;
+    else
+        std::cout << "Snapshot file complete" << std::endl;
+    if (fd >= 0)
+        close(fd);
+
+    // A write that fails counts no bytes and is reported by the next flush
+    // only, here into a file opened read only
+    AsyncWriter *writer = newAsyncWriter(budget);
+    fd = open("/tmp/firesim-snapshots.bin", O_RDONLY);
+    std::vector<uint8_t> bytes(4096);
+    queueWrite(writer, fd, 0, bytes, true);
+    bool failed = !flushAsyncWriter(writer);
+    bool cleared = flushAsyncWriter(writer);
+    if (!failed || !cleared || writer->bytes_written != 0 || writer->last_error != EBADF)
+        mismatch() << "failed write not reported" << std::endl;
+    else
+        std::cout << "Failed write reported" << std::endl;
+    freeAsyncWriter(writer);
+    if (fd >= 0)
+        close(fd);
+}
+
+void runSweep(Vertex *grid, int64_t width, int64_t height, int seeds) {
+    // Odds from 0.16 to 0.315, and burn rates as multiples of the usual
+    // 0.005 a step, which is the same as dividing fuel and intensity by them
+    const int points = 32;
+    const int rates = 3;
+    float odds[points];
+    for (int k = 0; k < points; k++)
+        odds[k] = 0.16f + 0.005f*k;
+    float burn_rates[rates] = {1.f, 20.f, 40.f};
+    std::vector<int64_t> burned(rates*seeds*points);
+    int64_t sweep_us = 0, separate_us = 0, mismatches = 0;
+    Vertex *scaled = (Vertex *) std::malloc(sizeof(Vertex)*6*width*height);
+    for (int r = 0; r < rates; r++) {
+        memcpy(scaled, grid, sizeof(Vertex)*6*width*height);
+        for (int64_t v = 0; v < 6*width*height; v++) {
+            scaled[v].col[0] /= burn_rates[r];
+            scaled[v].col[1] /= burn_rates[r];
+        }
+        for (int s = 0; s < seeds; s++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            Ensemble *ensemble = newEnsemble(scaled, width, height);
+            setEnsembleOdds(ensemble, odds, points);
+            for (int step = 0; stepEnsemble(ensemble, 0, SEED + s, step) != 0; step++)
+                ;
+            int64_t lanes[ENSEMBLE_LANES];
+            ensembleLaneBurned(ensemble, lanes);
+            freeEnsemble(ensemble);
+            auto end = std::chrono::high_resolution_clock::now();
+            sweep_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            for (int k = 0; k < points; k++)
+                burned[(r*seeds + s)*points + k] = lanes[k];
+        }
+
+        // Every point of the first seed run on its own, as before
+        for (int k = 0; k < points; k++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            QuantGrid *quant = newQuant(scaled, width, height);
+            for (int step = 0; stepQuant(quant, odds[k], SEED, step) != 0; step++)
+                ;
+            auto end = std::chrono::high_resolution_clock::now();
+            separate_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            int64_t quant_burned = 0;
+            for (int64_t i = 0; i < height; i++) {
+                const uint8_t *fuel = quantRow(quant->fuel, quant, i);
+                for (int64_t j = 0; j < width; j++) {
+                    const Vertex *vertex = &scaled[getGridIndex(i, j, width)];
+                    quant_burned += fuel[j] == 0 && (vertex->col[0] != 0 || vertex->col[1] != 0);
+                }
+            }
+            if (quant_burned != burned[r*seeds*points + k])
+                mismatches++;
+            freeQuant(quant);
+        }
+    }
+    std::free(scaled);
+
+    // Differences between neighboring odds, from the same seed (common random
+    // numbers) and from different seeds (independent runs)
+    double common_variance = 0, independent_variance = 0;
+    for (int r = 0; r < rates; r++) {
+        for (int k = 0; k + 1 < points; k++) {
+            double common_sum = 0, common_squares = 0, independent_sum = 0, independent_squares = 0;
+            for (int s = 0; s < seeds; s++) {
+                double common = burned[(r*seeds + s)*points + k+1] - burned[(r*seeds + s)*points + k];
+                double independent = burned[(r*seeds + (s+1) % seeds)*points + k+1] - burned[(r*seeds + s)*points + k];
+                common_sum += common;
+                common_squares += common*common;
+                independent_sum += independent;
+                independent_squares += independent*independent;
+            }
+            common_variance += common_squares/seeds - (common_sum/seeds)*(common_sum/seeds);
+            independent_variance += independent_squares/seeds - (independent_sum/seeds)*(independent_sum/seeds);
+        }
+    }
+    for (int r = 0; r < rates; r++) {
+        std::cout << "Burn rate " << burn_rates[r] << ", mean burned at odds";
+        for (int k = 0; k < points; k += 8) {
+            double sum = 0;
+            for (int s = 0; s < seeds; s++)
+                sum += burned[(r*seeds + s)*points + k];
+            std::cout << " " << odds[k] << ": " << (int64_t) (sum/seeds);
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Variance of neighboring differences, independent/common: "
+              << independent_variance/common_variance << "x" << std::endl;
+    std::cout << "Sweep: " << sweep_us/1000 << "ms for " << rates*seeds*points << " runs\tSeparate: "
+              << separate_us/1000 << "ms for " << rates*points << " runs, "
+              << (double) separate_us/(rates*points) / ((double) sweep_us/(rates*seeds*points)) << "x slower per run" << std::endl;
+    if (mismatches != 0)
+        mismatch() << mismatches << " lanes differ from separate runs" << std::endl;
+    else
+        std::cout << "Every lane matches its separate run" << std::endl;
+
+    // No odds at all, and odds out of order, are turned away
+    Ensemble *ensemble = newEnsemble(grid, width, height);
+    float descending[2] = {0.3f, 0.2f};
+    if (setEnsembleOdds(ensemble, odds, 0) || setEnsembleOdds(ensemble, descending, 2) || ensemble->common_rolls)
+        mismatch() << "setEnsembleOdds took odds it should refuse" << std::endl;
+    else
+        std::cout << "Empty and descending odds are refused" << std::endl;
+    freeEnsemble(ensemble);
+}
+
+void runConverge(Vertex *grid, int64_t width, int64_t height, int workers) {
+    Scheduler *scheduler = newScheduler(workers);
+    BatchTarget target = {0.05, 0.01, 128, 64*ENSEMBLE_LANES};
+    BatchRun *run = runBatches(grid, width, height, SCALE_FACTOR, SEED, &target, scheduler);
+    std::cout << "realizations\tprobability +-\tburned +-" << std::endl;
+    for (const BatchCheck &check : run->checks)
+        std::cout << check.realizations << "\t" << check.probability_half_width << "\t"
+                  << check.burned_half_width << std::endl;
+    std::cout << "Adaptive: " << run->realizations << " realizations" << (run->converged ? "" : " (not converged)")
+              << "\t" << run->run_us/1000 << "ms\tmerging and checking " << run->check_us/1000 << "ms ("
+              << 100.*run->check_us/run->run_us << "%)\tmean burned " << run->mean_burned << std::endl;
+
+    // The usual guess
+    BatchTarget fixed = {0, 0, 1024, 1024};
+    BatchRun *guess = runBatches(grid, width, height, SCALE_FACTOR, SEED, &fixed, scheduler);
+    std::cout << "Fixed: " << guess->realizations << " realizations\t" << guess->run_us/1000
+              << "ms\tprobability +-" << guess->probability_half_width << "\tburned +-"
+              << guess->burned_half_width << std::endl;
+    std::cout << "Adaptive saves " << 100. - 100.*run->run_us/guess->run_us << "% of the time" << std::endl;
+    freeBatchRun(guess);
+
+    // The same realizations on one worker
+    Scheduler *serial = newScheduler(1);
+    BatchTarget same = {0, 0, run->realizations, run->realizations};
+    BatchRun *check = runBatches(grid, width, height, SCALE_FACTOR, SEED, &same, serial);
+    if (check->burn_counts != run->burn_counts || check->burned_sum != run->burned_sum)
+        mismatch() << "one worker gives other burn counts" << std::endl;
+    else
+        std::cout << "One worker gives the same burn counts" << std::endl;
+    freeBatchRun(check);
+    freeScheduler(serial);
+    freeBatchRun(run);
+    freeScheduler(scheduler);
+}
+
+void runSpot(Vertex *grid, int64_t width, int64_t height) {
+    // 20 tiles of bare ground from top to bottom, 20 tiles right of the fire
+    int64_t break_from = width/2 + 20, break_to = width/2 + 40;
+    for (int64_t i = 0; i < height; i++) {
+        for (int64_t j = break_from; j < break_to && j < width; j++) {
+            for (int v = 0; v < 6; v++)
+                grid[getGridIndex(i, j, width) + v].col[1] = 0;
+        }
+    }
+    SpotParams params = {0.02f, 0.f, 1.f, 8.f, 2, 60};
+    SpotParams calm = params;
+    calm.launch_odds = 0;
+    const SpotParams *runs[3] = {NULL, &calm, &params};
+    const char *names[3] = {"No spotting", "Never launching", "Spotting"};
+    uint64_t hashes[3];
+    for (int k = 0; k < 3; k++) {
+        SimBand *band = newBand(grid, width, 0, height);
+        Spotting *spotting = runs[k] == NULL ? NULL : newSpotting(runs[k]);
+        if (spotting != NULL)
+            setBandSpotting(band, spotting);
+        int steps = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        int64_t burning_steps = 0, fire_count;
+        while ((fire_count = stepBand(band, SCALE_FACTOR, SEED, steps)) != 0) {
+            burning_steps += fire_count;
+            steps++;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        int64_t burned = 0, beyond = 0;
+        for (int64_t i = 0; i < height; i++) {
+            const float *fuel = bandRow(band->fuel, band, i+1);
+            for (int64_t j = 0; j < width; j++) {
+                if (fuel[j] == 0 && grid[getGridIndex(i, j, width)].col[1] != 0) {
+                    burned++;
+                    beyond += j >= break_to;
+                }
+            }
+        }
+        hashes[k] = hashBytes((const uint8_t *) bandRow(band->intensity, band, 1), sizeof(float)*width*height)
+                    ^ hashBytes((const uint8_t *) bandRow(band->fuel, band, 1), sizeof(float)*width*height);
+        std::cout << names[k] << ": " << steps << " steps\t" << us/1000 << "ms\t"
+                  << (double) us*1000/burning_steps << "ns per burning tile-step\tburned " << burned
+                  << "\tbeyond the break " << beyond;
+        if (spotting != NULL)
+            std::cout << "\tembers " << spotting->launched << " landed " << spotting->landed;
+        std::cout << std::endl;
+        if (k == 2) {
+            // Where the kernel sends embers
+            double distance = 0, downwind = 0;
+            const int samples = 1000000;
+            for (int s = 0; s < samples; s++) {
+                SpotOffset offset = sampleSpot(spotting, rngHash(SEED, 0, s, 0));
+                distance += sqrt((double) offset.di*offset.di + (double) offset.dj*offset.dj);
+                downwind += offset.dj > 0;
+            }
+            std::cout << "Kernel: " << spotting->offsets.size() << " offsets\tmean distance "
+                      << distance/samples << "\tdownwind " << 100*downwind/samples << "%" << std::endl;
+        }
+        if (spotting != NULL)
+            freeSpotting(spotting);
+        freeBand(band);
+    }
+    if (hashes[0] != hashes[1])
+        mismatch() << "spotting that never launches changed the fire" << std::endl;
+    else
+        std::cout << "Spotting that never launches leaves the fire unchanged" << std::endl;
+
+    // Nowhere for embers to land, and a median distance with no logarithm
+    SpotParams empty = params;
+    empty.min_distance = 10;
+    empty.max_distance = 5;
+    SpotParams no_median = params;
+    no_median.median_distance = 0;
+    if (newSpotting(&empty) != NULL || newSpotting(&no_median) != NULL)
+        mismatch() << "spotting made from parameters with no kernel" << std::endl;
+    else
+        std::cout << "Parameters with no kernel are turned away" << std::endl;
+}
+
+void runWeather(Vertex *grid, int64_t width, int64_t height, int every) {
+    // On the 1/65536 grid spread tables keep, so calm weather can match it
+    const float base_odds = roundf(SCALE_FACTOR*65536) / 65536;
+    WeatherParams params = {base_odds, 2.f, 0.3f};
+    // Calm and dry, then layers that alternate between 8x8 rasters of wind
+    // and moisture and a global wind turning around the compass
+    const int layer_count = 9;
+    std::vector<WeatherLayer> layers(layer_count);
+    for (int k = 0; k < layer_count; k++) {
+        WeatherLayer *layer = &layers[k];
+        layer->start_step = k*every;
+        layer->wind_u = k == 0 ? 0 : cosf(k);
+        layer->wind_v = k == 0 ? 0 : sinf(k);
+        layer->moisture = k == 0 ? 0 : 0.05f*(k % 3);
+        layer->raster_width = layer->raster_height = k % 2 == 0 && k != 0 ? 8 : 0;
+        for (int64_t cell = 0; cell < layer->raster_width*layer->raster_height; cell++) {
+            layer->wind_u_raster.push_back(rngUniform(SEED, k, cell, 0)*2 - 1);
+            layer->wind_v_raster.push_back(rngUniform(SEED, k, cell, 1)*2 - 1);
+            layer->moisture_raster.push_back(rngUniform(SEED, k, cell, 2)*0.2f);
+        }
+    }
+    int steps = layer_count*every;
+
+    // The calm first layer against the fixed odds
+    std::vector<WeatherLayer> calm(layers.begin(), layers.begin()+1);
+    WeatherStream *calm_stream = newWeatherStream(&params, width, height, calm, false);
+    SimBand *fixed = newBand(grid, width, 0, height);
+    SimBand *weathered = newBand(grid, width, 0, height);
+    for (int step = 0; step < every; step++) {
+        stepBand(fixed, base_odds, SEED, step);
+        weathered->spread = weatherSpread(calm_stream, step);
+        stepBand(weathered, 0, SEED, step);
+    }
+    bool calm_matches = memcmp(fixed->intensity, weathered->intensity, sizeof(float)*width*(height+2)) == 0
+                        && memcmp(fixed->fuel, weathered->fuel, sizeof(float)*width*(height+2)) == 0;
+    freeBand(fixed);
+    freeBand(weathered);
+    freeWeatherStream(calm_stream);
+
+    uint64_t hashes[2];
+    for (int prefetch = 1; prefetch >= 0; prefetch--) {
+        auto start = std::chrono::high_resolution_clock::now();
+        WeatherStream *stream = newWeatherStream(&params, width, height, layers, prefetch);
+        auto end = std::chrono::high_resolution_clock::now();
+        int64_t first_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        SimBand *band = newBand(grid, width, 0, height);
+        std::vector<int64_t> step_us(steps);
+        for (int step = 0; step < steps; step++) {
+            start = std::chrono::high_resolution_clock::now();
+            band->spread = weatherSpread(stream, step);
+            stepBand(band, 0, SEED, step);
+            end = std::chrono::high_resolution_clock::now();
+            step_us[step] = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        }
+        int64_t switch_max = 0, other_max = 0, total = 0;
+        for (int step = 0; step < steps; step++) {
+            total += step_us[step];
+            if (step % every == 0 && step != 0)
+                switch_max = std::max(switch_max, step_us[step]);
+            else
+                other_max = std::max(other_max, step_us[step]);
+        }
+        std::sort(step_us.begin(), step_us.end());
+        std::cout << (prefetch ? "Prefetched" : "On demand") << ": first table " << first_us/1000 << "ms\t"
+                  << steps << " steps " << total/1000 << "ms\tmedian " << step_us[steps/2] << "us\tp99 "
+                  << step_us[steps*99/100] << "us\tworst at a switch " << switch_max << "us, elsewhere "
+                  << other_max << "us";
+        if (prefetch)
+            std::cout << "\tswitches that waited " << stream->stalls << " (" << stream->stall_us << "us)";
+        std::cout << std::endl;
+        hashes[prefetch] = hashBytes((const uint8_t *) band->intensity, sizeof(float)*width*(height+2))
+                           ^ hashBytes((const uint8_t *) band->fuel, sizeof(float)*width*(height+2));
+        freeBand(band);
+        freeWeatherStream(stream);
+    }
+    std::cout << (passed(calm_matches) ? "Calm dry weather steps like the fixed odds"
+                               : "MISMATCH: calm dry weather steps differently from the fixed odds") << std::endl;
+    std::cout << (passed(hashes[0] == hashes[1]) ? "Prefetched and on demand agree"
+                                         : "MISMATCH: prefetched and on demand differ") << std::endl;
+
+    // A raster short of its cells, and moisture that never stops a fire
+    std::vector<WeatherLayer> short_raster(layers.begin(), layers.begin()+3);
+    short_raster[2].moisture_raster.pop_back();
+    WeatherParams no_extinction = params;
+    no_extinction.extinction_moisture = 0;
+    bool refused = newWeatherStream(&params, width, height, short_raster, false) == NULL
+                   && newWeatherStream(&no_extinction, width, height, calm, false) == NULL;
+    std::cout << (passed(refused) ? "Short rasters and zero extinction moisture are refused"
+                          : "MISMATCH: a stream was made from weather it cannot read") << std::endl;
+}
+
+void runOverlay(Vertex *grid, int64_t width, int64_t height, int features) {
+    int64_t edits = features/10;
+    FuelNoise noise = clumpedFuelNoise(SEED, 32);
+    for (int s = 0; s < 2; s++) {
+        int64_t w = s == 0 ? width : 10*width, h = s == 0 ? height : 10*height;
+        float *fuel = (float *) std::malloc(sizeof(float)*w*h);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int64_t i = 0; i < h; i++)
+            fuelNoiseRow(&noise, i, 0, w, fuel + i*w);
+        auto end = std::chrono::high_resolution_clock::now();
+        int64_t fill_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        Overlay *overlay = newOverlay(fuel, w, h, fuelNoiseAt, &noise);
+        int64_t tiles = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (int f = 0; f < features; f++) {
+            OverlayFeature feature = randomFeature(w, h, f);
+            addOverlayFeature(overlay, &feature);
+            for (const OverlaySpan &span : overlay->changed)
+                tiles += span.end_j - span.first_j;
+        }
+        end = std::chrono::high_resolution_clock::now();
+        int64_t add_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        // Every fifth edit removes the feature, the others move it
+        int64_t edit_max_us = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (int64_t e = 0; e < edits; e++) {
+            auto edit_start = std::chrono::high_resolution_clock::now();
+            int64_t id = rngHash(SEED, e, 0, 1) % features;
+            if (e % 5 == 0) {
+                removeOverlayFeature(overlay, id);
+            } else {
+                OverlayFeature feature = randomFeature(w, h, features + e);
+                setOverlayFeature(overlay, id, &feature);
+            }
+            auto edit_end = std::chrono::high_resolution_clock::now();
+            edit_max_us = std::max(edit_max_us, (int64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                edit_end - edit_start).count());
+        }
+        end = std::chrono::high_resolution_clock::now();
+        int64_t edit_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        std::cout << w << "x" << h << ": fuel " << fill_us/1000 << "ms\t" << features << " features ("
+                  << tiles << " tiles) " << add_us/1000 << "ms\t" << edits << " edits " << edit_us/1000
+                  << "ms, " << edit_us/edits << "us each, worst " << edit_max_us << "us" << std::endl;
+
+        if (s == 0) {
+            // The final features drawn from scratch
+            float *fresh = (float *) std::malloc(sizeof(float)*w*h);
+            for (int64_t i = 0; i < h; i++)
+                fuelNoiseRow(&noise, i, 0, w, fresh + i*w);
+            Overlay *scratch = newOverlay(fresh, w, h, fuelNoiseAt, &noise);
+            for (const OverlayFeature &feature : overlay->features) {
+                if (!feature.points.empty())
+                    addOverlayFeature(scratch, &feature);
+            }
+            if (memcmp(fresh, fuel, sizeof(float)*w*h) != 0)
+                mismatch() << "edited fuel differs from drawing the features from scratch" << std::endl;
+            else
+                std::cout << "Edited fuel matches drawing the features from scratch" << std::endl;
+            freeOverlay(scratch);
+            std::free(fresh);
+        }
+        freeOverlay(overlay);
+        std::free(fuel);
+    }
+
+    // Breaks drawn into a band once the fire has left the rows behind, in two
+    // corners a step apart, with the overlay pointed at the rows the band
+    // stepped into before the second
+    SimBand *band = newBand(grid, width, 0, height);
+    int step = 0;
+    for (; step < 50; step++)
+        stepBand(band, SCALE_FACTOR, SEED, step);
+    GridFuel grid_fuel = {grid, width};
+    Overlay *overlay = newOverlay(bandRow(band->fuel, band, 1), width, height, gridFuel, &grid_fuel);
+    OverlayFeature corner = {OVERLAY_POLYGON, 0, 0, {{0, 0}, {0, 10}, {10, 10}, {10, 0}}};
+    addOverlayFeature(overlay, &corner);
+    markBandRowsChanged(band, 0, 10);
+    stepBand(band, SCALE_FACTOR, SEED, step++);
+    setOverlayPlane(overlay, bandRow(band->fuel, band, 1));
+    OverlayFeature far_corner = {OVERLAY_POLYGON, 0, 0, {{0, width-10.}, {0, (double) width}, {10, (double) width},
+                                                         {10, width-10.}}};
+    addOverlayFeature(overlay, &far_corner);
+    markBandRowsChanged(band, 0, 10);
+    for (; step < 53; step++)
+        stepBand(band, SCALE_FACTOR, SEED, step);
+    float left = 0;
+    for (int64_t i = 0; i < 10; i++) {
+        for (int64_t j = 0; j < 10; j++)
+            left += bandRow(band->fuel, band, i+1)[j] + bandRow(band->fuel, band, i+1)[width-1-j];
+    }
+    std::cout << (passed(left == 0) ? "Breaks drawn between steps hold in the band"
+                            : "MISMATCH: a break drawn between steps was lost") << std::endl;
+    freeOverlay(overlay);
+    freeBand(band);
+
+    // Everything before the bad line is kept
+    FILE *file = tmpfile();
+    fputs("# roads\n"
+          "line 2 0 10,10 10,400 300,400\n"
+          "\n"
+          "polygon 0.2 50,50 50,90 90,70  # a clearing\n"
+          "line 1 0 5,5 5,\n"
+          "polygon 0 1,1 1,2 2,2\n", file);
+    rewind(file);
+    std::vector<OverlayFeature> read;
+    bool read_ok = readOverlayFeatures(file, &read);
+    fclose(file);
+    bool read_right = !read_ok && read.size() == 2 && read[0].kind == OVERLAY_LINE && read[0].width == 2
+                      && read[0].points.size() == 3 && read[0].points[2].i == 300 && read[1].kind == OVERLAY_POLYGON
+                      && read[1].fuel == 0.2f && read[1].points.size() == 3;
+    std::cout << (passed(read_right) ? "Features file read up to its bad line"
+                             : "MISMATCH: features file read wrongly") << std::endl;
+
+    // A road from far off either side crosses the grid at column 5 and is
+    // clipped before it is walked; numbers that are not finite cover nothing
+    // and are not read
+    std::vector<OverlaySpan> spans;
+    OverlayFeature far_road = {OVERLAY_LINE, 1, 0, {{-1e15, 5.5}, {1e15, 5.5}}};
+    auto far_start = std::chrono::high_resolution_clock::now();
+    rasterizeFeature(&far_road, width, height, &spans);
+    int64_t far_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - far_start).count();
+    bool far_right = (int64_t) spans.size() == height;
+    for (const OverlaySpan &span : spans)
+        far_right = far_right && span.first_j == 5 && span.end_j == 6;
+    OverlayFeature nan_road = {OVERLAY_LINE, 1, 0, {{NAN, 5}, {5, 5}}};
+    rasterizeFeature(&nan_road, width, height, &spans);
+    bool nan_right = spans.empty();
+    file = tmpfile();
+    fputs("line 1 0 nan,5 5,5\n", file);
+    rewind(file);
+    read.clear();
+    nan_right = nan_right && !readOverlayFeatures(file, &read) && read.empty();
+    fclose(file);
+    std::cout << (passed(far_right && nan_right) ? "Far-off and non-finite features clipped and refused"
+                                                 : "MISMATCH: a far-off or non-finite feature drawn wrongly")
+              << " (" << far_us << "us)" << std::endl;
+}
+
+// Two in ten are areas up to 60 tiles across, the rest roads and dozer lines
+// of 2 to 5 points up to 200 tiles apart, 1 to 4 tiles wide.
+OverlayFeature randomFeature(int64_t width, int64_t height, uint64_t key) {
+    OverlayFeature feature;
+    bool area = rngUniform(SEED, key, 0, 2) < 0.2f;
+    feature.kind = area ? OVERLAY_POLYGON : OVERLAY_LINE;
+    feature.width = 1 + (int) (rngUniform(SEED, key, 1, 2) * 4);
+    feature.fuel = rngUniform(SEED, key, 2, 2) < 0.5f ? 0 : 0.2f;
+    double i = rngUniform(SEED, key, 3, 2) * height, j = rngUniform(SEED, key, 4, 2) * width;
+    int points = area ? 3 + (int) (rngUniform(SEED, key, 5, 2) * 6) : 2 + (int) (rngUniform(SEED, key, 5, 2) * 4);
+    for (int p = 0; p < points; p++) {
+        if (area) {
+            double angle = 2*M_PI*p/points;
+            double radius = 5 + rngUniform(SEED, key, 6+p, 2) * 25;
+            feature.points.push_back({i + radius*sin(angle), j + radius*cos(angle)});
+        } else {
+            feature.points.push_back({i, j});
+            i += (rngUniform(SEED, key, 6+2*p, 2)*2 - 1) * 200;
+            j += (rngUniform(SEED, key, 7+2*p, 2)*2 - 1) * 200;
+        }
+    }
+    return feature;
+}
+
+uint64_t hashBytes(const uint8_t *bytes, int64_t count) {
+    uint64_t hash = 0;
+    for (int64_t k = 0; k + 8 <= count; k += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + k, 8);
+        hash = rngMix(hash ^ word);
+    }
+    return hash;
+}
+
+// Steps a band of rows near the top of a width x height grid, where tile ids
+// are past 2^31, and compares it with a plain restatement of the model that
+// works on the band's tile ids directly. Only the band is allocated.
+void runBigCheck(int64_t width, int64_t height, int steps) {
+    int64_t rows = 64;
+    int64_t first_row = height - rows - 1;
+    SimBand *band = newEmptyBand(width, first_row, rows);
+    std::vector<float> intensity((rows+2)*width, 0), fuel((rows+2)*width, 0);
+    for (int64_t r = 1; r <= rows; r++) {
+        for (int64_t j = 0; j < width; j++) {
+            uint64_t tile = (first_row + r - 1)*width + j;
+            fuel[r*width + j] = 0.5f + rngUniform(SEED, 0, tile, 4)/2.f;
+        }
+    }
+    intensity[(rows/2+1)*width + width/2] = 1;
+    fuel[(rows/2+1)*width + width/2] = 0;
+    memcpy(band->intensity, intensity.data(), sizeof(float)*intensity.size());
+    memcpy(band->fuel, fuel.data(), sizeof(float)*fuel.size());
+    countBandFire(band);
+
+    int64_t fire_count = 0;
+    std::vector<float> next_intensity(intensity), next_fuel(fuel);
+    for (int step = 0; step < steps; step++) {
+        fire_count = stepBand(band, SCALE_FACTOR, SEED, step);
+        for (int64_t r = 1; r <= rows; r++) {
+            uint64_t row = first_row + r - 1;
+            for (int64_t j = 0; j < width; j++) {
+                int64_t c = r*width + j;
+                int hits = 0;
+                if (j > 0 && intensity[c-1] != 0 && rngUniform(SEED, step, row*width + j-1, DIR_RIGHT) < SCALE_FACTOR)
+                    hits++;
+                if (j < width-1 && intensity[c+1] != 0 && rngUniform(SEED, step, row*width + j+1, DIR_LEFT) < SCALE_FACTOR)
+                    hits++;
+                if (intensity[c-width] != 0 && rngUniform(SEED, step, (row-1)*width + j, DIR_UP) < SCALE_FACTOR)
+                    hits++;
+                if (intensity[c+width] != 0 && rngUniform(SEED, step, (row+1)*width + j, DIR_DOWN) < SCALE_FACTOR)
+                    hits++;
+                float cur = intensity[c];
+                if (cur != 0) {
+                    cur -= 0.005;
+                    if (cur < 0)
+                        cur = 0;
+                }
+                next_intensity[c] = hits == 0 ? cur : hits == 1 ? fuel[c] : 0;
+                next_fuel[c] = hits == 0 ? fuel[c] : 0;
+            }
+        }
+        intensity.swap(next_intensity);
+        fuel.swap(next_fuel);
+    }
+
+    int64_t mismatches = 0;
+    for (int64_t c = width; c < (rows+1)*width; c++) {
+        if (band->intensity[c] != intensity[c] || band->fuel[c] != fuel[c])
+            mismatches++;
+    }
+    std::cout << "Big: " << width << "x" << height << " (" << width*height << " tiles), rows "
+              << first_row << "-" << first_row + rows - 1 << ", " << steps << " steps, "
+              << fire_count << " burning" << std::endl;
+    if (mismatches != 0)
+        mismatch() << mismatches << " tiles differ" << std::endl;
+    else
+        std::cout << "Identical" << std::endl;
+    freeBand(band);
+}
+
+// Starts the message of a failed check and counts it
+std::ostream &mismatch() {
+    failed_checks++;
+    return std::cout << "MISMATCH: ";
+}
+
+// Counts ok as a failed check if it is false, for checks that print a line
+// either way
+bool passed(bool ok) {
+    if (!ok)
+        failed_checks++;
+    return ok;
+}
+
 void interruptHandler(int signum) {
-    int average_us = total_us / counter;
-    int average_ms = average_us / 1000;
+    int64_t average_us = total_us / counter;
+    int64_t average_ms = average_us / 1000;
     std::cout << "\nAv: " << average_ms << "ms\t" << average_us << "us" << std::endl;
     std::cout << "Max: " << max_us/1000 << "ms\t" << max_us << "us" << std::endl;
     std::cout << "FCount: " << max_fire_count << std::endl;
@@ -0,0 +1,165 @@
+#include "frames.h"
+#include "share.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Fuel from none to full, then burning from dying down to full intensity
+static const char fuel_chars[] = " .:-=+";
+static const char fire_chars[] = "*#@";
+
+static int usage();
+static bool parseSize(const char *text, int *size);
+static int watchShare(const char *name, int columns, int rows);
+static int playStream(const char *path, int columns, int rows);
+static std::string renderFrame(const ShareFrame *frame, int64_t width, int64_t height, int columns, int rows);
+
+// ./viewer [name] [columns] [rows] attaches read-only to the state a
+// simulation publishes with newShare and draws it in the terminal a few times
+// a second, each character covering a block of tiles.
+// ./viewer -f path [columns] [rows] plays a frame stream instead, from a file
+// or from standard input for "-", e.g. nc host port | ./viewer -f -
+int main(int argc, char **argv) {
+    // Flags are taken out first, wherever they are, so "./viewer -f" is an
+    // error rather than a share named "-f"; "-" alone is a path
+    bool stream = false;
+    const char *source = "/firesim";
+    std::vector<const char *> positional;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "-f") {
+            if (stream || a+1 >= argc)
+                return usage();
+            stream = true;
+            source = argv[++a];
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return usage();
+        } else {
+            positional.push_back(argv[a]);
+        }
+    }
+    size_t next = 0;
+    if (!stream && next < positional.size())
+        source = positional[next++];
+    int columns = 100, rows = 40;
+    if (next < positional.size() && !parseSize(positional[next++], &columns))
+        return usage();
+    if (next < positional.size() && !parseSize(positional[next++], &rows))
+        return usage();
+    if (next < positional.size())
+        return usage();
+    if (stream)
+        return playStream(source, columns, rows);
+    return watchShare(source, columns, rows);
+}
+
+static int usage() {
+    std::cerr << "usage: viewer [name] [columns] [rows]" << std::endl
+              << "       viewer -f path [columns] [rows]" << std::endl;
+    return 2;
+}
+
+// Columns and rows are whole numbers from 1 to 10000.
+static bool parseSize(const char *text, int *size) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < 1 || value > 10000)
+        return false;
+    *size = (int) value;
+    return true;
+}
+
+static int watchShare(const char *name, int columns, int rows) {
+    Share *share = NULL;
+    while ((share = openShare(name)) == NULL) {
+        std::cerr << "\rWaiting for " << name << std::flush;
+        sleep(1);
+    }
+    int64_t width = share->header->width;
+    int64_t height = share->header->height;
+    uint64_t last_generation = 0;
+    int64_t dropped = 0;
+    while (true) {
+        ShareFrame frame;
+        if (!readShare(share, &frame) || frame.generation == last_generation) {
+            usleep(10000);
+            continue;
+        }
+        // Drawn straight from shared memory, then thrown away if the writer
+        // came around to the slot meanwhile
+        std::string text = renderFrame(&frame, width, height, columns, rows);
+        if (!validShare(share, &frame)) {
+            dropped++;
+            continue;
+        }
+        last_generation = frame.generation;
+        std::cout << "\x1b[H\x1b[2J" << text << name << "  " << width << "x" << height
+                  << "  generation " << frame.generation << "  step " << frame.step
+                  << "  burning " << frame.fire_count << "  dropped " << dropped << std::endl;
+        usleep(200000);
+    }
+}
+
+// Draws every frame as it is decoded; a pipe or socket paces it, a file is
+// played at 20 frames a second.
+static int playStream(const char *path, int columns, int rows) {
+    bool from_stdin = std::string(path) == "-";
+    FILE *file = from_stdin ? stdin : fopen(path, "rb");
+    FrameDecoder *decoder = file == NULL ? NULL : newFrameDecoder(file);
+    if (decoder == NULL) {
+        std::cerr << "No frame stream in " << path << std::endl;
+        return 1;
+    }
+    int64_t frames = 0;
+    while (decodeFrame(decoder)) {
+        ShareFrame frame = {0, 0, (uint64_t) ++frames, decoder->step, 0,
+                            decoder->intensity.data(), decoder->fuel.data()};
+        std::cout << "\x1b[H\x1b[2J" << renderFrame(&frame, decoder->width, decoder->height, columns, rows)
+                  << path << "  " << decoder->width << "x" << decoder->height
+                  << "  frame " << frames << "  step " << decoder->step << std::endl;
+        if (!from_stdin)
+            usleep(50000);
+    }
+    freeFrameDecoder(decoder);
+    if (!from_stdin)
+        fclose(file);
+    return 0;
+}
+
+// Each character shows the fire if any tile of its block burns, the mean fuel
+// of the block otherwise.
+static std::string renderFrame(const ShareFrame *frame, int64_t width, int64_t height, int columns, int rows) {
+    std::string text;
+    std::vector<int64_t> fuel(columns), fire(columns), tiles(columns);
+    for (int r = 0; r < rows; r++) {
+        std::fill(fuel.begin(), fuel.end(), 0);
+        std::fill(fire.begin(), fire.end(), 0);
+        std::fill(tiles.begin(), tiles.end(), 0);
+        for (int64_t i = r*height/rows; i < (r+1)*height/rows; i++) {
+            const uint8_t *intensity = frame->intensity + i*width;
+            const uint8_t *row_fuel = frame->fuel + i*width;
+            for (int64_t j = 0; j < width; j++) {
+                int c = j*columns/width;
+                if (intensity[j] > fire[c])
+                    fire[c] = intensity[j];
+                fuel[c] += row_fuel[j];
+                tiles[c]++;
+            }
+        }
+        for (int c = 0; c < columns; c++) {
+            if (fire[c] != 0) {
+                text += fire_chars[fire[c]*(sizeof(fire_chars)-1)/256];
+            } else {
+                // Fuel runs up to 200 steps (1.0)
+                int64_t mean = tiles[c] == 0 ? 0 : fuel[c]/tiles[c];
+                int level = mean*(sizeof(fuel_chars)-1)/201;
+                text += fuel_chars[level < (int) sizeof(fuel_chars)-2 ? level : sizeof(fuel_chars)-2];
+            }
+        }
+        text += '\n';
+    }
+    return text;
+}
@@ -0,0 +1,171 @@
+#include "weather.h"
+#include "sim.h"
+
+#include <math.h>
+#include <chrono>
+
+static void buildLoop(WeatherStream *stream);
+static float sampleRaster(const std::vector<float> &raster, int64_t raster_width, int64_t y0, int64_t y1, float fy,
+                          int64_t x0, int64_t x1, float fx);
+static void rasterCell(float at, int64_t cells, int64_t *low, int64_t *high, float *frac);
+static bool layerValid(const WeatherLayer *layer);
+
+WeatherStream *newWeatherStream(const WeatherParams *params, int64_t width, int64_t height,
+                                const std::vector<WeatherLayer> &layers, bool prefetch) {
+    if (layers.empty() || !(params->extinction_moisture > 0))
+        return NULL;
+    for (size_t k = 0; k < layers.size(); k++) {
+        if (!layerValid(&layers[k]) || (k > 0 && layers[k].start_step < layers[k-1].start_step))
+            return NULL;
+    }
+    WeatherStream *stream = new WeatherStream;
+    stream->params = *params;
+    stream->width = width;
+    stream->height = height;
+    stream->layers = layers;
+    stream->current = 0;
+    stream->table.resize(4*width*height);
+    buildSpreadTable(params, &stream->layers[0], width, height, stream->table.data());
+    stream->next_layer = 1;
+    stream->next_ready = false;
+    stream->prefetch = prefetch;
+    stream->stopping = false;
+    stream->stalls = 0;
+    stream->stall_us = 0;
+    if (prefetch) {
+        stream->next_table.resize(4*width*height);
+        stream->thread = std::thread(buildLoop, stream);
+    }
+    return stream;
+}
+
+void freeWeatherStream(WeatherStream *stream) {
+    if (stream->prefetch) {
+        {
+            std::lock_guard<std::mutex> guard(stream->lock);
+            stream->stopping = true;
+        }
+        stream->wake.notify_one();
+        stream->thread.join();
+    }
+    delete stream;
+}
+
+const uint16_t *weatherSpread(WeatherStream *stream, int step) {
+    while (stream->current+1 < stream->layers.size() && step >= stream->layers[stream->current+1].start_step) {
+        if (!stream->prefetch) {
+            stream->current++;
+            buildSpreadTable(&stream->params, &stream->layers[stream->current], stream->width, stream->height,
+                             stream->table.data());
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(stream->lock);
+        if (!stream->next_ready) {
+            auto start = std::chrono::high_resolution_clock::now();
+            stream->built.wait(guard, [stream] { return stream->next_ready; });
+            auto end = std::chrono::high_resolution_clock::now();
+            stream->stalls++;
+            stream->stall_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        }
+        stream->table.swap(stream->next_table);
+        stream->current = stream->next_layer;
+        stream->next_layer++;
+        stream->next_ready = false;
+        guard.unlock();
+        stream->wake.notify_one();
+    }
+    return stream->table.data();
+}
+
+// Builds each layer's table as soon as the one before it is taken.
+static void buildLoop(WeatherStream *stream) {
+    std::unique_lock<std::mutex> guard(stream->lock);
+    while (true) {
+        stream->wake.wait(guard, [stream] {
+            return stream->stopping || (!stream->next_ready && stream->next_layer < stream->layers.size());
+        });
+        if (stream->stopping)
+            return;
+        const WeatherLayer *layer = &stream->layers[stream->next_layer];
+        guard.unlock();
+        buildSpreadTable(&stream->params, layer, stream->width, stream->height, stream->next_table.data());
+        guard.lock();
+        stream->next_ready = true;
+        stream->built.notify_all();
+    }
+}
+
+void buildSpreadTable(const WeatherParams *params, const WeatherLayer *layer, int64_t width, int64_t height,
+                      uint16_t *table) {
+    bool rasters = layer->raster_width > 0 && layer->raster_height > 0;
+    for (int64_t i = 0; i < height; i++) {
+        int64_t y0 = 0, y1 = 0;
+        float fy = 0;
+        if (rasters)
+            rasterCell((i + 0.5f) * layer->raster_height / height - 0.5f, layer->raster_height, &y0, &y1, &fy);
+        for (int64_t j = 0; j < width; j++) {
+            float u = layer->wind_u, v = layer->wind_v, moisture = layer->moisture;
+            if (rasters) {
+                int64_t x0, x1;
+                float fx;
+                rasterCell((j + 0.5f) * layer->raster_width / width - 0.5f, layer->raster_width, &x0, &x1, &fx);
+                int64_t rw = layer->raster_width;
+                u = sampleRaster(layer->wind_u_raster, rw, y0, y1, fy, x0, x1, fx);
+                v = sampleRaster(layer->wind_v_raster, rw, y0, y1, fy, x0, x1, fx);
+                moisture = sampleRaster(layer->moisture_raster, rw, y0, y1, fy, x0, x1, fx);
+            }
+            float dry = 1.f - moisture / params->extinction_moisture;
+            float odds = params->base_odds * (dry > 0 ? dry : 0);
+            // Wind component toward each neighbor
+            float toward[4];
+            toward[DIR_LEFT] = -u;
+            toward[DIR_RIGHT] = u;
+            toward[DIR_DOWN] = -v;
+            toward[DIR_UP] = v;
+            uint16_t *cell = table + 4*(i*width + j);
+            for (int dir = 0; dir < 4; dir++) {
+                float threshold = odds * expf(params->wind_factor * toward[dir]) * 65536.f + 0.5f;
+                // NaN from bad weather never spreads rather than converting
+                // out of range
+                if (threshold >= SPREAD_CERTAIN)
+                    cell[dir] = SPREAD_CERTAIN;
+                else
+                    cell[dir] = threshold >= 1 ? (uint16_t) threshold : 0;
+            }
+        }
+    }
+}
+
+static float sampleRaster(const std::vector<float> &raster, int64_t raster_width, int64_t y0, int64_t y1, float fy,
+                          int64_t x0, int64_t x1, float fx) {
+    float low = raster[y0*raster_width + x0] * (1-fx) + raster[y0*raster_width + x1] * fx;
+    float high = raster[y1*raster_width + x0] * (1-fx) + raster[y1*raster_width + x1] * fx;
+    return low * (1-fy) + high * fy;
+}
+
+// Rasters in use hold a value for every cell
+static bool layerValid(const WeatherLayer *layer) {
+    if (layer->raster_width <= 0 || layer->raster_height <= 0)
+        return true;
+    size_t cells = layer->raster_width*layer->raster_height;
+    return layer->wind_u_raster.size() >= cells && layer->wind_v_raster.size() >= cells
+           && layer->moisture_raster.size() >= cells;
+}
+
+// The two cells around a position in cell units and how far it is between
+// them, holding the edge cell's value past the edges
+static void rasterCell(float at, int64_t cells, int64_t *low, int64_t *high, float *frac) {
+    if (at <= 0) {
+        *low = *high = 0;
+        *frac = 0;
+        return;
+    }
+    if (at >= cells-1) {
+        *low = *high = cells-1;
+        *frac = 0;
+        return;
+    }
+    *low = (int64_t) at;
+    *high = *low + 1;
+    *frac = at - *low;
+}
@@ -0,0 +1,85 @@
+#ifndef WEATHER_H
+#define WEATHER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Weather over the whole grid from start_step until the next layer starts.
+// Wind is in components along +j (u) and +i (v). Without rasters the global
+// values hold everywhere; with them, each raster is raster_width x
+// raster_height cells stretched over the grid and sampled bilinearly, the way
+// hourly weather comes at a much coarser resolution than the fuel.
+typedef struct WeatherLayer
+{
+    int start_step;
+    float wind_u;
+    float wind_v;
+    float moisture;
+    int64_t raster_width;
+    int64_t raster_height;
+    std::vector<float> wind_u_raster;
+    std::vector<float> wind_v_raster;
+    std::vector<float> moisture_raster;
+} WeatherLayer;
+
+// How weather becomes spread odds: a neighbor downwind by w (the wind
+// component toward it) is reached with odds
+// base_odds * (1 - moisture/extinction_moisture) * exp(wind_factor*w),
+// clamped to [0, 1]. Calm, dry weather gives base_odds in every direction.
+typedef struct WeatherParams
+{
+    float base_odds;
+    float wind_factor;
+    float extinction_moisture;
+} WeatherParams;
+
+// Serves the spread table (SimBand::spread) for the layer in force at each
+// step. The table of the next layer is built on a thread of its own while the
+// current one is in use, so switching layers only swaps two buffers. Odds are
+// kept as 16-bit thresholds, so the two tables take 16 bytes a tile.
+typedef struct WeatherStream
+{
+    WeatherParams params;
+    int64_t width;
+    int64_t height;
+    std::vector<WeatherLayer> layers;
+    // Layer in force and its table
+    size_t current;
+    std::vector<uint16_t> table;
+    // Built by the thread: the layer next_layer is for, next_ready once done
+    std::vector<uint16_t> next_table;
+    size_t next_layer;
+    bool next_ready;
+    bool prefetch;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable built;
+    bool stopping;
+    // Layer switches that had to wait for their table, and the time waited
+    int64_t stalls;
+    int64_t stall_us;
+} WeatherStream;
+
+// layers must be sorted by start_step, the first starting at or before the
+// first step. Builds the first table before returning. Without prefetch,
+// tables are built when their layer comes into force, on the caller's thread.
+// Returns NULL when there are no layers, they are out of order, a raster in
+// use is short of raster_width x raster_height cells, or extinction_moisture
+// is not positive.
+WeatherStream *newWeatherStream(const WeatherParams *params, int64_t width, int64_t height,
+                                const std::vector<WeatherLayer> &layers, bool prefetch);
+void freeWeatherStream(WeatherStream *stream);
+// The spread table for step, 4 thresholds a tile. It stays valid until the
+// next call; steps must not go back.
+const uint16_t *weatherSpread(WeatherStream *stream, int step);
+// Fills table (4 thresholds a tile, in DIR_ order, as SimBand::spread takes
+// them) for a layer. Odds round to the nearest 1/65536, and odds within
+// 1/65536 of 1 always spread.
+void buildSpreadTable(const WeatherParams *params, const WeatherLayer *layer, int64_t width, int64_t height,
+                      uint16_t *table);
+
+#endif
@@ -0,0 +1,164 @@
+#include "writer.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <chrono>
+
+static void writeLoop(AsyncWriter *writer);
+static bool continues(const AsyncWrite *last, const AsyncWrite *next);
+static int writeBatch(std::deque<AsyncWrite> &batch, int64_t *written);
+static int writeAll(int fd, int64_t offset, struct iovec *iov, int count, int64_t *written);
+
+AsyncWriter *newAsyncWriter(int64_t max_bytes) {
+    AsyncWriter *writer = new AsyncWriter;
+    writer->queued_bytes = 0;
+    writer->max_bytes = max_bytes;
+    writer->stopping = false;
+    writer->bytes_written = 0;
+    writer->batches = 0;
+    writer->dropped = 0;
+    writer->stall_us = 0;
+    writer->errors = 0;
+    writer->last_error = 0;
+    writer->errors_reported = 0;
+    writer->thread = std::thread(writeLoop, writer);
+    return writer;
+}
+
+bool freeAsyncWriter(AsyncWriter *writer) {
+    {
+        std::lock_guard<std::mutex> guard(writer->lock);
+        writer->stopping = true;
+    }
+    writer->wake.notify_one();
+    writer->thread.join();
+    bool ok = writer->errors == writer->errors_reported;
+    delete writer;
+    return ok;
+}
+
+bool queueWrite(AsyncWriter *writer, int fd, int64_t offset, std::vector<uint8_t> &bytes,
+                bool wait, bool close_after) {
+    int64_t size = bytes.size();
+    std::unique_lock<std::mutex> guard(writer->lock);
+    // An empty queue always has room, so a buffer over the bound still goes
+    auto room = [writer, size] {
+        return writer->queued_bytes == 0 || writer->queued_bytes + size <= writer->max_bytes;
+    };
+    if (!room()) {
+        if (!wait) {
+            writer->dropped++;
+            return false;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        writer->written.wait(guard, room);
+        auto end = std::chrono::high_resolution_clock::now();
+        writer->stall_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+    writer->queue.push_back({fd, offset, std::move(bytes), close_after});
+    bytes.clear();
+    writer->queued_bytes += size;
+    guard.unlock();
+    writer->wake.notify_one();
+    return true;
+}
+
+bool flushAsyncWriter(AsyncWriter *writer) {
+    std::unique_lock<std::mutex> guard(writer->lock);
+    writer->written.wait(guard, [writer] { return writer->queued_bytes == 0; });
+    bool ok = writer->errors == writer->errors_reported;
+    writer->errors_reported = writer->errors;
+    return ok;
+}
+
+// Takes a run of writes that continue one another off the front of the
+// queue, writes them without the lock, and only then gives their room back.
+static void writeLoop(AsyncWriter *writer) {
+    std::unique_lock<std::mutex> guard(writer->lock);
+    while (true) {
+        writer->wake.wait(guard, [writer] { return writer->stopping || !writer->queue.empty(); });
+        if (writer->queue.empty())
+            return;
+        std::deque<AsyncWrite> batch;
+        int64_t size = 0;
+        do {
+            size += writer->queue.front().bytes.size();
+            batch.push_back(std::move(writer->queue.front()));
+            writer->queue.pop_front();
+        } while (!writer->queue.empty() && batch.size() < IOV_MAX
+                 && continues(&batch.back(), &writer->queue.front()));
+        guard.unlock();
+        int64_t written = 0;
+        int error = writeBatch(batch, &written);
+        // Freed outside the lock too
+        batch.clear();
+        guard.lock();
+        // A failed batch is given up on, so all its room comes back
+        writer->queued_bytes -= size;
+        writer->bytes_written += written;
+        writer->batches++;
+        if (error != 0) {
+            writer->errors++;
+            writer->last_error = error;
+        }
+        writer->written.notify_all();
+    }
+}
+
+// True if next picks up in the same file where last leaves off.
+static bool continues(const AsyncWrite *last, const AsyncWrite *next) {
+    if (next->fd != last->fd || last->close_after)
+        return false;
+    if (last->offset < 0 || next->offset < 0)
+        return last->offset < 0 && next->offset < 0;
+    return next->offset == last->offset + (int64_t) last->bytes.size();
+}
+
+// Returns 0, or errno of the write or close that failed. written gets the
+// bytes that went out either way.
+static int writeBatch(std::deque<AsyncWrite> &batch, int64_t *written) {
+    std::vector<struct iovec> iov(batch.size());
+    for (size_t k = 0; k < batch.size(); k++)
+        iov[k] = {batch[k].bytes.data(), batch[k].bytes.size()};
+    int error = writeAll(batch.front().fd, batch.front().offset, iov.data(), iov.size(), written);
+    if (batch.back().close_after && close(batch.back().fd) != 0 && error == 0 && errno != EINTR)
+        error = errno;
+    return error;
+}
+
+// pwritev (or writev at the current position) until every byte is out, since
+// either may write less than asked. Adds the bytes written to written and
+// returns 0, or errno if a write fails; a write taking nothing is an error
+// too, as retrying it would spin.
+static int writeAll(int fd, int64_t offset, struct iovec *iov, int count, int64_t *written) {
+    while (true) {
+        // Empty buffers have nothing to wait for
+        while (count > 0 && iov->iov_len == 0) {
+            iov++;
+            count--;
+        }
+        if (count == 0)
+            return 0;
+        ssize_t wrote = offset < 0 ? writev(fd, iov, count) : pwritev(fd, iov, count, offset);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+        if (wrote < 0)
+            return errno;
+        if (wrote == 0)
+            return EIO;
+        *written += wrote;
+        if (offset >= 0)
+            offset += wrote;
+        while (count > 0 && (size_t) wrote >= iov->iov_len) {
+            wrote -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *) iov->iov_base + wrote;
+            iov->iov_len -= wrote;
+        }
+    }
+}
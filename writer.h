@@ -0,0 +1,67 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One buffer handed to the writer. An offset below 0 writes at the current
+// position, for pipes, sockets and files opened for appending.
+typedef struct AsyncWrite
+{
+    int fd;
+    int64_t offset;
+    std::vector<uint8_t> bytes;
+    // Close fd once this (its last write) is out
+    bool close_after;
+} AsyncWrite;
+
+// Takes buffers off the simulation's hands and writes them from a thread of
+// its own, so the step loop never waits on storage unless it wants to. Writes
+// queued back to back at adjacent offsets of one file go out as a single
+// pwritev.
+typedef struct AsyncWriter
+{
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    // Signalled whenever writes finish, for callers waiting for room
+    std::condition_variable written;
+    std::deque<AsyncWrite> queue;
+    // Bytes queued and not yet written, never more than max_bytes unless a
+    // single buffer is larger
+    int64_t queued_bytes;
+    int64_t max_bytes;
+    bool stopping;
+    // Since the writer started. bytes_written counts only what the system
+    // took, so a failed batch adds what went out before the failure.
+    int64_t bytes_written;
+    int64_t batches;
+    int64_t dropped;
+    int64_t stall_us;
+    // Batches that failed, and errno of the last failure
+    int64_t errors;
+    int last_error;
+    // errors as of the last flush
+    int64_t errors_reported;
+} AsyncWriter;
+
+// max_bytes bounds the memory held by queued buffers.
+AsyncWriter *newAsyncWriter(int64_t max_bytes);
+// Writes out everything queued, then stops the thread. Returns false if a
+// write failed since the last flush.
+bool freeAsyncWriter(AsyncWriter *writer);
+// Hands bytes over, leaving the caller's vector empty. If the queue has no
+// room, waits for it when wait is set and otherwise drops the buffer, so a
+// loop with a time budget keeps to it however slow the storage is. Returns
+// false if the buffer was dropped.
+bool queueWrite(AsyncWriter *writer, int fd, int64_t offset, std::vector<uint8_t> &bytes,
+                bool wait, bool close_after = false);
+// Waits until everything queued so far is written. Returns false if a write
+// failed since the last flush, with errno left in last_error.
+bool flushAsyncWriter(AsyncWriter *writer);
+
+#endif